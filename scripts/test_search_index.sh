@@ -0,0 +1,23 @@
+#!/bin/sh
+# \bget\s*Name also matches "getName": the Bloom filters must not require
+# get and Name as whole tokens, or the file is skipped.
+# \bprice\b matches "price$usd" and "price€": rg's \b treats '$' and '€' as
+# non-word, so the filters must hold "price" although Java reads one name.
+set -e
+repo=$(mktemp -d)
+trap 'rm -rf "$repo"' EXIT
+mkdir -p "$repo/src"
+printf 'class A {\n    String getName() { return "a"; }\n}\n' > "$repo/src/A.java"
+printf 'class B {\n    int price$usd;\n    String s = "price\342\202\254";\n}\n' > "$repo/src/B.java"
+./build/codegencli index --repo-root "$repo" > /dev/null
+
+out=$(./build/codegencli search --repo-root "$repo" --pattern '\bget\s*Name' --index)
+echo "$out"
+echo "$out" | grep -q 'bloom_skipped=0 '
+echo "$out" | grep -q '^hits: 1$'
+
+out=$(./build/codegencli search --repo-root "$repo" --pattern '\bprice\b' --index)
+echo "$out"
+echo "$out" | grep -q 'bloom_skipped=0 '
+echo "$out" | grep -q '^hits: 2$'
+echo OK
@@ -0,0 +1 @@
+./build/codegencli watch --repo-root ../xxxxx --debounce-ms 200 --verbose
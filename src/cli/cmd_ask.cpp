@@ -1,22 +1,33 @@
 
 
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <initializer_list>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "cli/context_out.h"
+
 #include "sys/error.h"
 #include "sys/fd.h"
 #include "sys/io.h"
 #include "sys/process.h"
 
 #include "workspace/context_builder.h"
+#include "workspace/index_io.h"
+#include "workspace/java/parse_cache.h"
 #include "workspace/prompt_spec.h"
 #include "workspace/scanner.h"
+#include "workspace/workspace_index.h"
 
 namespace cli
 {
@@ -24,9 +35,12 @@ namespace cli
 static void usage_ask(const char *argv0)
 {
     std::fprintf(stderr,
-                 "Usage: %s ask --prompt <prompt.txt> [--py <python>] [--script <llm_adaptor.py>]\n"
-                 "Writes: context.txt and answer.txt in current directory.\n"
-                 "Defaults: --py python3 --script python/llm_adaptor.py\n",
+                 "Usage: %s ask --prompt <prompt.txt> [--py <python>] [--script <llm_adaptor.py>] [--layout task-first|stable]\n"
+                 "Writes: etc/context.txt, etc/prompt.txt and etc/gen.txt.\n"
+                 "Defaults: --py python3 --script python/llm_adaptor.py --layout task-first\n"
+                 "--layout stable puts instructions and sorted snippets first and the task last, so\n"
+                 "consecutive prompts share a long prefix; the prefix shared with the previous\n"
+                 "etc/prompt.txt is reported.\n",
                  argv0);
 }
 
@@ -41,138 +55,190 @@ static int scope_to_hops(Scope s)
     return -1;
 }
 
-static void write_str(int fd, const std::string &s)
-{
-    if (write_all(fd, reinterpret_cast<const uint8_t *>(s.data()), s.size()) < 0) {
-        die("write");
-    }
-}
+static const char kSnippetEnd[] = "\n[/SNIPPET]\n";
 
-static void write_context_file(const ContextRequest &req,
-                               const ContextOptions &opt,
-                               const ContextPack &pack,
-                               const char *path)
+enum class PromptLayout
 {
-    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
-    if (fd < 0) {
-        die("open(context.txt)");
-    }
+    TaskFirst,
+    Stable
+};
 
-    Fd f;
-    f.reset(fd);
-
-    std::string head;
-    head += "[CONTEXT]\n";
-    head += "repo_root: " + req.repo_root + "\n";
-    head += "anchor_class: " + req.anchor_class_fqcn + "\n";
-    head += "anchor_method: " + req.anchor_method + "\n";
-    head += "max_hops: " + std::to_string(opt.max_hops) + "\n";
-    head += "max_snippets: " + std::to_string(opt.max_snippets) + "\n";
-    head += "max_bytes: " + std::to_string(opt.max_bytes) + "\n";
-    head += "====\n";
-    write_str(f.get(), head);
-
-    for (const ContextSnippet &s : pack.snippets) {
-        std::string block;
-        block += "\n[SNIPPET]\n";
-        block += "hop: " + std::to_string(s.hop) + "\n";
-        block += "score: " + std::to_string(s.score) + "\n";
-        block += "symbol: " + s.symbol + "\n";
-        block += "file: " + s.rel_path + "\n";
-        block += "kind: " + s.kind + "\n";
-        block += "range: " + std::to_string(s.start) + ".." + std::to_string(s.end) + "\n";
-        block += "----\n";
-        block += s.text;
-        block += "\n[/SNIPPET]\n";
-        write_str(f.get(), block);
-    }
+static void append_output_format(std::string *p)
+{
+    *p += "OUTPUT FORMAT:\n";
+    *p += "- Output plain text only (no markdown fences).\n";
+    *p += "- If you propose changes to files, output the COMPLETE contents of each file.\n";
+    *p += "- Use this exact header before each file:\n";
+    *p += "  FILE: <relative/path>\n";
+    *p += "- If only one file is involved, output that file only.\n";
+    *p += "- Do not include explanations unless explicitly asked in TASK.\n";
+    *p += "\n";
+}
 
-    std::string tail;
-    tail += "\n[STATS]\n";
-    tail += "hops_used: " + std::to_string(pack.stats.hops_used) + "\n";
-    tail += "snippets_written: " + std::to_string(pack.stats.snippets_written) + "\n";
-    tail += "bytes_written: " + std::to_string(pack.stats.bytes_written) + "\n";
-    tail += "symbols_seen: " + std::to_string(pack.stats.symbols_seen) + "\n";
-    tail += "rg_queries: " + std::to_string(pack.stats.rg_queries) + "\n";
-    tail += "rg_hits_total: " + std::to_string(pack.stats.rg_hits_total) + "\n";
-    tail += "[/STATS]\n";
-    tail += "[/CONTEXT]\n";
-    write_str(f.get(), tail);
+static void append_task(const PromptSpec &spec, std::string *p)
+{
+    *p += "TASK:\n";
+    *p += spec.task_text.empty() ? "(no task text provided)\n" : (spec.task_text + "\n");
 }
 
-static std::string build_final_prompt(const PromptSpec &spec,
-                                      const ContextRequest &req,
-                                      const ContextOptions &opt,
-                                      const ContextPack &pack)
+// v1 prompt: general-purpose one-shot codegen.
+// Output contract: plain text. If multiple files, use FILE: <path> headers and full file contents.
+//
+// TaskFirst: task, output format, anchor, snippets in pack order.
+// Stable, for provider prefix caches: fixed instructions, snippets by file
+// and offset with only what doesn't depend on how they were reached (no hop
+// or symbol), then the anchor and finally the task text.
+static std::string prompt_head(const PromptSpec &spec,
+                               const ContextRequest &req,
+                               const ContextOptions &opt,
+                               PromptLayout layout)
 {
-    // v1 prompt: general-purpose one-shot codegen.
-    // Output contract: plain text. If multiple files, use FILE: <path> headers and full file contents.
     std::string p;
-
     p += "You are a senior software engineer. Follow instructions carefully.\n";
     p += "\n";
-    p += "TASK:\n";
-    p += spec.task_text.empty() ? "(no task text provided)\n" : (spec.task_text + "\n");
-    p += "\n";
-    p += "OUTPUT FORMAT:\n";
-    p += "- Output plain text only (no markdown fences).\n";
-    p += "- If you propose changes to files, output the COMPLETE contents of each file.\n";
-    p += "- Use this exact header before each file:\n";
-    p += "  FILE: <relative/path>\n";
-    p += "- If only one file is involved, output that file only.\n";
-    p += "- Do not include explanations unless explicitly asked in TASK.\n";
-    p += "\n";
+    if (layout == PromptLayout::TaskFirst) {
+        append_task(spec, &p);
+        p += "\n";
+    }
+    append_output_format(&p);
     p += "CONTEXT:\n";
     p += "repo_root: " + req.repo_root + "\n";
-    p += "anchor_class: " + req.anchor_class_fqcn + "\n";
-    p += "anchor_method: " + req.anchor_method + "\n";
-    p += "max_hops: " + std::to_string(opt.max_hops) + "\n";
-    p += "\n";
-
-    for (const ContextSnippet &s : pack.snippets) {
+    if (layout == PromptLayout::TaskFirst) {
+        p += "anchor_class: " + req.anchor_class_fqcn + "\n";
+        p += "anchor_method: " + req.anchor_method + "\n";
+        p += "max_hops: " + std::to_string(opt.max_hops) + "\n";
         p += "\n";
-        p += "[SNIPPET]\n";
+    }
+    return p;
+}
+
+static std::string prompt_snippet_header(const ContextSnippet &s, PromptLayout layout)
+{
+    std::string p;
+    p += "\n";
+    p += "[SNIPPET]\n";
+    if (layout == PromptLayout::TaskFirst) {
         p += "hop: " + std::to_string(s.hop) + "\n";
         p += "symbol: " + s.symbol + "\n";
-        p += "file: " + s.rel_path + "\n";
-        p += "kind: " + s.kind + "\n";
-        p += "----\n";
-        p += s.text;
-        p += "\n[/SNIPPET]\n";
     }
+    p += "file: " + s.rel_path + "\n";
+    p += "kind: " + s.kind + "\n";
+    p += "----\n";
+    return p;
+}
 
+static std::string prompt_tail(const PromptSpec &spec,
+                               const ContextRequest &req,
+                               const ContextOptions &opt,
+                               PromptLayout layout)
+{
+    std::string p;
+    if (layout == PromptLayout::Stable) {
+        p += "\n";
+        p += "anchor_class: " + req.anchor_class_fqcn + "\n";
+        p += "anchor_method: " + req.anchor_method + "\n";
+        p += "max_hops: " + std::to_string(opt.max_hops) + "\n";
+        p += "\n";
+        append_task(spec, &p);
+    }
     p += "\nEND.\n";
     return p;
 }
 
-static void run_python_llm(const char *py,
-                           const char *script,
-                           const std::string &prompt,
-                           const char *answer_path)
+// False if the reader is gone (EPIPE); other errors are fatal.
+static bool write_parts(int fd, std::initializer_list<std::string_view> parts, const char *what)
 {
-    SpawnSpec spec;
-    spec.exe = py;
-    spec.argv = {py, script};
+    struct iovec iov[4];
+    int n = 0;
+    for (std::string_view part : parts) {
+        if (n == 4) {
+            break;
+        }
+        iov[n].iov_base = const_cast<char *>(part.data());
+        iov[n].iov_len = part.size();
+        n++;
+    }
+    if (writev_all(fd, iov, n) < 0) {
+        if (errno == EPIPE) {
+            return false;
+        }
+        die(what);
+    }
+    return true;
+}
+
+// The prompt goes to the adaptor's stdin and to etc/prompt.txt as it is
+// produced. shared counts the leading bytes that match the previous prompt,
+// i.e. what a provider could serve from its prefix cache if it is warm.
+// Once the adaptor has exited the rest only goes to the file.
+struct PromptOut
+{
+    int child_fd = -1;
+    int file_fd = -1;
+    bool child_gone = false;
+    std::string prev;
+    size_t sent = 0;
+    size_t shared = 0;
+
+    void send(std::initializer_list<std::string_view> parts)
+    {
+        for (std::string_view part : parts) {
+            if (shared == sent && sent < prev.size()) {
+                size_t n = std::min(part.size(), prev.size() - sent);
+                auto it = std::mismatch(part.begin(), part.begin() + n, prev.begin() + static_cast<std::ptrdiff_t>(sent));
+                shared += static_cast<size_t>(it.first - part.begin());
+            }
+            sent += part.size();
+        }
+        if (!child_gone && !write_parts(child_fd, parts, "write(child stdin)")) {
+            child_gone = true;
+        }
+        write_parts(file_fd, parts, "write(etc/prompt.txt)");
+    }
+};
 
-    ChildProcess cp = spawn(spec);
+// Writes each snippet to etc/context.txt, and to the prompt when the layout
+// keeps pack order, as the builder accepts it: header and text go out in one
+// writev without being joined.
+class AskSink : public SnippetSink
+{
+public:
+    AskSink(OutWriter *context, PromptOut *prompt, PromptLayout layout)
+        : context_(context), prompt_(prompt), layout_(layout)
+    {
+    }
 
-    // Write prompt to child stdin
-    if (write_all(cp.stdin_w.get(),
-                       reinterpret_cast<const uint8_t *>(prompt.data()),
-                       prompt.size()) < 0) {
-        die("write(child stdin)");
+    void accept(const ContextSnippet &s) override
+    {
+        // s may move when the pack grows, so its text can't stay queued
+        write_context_snippet(*context_, s);
+        context_->flush();
+        if (prompt_) {
+            prompt_->send({prompt_snippet_header(s, layout_), s.text, kSnippetEnd});
+        }
     }
-    cp.stdin_w.close(); // EOF
 
-    int fd = open(answer_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+private:
+    OutWriter *context_;
+    PromptOut *prompt_;
+    PromptLayout layout_;
+};
+
+static int open_or_die(const char *path)
+{
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
     if (fd < 0) {
-        die("open(answer.txt)");
+        die(path);
     }
+    return fd;
+}
 
+static void finish_llm(ChildProcess &cp, const char *answer_path)
+{
     Fd out_file;
-    out_file.reset(fd);
+    out_file.reset(open_or_die(answer_path));
 
-    // Stream child stdout -> answer.txt, child stderr -> terminal stderr
+    // Stream child stdout -> answer file, child stderr -> terminal stderr
     stream_to_parent(cp, out_file.get());
 
     ExitStatus es = wait_child(cp.pid);
@@ -187,6 +253,7 @@ int cmd_ask(int argc, char **argv)
     const char *prompt_path = nullptr;
     const char *py = "python3";
     const char *script = "python/llm_adaptor.py";
+    PromptLayout layout = PromptLayout::TaskFirst;
 
     for (int i = 2; i < argc; i++) {
         if (std::strcmp(argv[i], "--prompt") == 0) {
@@ -198,6 +265,16 @@ int cmd_ask(int argc, char **argv)
         } else if (std::strcmp(argv[i], "--script") == 0) {
             if (++i >= argc) { usage_ask(argv[0]); return 2; }
             script = argv[i];
+        } else if (std::strcmp(argv[i], "--layout") == 0) {
+            if (++i >= argc) { usage_ask(argv[0]); return 2; }
+            if (std::strcmp(argv[i], "stable") == 0) {
+                layout = PromptLayout::Stable;
+            } else if (std::strcmp(argv[i], "task-first") == 0) {
+                layout = PromptLayout::TaskFirst;
+            } else {
+                usage_ask(argv[0]);
+                return 2;
+            }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_ask(argv[0]);
             return 0;
@@ -220,6 +297,15 @@ int cmd_ask(int argc, char **argv)
         return 2;
     }
 
+    // Started first so interpreter startup overlaps the scan and context
+    // build; the prompt is streamed into its stdin as it is produced.
+    SpawnSpec child_spec;
+    child_spec.exe = py;
+    child_spec.argv = {py, script};
+    ChildProcess cp = spawn(child_spec);
+    // an adaptor that exits early must not kill us mid-write; see PromptOut
+    std::signal(SIGPIPE, SIG_IGN);
+
     // Defaults
     ContextRequest req;
     req.repo_root = spec.repo_root.empty() ? ".." : spec.repo_root;
@@ -232,25 +318,84 @@ int cmd_ask(int argc, char **argv)
         opt.max_hops = hops;
     }
 
+    PromptOut prompt;
+    prompt.child_fd = cp.stdin_w.get();
+    read_file_bytes("etc/prompt.txt", &prompt.prev);
+    Fd prompt_file;
+    prompt_file.reset(open_or_die("etc/prompt.txt"));
+    prompt.file_fd = prompt_file.get();
+
+    // intermediate context file for debugging
+    Fd context_file;
+    context_file.reset(open_or_die("etc/context.txt"));
+    OutWriter context_out(context_file.get(), "write(etc/context.txt)");
+
+    write_context_head(context_out, req, opt);
+    prompt.send({prompt_head(spec, req, opt, layout)});
+
     // Scan workspace and build context pack
     ScanOptions scan_opt;
-    std::vector<FileEntry> files = scan_workspace(req.repo_root, scan_opt);
+    FileTable files = scan_workspace(req.repo_root, scan_opt);
+
+    // used when `index` has been run for this repo
+    WorkspaceIndex index;
+    open_workspace_index(files.root(), "", &index);
+    opt.pack_cache_dir = default_index_dir(files.root());
+
+    // snippets reach the prompt as they are accepted unless they get sorted
+    AskSink sink(&context_out, layout == PromptLayout::TaskFirst ? &prompt : nullptr, layout);
+
+    // anchor and hit files get parsed several times per run
+    JavaParseCache parse_cache;
+    set_java_parse_cache(&parse_cache);
+    ContextPack pack = build_context_pack(req, opt, files, &index, &sink);
+    set_java_parse_cache(nullptr);
+    write_context_stats(context_out, pack.stats);
+    context_out.flush();
 
-    ContextPack pack = build_context_pack(req, opt, files);
     if (pack.snippets.empty()) {
+        // the adaptor must not act on a prompt without context
+        kill(cp.pid, SIGKILL);
+        wait_child(cp.pid);
         std::fprintf(stderr, "ask: context pack is empty (anchor not found or extraction failed)\n");
         return 1;
     }
 
-    // intermediate context file for debugging
-    write_context_file(req, opt, pack, "etc/context.txt");
+    if (layout == PromptLayout::Stable) {
+        std::vector<const ContextSnippet *> order;
+        order.reserve(pack.snippets.size());
+        for (const ContextSnippet &s : pack.snippets) {
+            order.push_back(&s);
+        }
+        std::sort(order.begin(), order.end(),
+                  [](const ContextSnippet *a, const ContextSnippet *b)
+                  {
+                      if (a->rel_path != b->rel_path) {
+                          return a->rel_path < b->rel_path;
+                      }
+                      return a->start < b->start;
+                  });
+        for (const ContextSnippet *s : order) {
+            prompt.send({prompt_snippet_header(*s, layout), s->text, kSnippetEnd});
+        }
+    }
+    prompt.send({prompt_tail(spec, req, opt, layout)});
+    cp.stdin_w.close(); // EOF
 
-    std::string final_prompt = build_final_prompt(spec, req, opt, pack);
+    std::printf("prompt_bytes: %zu\n", prompt.sent);
+    std::printf("shared_prefix_bytes: %zu\n", prompt.shared);
+    double pct = prompt.sent == 0 ? 0.0 : 100.0 * static_cast<double>(prompt.shared) / static_cast<double>(prompt.sent);
+    std::printf("shared_prefix_pct: %.1f\n", pct);
 
-    // write to gen.txt
-    run_python_llm(py, script, final_prompt, "etc/gen.txt");
+    // write to gen.txt; also reports the adaptor's stderr and exit code
+    // when it quit before reading the whole prompt
+    finish_llm(cp, "etc/gen.txt");
+    if (prompt.child_gone) {
+        std::fprintf(stderr, "ask: adaptor exited before reading the whole prompt\n");
+        return 1;
+    }
 
-    std::printf("Wrote etc/context.txt and generated code in etc/gen.txt\n");
+    std::printf("Wrote etc/context.txt, etc/prompt.txt and generated code in etc/gen.txt\n");
     return 0;
 }
 
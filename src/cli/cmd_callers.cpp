@@ -0,0 +1,148 @@
+
+#include "cli/commands.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/index_io.h"
+#include "workspace/java/callers.h"
+#include "workspace/java/ident_index.h"
+#include "workspace/scanner.h"
+
+namespace cli
+{
+
+static void usage_callers(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "Usage: %s callers --method <name> [--repo-root <path>] [--index-dir <path>] [--limit <N>]\n"
+                 "Lists the methods and constructors that call <name>, one line per caller,\n"
+                 "from the call edges recorded by `index`. Without an index, or for files\n"
+                 "changed since indexing, call sites are found with rg.\n"
+                 "Defaults: --repo-root .. --index-dir <repo-root>/.codegencli --limit 50\n",
+                 argv0);
+}
+
+
+struct CallerRow
+{
+    FileId file = kNoFile;
+    size_t start = 0;
+    uint64_t first_call = 0;
+    uint64_t line = 0;
+    int calls = 0;
+    std::string name;
+    bool from_index = false;
+};
+
+
+int cmd_callers(int argc, char **argv)
+{
+    const char *repo_root = "..";
+    const char *index_dir = nullptr;
+    const char *method = nullptr;
+    int limit = 50;
+
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--repo-root") == 0) {
+            if (++i >= argc) { usage_callers(argv[0]); return 2; }
+            repo_root = argv[i];
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_callers(argv[0]); return 2; }
+            index_dir = argv[i];
+        } else if (std::strcmp(argv[i], "--method") == 0) {
+            if (++i >= argc) { usage_callers(argv[0]); return 2; }
+            method = argv[i];
+        } else if (std::strcmp(argv[i], "--limit") == 0) {
+            if (++i >= argc) { usage_callers(argv[0]); return 2; }
+            limit = std::atoi(argv[i]);
+            if (limit < 0) limit = 0;
+        } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            usage_callers(argv[0]);
+            return 0;
+        } else {
+            std::fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+            usage_callers(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!method) {
+        std::fprintf(stderr, "Missing required flag: --method <name>\n");
+        usage_callers(argv[0]);
+        return 2;
+    }
+
+    ScanOptions opt;
+    FileTable files = scan_workspace(repo_root, opt);
+
+    std::string dir = index_dir ? std::string(index_dir) : default_index_dir(files.root());
+    IdentIndex idents;
+    std::string err;
+    bool have_index = idents.open(ident_index_path(dir), &err);
+
+    RgQuery scope;
+    scope.globs = {"*.java"};
+
+    std::vector<CallerSite> sites;
+    CallerStats cst;
+    find_callers(repo_root, files, have_index ? &idents : nullptr, scope, method, &sites, &cst);
+
+    // sites are in (path, offset) order, so calls from one declaration are adjacent
+    std::vector<CallerRow> rows;
+    for (const CallerSite &s : sites) {
+        if (!rows.empty() && rows.back().file == s.file && rows.back().start == s.caller_start) {
+            rows.back().calls += 1;
+            continue;
+        }
+        CallerRow r;
+        r.file = s.file;
+        r.start = s.caller_start;
+        r.first_call = s.call_offset;
+        r.calls = 1;
+        r.name = s.caller_name;
+        r.from_index = s.from_index;
+        rows.push_back(std::move(r));
+    }
+
+    size_t total = rows.size();
+    size_t n = std::min(total, static_cast<size_t>(limit));
+    rows.resize(n);
+
+    std::string src;
+    FileId loaded = kNoFile;
+    for (CallerRow &r : rows) {
+        if (r.file != loaded) {
+            loaded = r.file;
+            if (!read_file_bytes(files.abs_path(r.file), &src)) {
+                src.clear();
+            }
+        }
+        size_t end = std::min<size_t>(r.start, src.size());
+        r.line = 1 + static_cast<uint64_t>(std::count(src.begin(), src.begin() + static_cast<std::ptrdiff_t>(end), '\n'));
+    }
+
+    std::printf("method: %s\n", method);
+    std::printf("index: %s\n", have_index ? "yes" : err.c_str());
+    std::printf("callers: %zu\n", total);
+    std::printf("call_sites: %zu\n", sites.size());
+    std::printf("showing: %zu\n", n);
+    std::printf("stale_files: %zu%s\n", cst.stale_files, cst.rg_failed ? " (rg failed)" : "");
+    for (const CallerRow &r : rows) {
+        std::string_view rel = files.rel_path(r.file);
+        std::printf("%.*s:%llu caller=%s calls=%d source=%s\n",
+                    static_cast<int>(rel.size()), rel.data(),
+                    static_cast<unsigned long long>(r.line),
+                    r.name.empty() ? "?" : r.name.c_str(),
+                    r.calls,
+                    r.from_index ? "index" : "rg");
+    }
+    return 0;
+}
+
+} // namespace cli
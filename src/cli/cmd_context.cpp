@@ -1,4 +1,6 @@
 #include "cli/commands.h"
+#include "cli/context_out.h"
+#include "cli/jsonl.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -11,11 +13,13 @@
 
 #include "sys/error.h"
 #include "sys/fd.h"
-#include "sys/io.h"
 
 #include "workspace/context_builder.h"
+#include "workspace/index_io.h"
+#include "workspace/java/parse_cache.h"
 #include "workspace/prompt_spec.h"
 #include "workspace/scanner.h"
+#include "workspace/workspace_index.h"
 
 namespace cli
 {
@@ -26,6 +30,10 @@ static void usage_context(const char *argv0)
                  "Usage: %s context [--prompt <file>] [--repo-root <path>] [--class <FQCN>] [--method <name>] [--out <path|->]\n"
                  "                 [--max-hops N] [--max-snippets N] [--max-bytes N]\n"
                  "                 [--max-symbols-per-method N] [--max-rg-hits-per-symbol N] [--max-snippets-per-symbol N]\n"
+                 "                 [--max-callers N] [--parse-timeout-ms N] [--parse-budget-ms N] [--max-parse-bytes N]\n"
+                 "                 [--deadline-ms N] [--max-tokens N] [--token-vocab <file>]\n"
+                 "                 [--compact] [--strip-annotations] [--full-classes]\n"
+                 "                 [--index-dir <path>] [--no-index] [--no-pack-cache] [--format text|jsonl]\n"
                  "\n"
                  "Prompt format:\n"
                  "  [HINTS]\n"
@@ -36,7 +44,16 @@ static void usage_context(const char *argv0)
                  "  [/HINTS]\n"
                  "  [TASK] ... [/TASK] (optional)\n"
                  "\n"
-                 "Defaults: --repo-root .. --out context.txt\n",
+                 "Defaults: --repo-root .. --out context.txt --index-dir <repo-root>/.codegencli\n"
+                 "The index (see `index`) is used when present unless --no-index is given.\n"
+                 "Packs are cached under <index-dir>/packs and reused while their files are unchanged.\n"
+                 "--token-vocab takes a tiktoken-style file (\"<base64> <rank>\" per line) or one token per line;\n"
+                 "without it tokens are estimated.\n"
+                 "--compact drops comments and blank lines and collapses indentation in snippets;\n"
+                 "--strip-annotations implies it and also removes annotations.\n"
+                 "Hits outside any method give a class skeleton (bodies elided) unless --full-classes.\n"
+                 "--format jsonl writes a \"context\" record, then each \"snippet\" record as soon as it is\n"
+                 "accepted, then a \"stats\" record.\n",
                  argv0);
 }
 
@@ -55,13 +72,6 @@ static int open_out_fd(const char *out_path, Fd *out_file)
     return out_file->get();
 }
 
-static void write_str(int out_fd, const std::string &s)
-{
-    if (write_all(out_fd, reinterpret_cast<const uint8_t *>(s.data()), s.size()) < 0) {
-        die("write(out)");
-    }
-}
-
 static int scope_to_hops(Scope s)
 {
     if (s == Scope::Local) {
@@ -81,45 +91,30 @@ static void write_pack(int out_fd,
                        const ContextOptions &opt,
                        const ContextPack &pack)
 {
-    std::string head;
-    head += "[CONTEXT]\n";
-    head += "repo_root: " + req.repo_root + "\n";
-    head += "anchor_class: " + req.anchor_class_fqcn + "\n";
-    head += "anchor_method: " + req.anchor_method + "\n";
-    head += "max_hops: " + std::to_string(opt.max_hops) + "\n";
-    head += "max_snippets: " + std::to_string(opt.max_snippets) + "\n";
-    head += "max_bytes: " + std::to_string(opt.max_bytes) + "\n";
-    head += "====\n";
-    write_str(out_fd, head);
-
+    OutWriter w(out_fd);
+    write_context_head(w, req, opt);
     for (const ContextSnippet &s : pack.snippets) {
-        std::string block;
-        block += "\n[SNIPPET]\n";
-        block += "hop: " + std::to_string(s.hop) + "\n";
-        block += "score: " + std::to_string(s.score) + "\n";
-        block += "symbol: " + s.symbol + "\n";
-        block += "file: " + s.rel_path + "\n";
-        block += "kind: " + s.kind + "\n";
-        block += "range: " + std::to_string(s.start) + ".." + std::to_string(s.end) + "\n";
-        block += "----\n";
-        block += s.text;
-        block += "\n[/SNIPPET]\n";
-        write_str(out_fd, block);
-    }
-
-    std::string tail;
-    tail += "\n[STATS]\n";
-    tail += "hops_used: " + std::to_string(pack.stats.hops_used) + "\n";
-    tail += "snippets_written: " + std::to_string(pack.stats.snippets_written) + "\n";
-    tail += "bytes_written: " + std::to_string(pack.stats.bytes_written) + "\n";
-    tail += "symbols_seen: " + std::to_string(pack.stats.symbols_seen) + "\n";
-    tail += "rg_queries: " + std::to_string(pack.stats.rg_queries) + "\n";
-    tail += "rg_hits_total: " + std::to_string(pack.stats.rg_hits_total) + "\n";
-    tail += "[/STATS]\n";
-    tail += "[/CONTEXT]\n";
-    write_str(out_fd, tail);
+        write_context_snippet(w, s);
+    }
+    write_context_stats(w, pack.stats);
 }
 
+// jsonl records go out as the builder accepts each snippet
+class JsonlSink : public SnippetSink
+{
+public:
+    explicit JsonlSink(OutWriter *w) : w_(w) {}
+
+    void accept(const ContextSnippet &s) override
+    {
+        write_context_snippet_jsonl(*w_, s);
+        w_->flush();
+    }
+
+private:
+    OutWriter *w_;
+};
+
 int cmd_context(int argc, char **argv)
 {
     const char *prompt_path = nullptr;
@@ -128,6 +123,10 @@ int cmd_context(int argc, char **argv)
     const char *fqcn = nullptr;
     const char *method = nullptr;
     const char *out_path = "context.txt";
+    const char *index_dir = "";
+    bool use_pack_cache = true;
+    bool use_index = true;
+    OutputFormat format = OutputFormat::Text;
 
     ContextOptions opt;
 
@@ -165,6 +164,43 @@ int cmd_context(int argc, char **argv)
         } else if (std::strcmp(argv[i], "--max-snippets-per-symbol") == 0) {
             if (++i >= argc) { usage_context(argv[0]); return 2; }
             opt.max_snippets_per_symbol = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--max-callers") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.max_callers = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--parse-timeout-ms") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.parse_timeout_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--parse-budget-ms") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.parse_budget_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--max-parse-bytes") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.max_parse_bytes = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--deadline-ms") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.deadline_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--max-tokens") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.max_tokens = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--token-vocab") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            opt.token_vocab = argv[i];
+        } else if (std::strcmp(argv[i], "--full-classes") == 0) {
+            opt.class_skeletons = false;
+        } else if (std::strcmp(argv[i], "--compact") == 0) {
+            opt.compact_snippets = true;
+        } else if (std::strcmp(argv[i], "--strip-annotations") == 0) {
+            opt.compact_snippets = true;
+            opt.strip_annotations = true;
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_context(argv[0]); return 2; }
+            index_dir = argv[i];
+        } else if (std::strcmp(argv[i], "--no-index") == 0) {
+            use_index = false;
+        } else if (std::strcmp(argv[i], "--no-pack-cache") == 0) {
+            use_pack_cache = false;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) { usage_context(argv[0]); return 2; }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_context(argv[0]);
             return 0;
@@ -217,19 +253,41 @@ int cmd_context(int argc, char **argv)
     }
 
     ScanOptions scan_opt;
-    std::vector<FileEntry> files = scan_workspace(repo_root_str, scan_opt);
+    FileTable files = scan_workspace(repo_root_str, scan_opt);
 
     ContextRequest req;
     req.repo_root = repo_root_str;
     req.anchor_class_fqcn = fqcn_str;
     req.anchor_method = method_str;
 
-    ContextPack pack = build_context_pack(req, opt, files);
+    WorkspaceIndex index;
+    if (use_index) {
+        open_workspace_index(files.root(), index_dir, &index);
+    }
+    if (use_pack_cache) {
+        opt.pack_cache_dir = *index_dir ? std::string(index_dir) : default_index_dir(files.root());
+    }
+
+    // anchor and hit files get parsed several times per run
+    JavaParseCache parse_cache;
+    set_java_parse_cache(&parse_cache);
 
     Fd out_file;
-    int out_fd = open_out_fd(out_path, &out_file);
-
-    write_pack(out_fd, req, opt, pack);
+    ContextPack pack;
+    if (format == OutputFormat::Jsonl) {
+        int out_fd = open_out_fd(out_path, &out_file);
+        OutWriter w(out_fd);
+        write_context_head_jsonl(w, req, opt);
+        w.flush();
+        JsonlSink sink(&w);
+        pack = build_context_pack(req, opt, files, &index, &sink);
+        write_context_stats_jsonl(w, pack.stats);
+    } else {
+        pack = build_context_pack(req, opt, files, &index);
+        int out_fd = open_out_fd(out_path, &out_file);
+        write_pack(out_fd, req, opt, pack);
+    }
+    set_java_parse_cache(nullptr);
 
     if (pack.snippets.empty()) {
         std::fprintf(stderr, "context: no snippets produced (anchor not found or extraction failed)\n");
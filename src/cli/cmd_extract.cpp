@@ -1,5 +1,7 @@
 
 
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -9,9 +11,10 @@
 #include <unistd.h>
 #include <vector>
 
+#include "cli/jsonl.h"
 #include "sys/error.h"
 #include "sys/fd.h"
-#include "sys/io.h"
+#include "sys/out_writer.h"
 #include "workspace/java/extractor.h"
 #include "workspace/java/locator.h"
 #include "workspace/scanner.h"
@@ -19,13 +22,21 @@
 namespace cli
 {
 
+static constexpr uint64_t kExtractMaxFileBytes = 64ull * 1024 * 1024;
+
 
 static void usage_extract(const char *argv0)
 {
     std::fprintf(stderr,
-                 "Usage: %s extract --class <FQCN> --method <name> [--repo-root <path>] [--out <path|->] [--verbose]\n"
+                 "Usage: %s extract --class <FQCN> --method <spec> [--method <spec> ...] [--repo-root <path>] [--out <path|->]\n"
+                 "                  [--lex-above <bytes>] [--compare] [--verbose] [--format text|jsonl]\n"
+                 "  <spec>: name | name/<nparams> | name(Type,Type...)\n"
+                 "  every overload matching any spec is written; the file is parsed once\n"
+                 "  --lex-above: files this big are lexed, not parsed (default 1 MiB; 0 = always)\n"
+                 "  --compare:   time the lexer and tree-sitter paths on the file and report\n"
+                 "  --format:    jsonl writes one \"method\" record per extracted method\n"
                  "Defaults: --repo-root .. --out answer.txt\n"
-                 "Example:  %s extract --repo-root .. --class com.foo.Bar --method baz --out answer.txt\n",
+                 "Example:  %s extract --repo-root .. --class com.foo.Bar --method baz --method 'qux(String,int)' --out answer.txt\n",
                  argv0, argv0);
 }
 
@@ -45,13 +56,60 @@ static int open_out_fd(const char *out_path, Fd *out_file)
 }
 
 
+static long long elapsed_us(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+// Runs both extraction paths on one file; the lexer numbers include verifying
+// each match with tree-sitter.
+static int compare_paths(const ClassLocation &loc, const std::vector<MethodQuery> &queries)
+{
+    using clock = std::chrono::steady_clock;
+    std::string lex_err;
+    std::string ts_err;
+    ExtractStats es;
+
+    clock::time_point t0 = clock::now();
+    std::vector<Method> lexed = extract_methods_from_file(loc.abs_path, loc.rel_path, queries, &lex_err, 0, &es);
+    long long lex_us = elapsed_us(t0);
+
+    t0 = clock::now();
+    std::vector<Method> parsed = extract_methods_from_file(loc.abs_path, loc.rel_path, queries, &ts_err, UINT64_MAX);
+    long long ts_us = elapsed_us(t0);
+
+    bool agree = lexed.size() == parsed.size();
+    for (size_t i = 0; agree && i < lexed.size(); i++) {
+        agree = lexed[i].start == parsed[i].start && lexed[i].end == parsed[i].end;
+    }
+
+    std::printf("file: %s\n", loc.rel_path.c_str());
+    std::printf("lexer_us: %lld\n", lex_us);
+    std::printf("lexer_matches: %zu\n", lexed.size());
+    std::printf("lexer_verified: %zu\n", es.verified);
+    std::printf("lexer_fell_back: %s\n", es.fell_back ? "yes" : "no");
+    std::printf("treesitter_us: %lld\n", ts_us);
+    std::printf("treesitter_matches: %zu\n", parsed.size());
+    std::printf("agree: %s\n", agree ? "yes" : "no");
+    if (!lex_err.empty() || !ts_err.empty()) {
+        std::fprintf(stderr, "compare: %s\n", (lex_err.empty() ? ts_err : lex_err).c_str());
+        return 1;
+    }
+    return agree ? 0 : 1;
+}
+
+
 int cmd_extract(int argc, char **argv)
 {
     const char *repo_root = "..";
     const char *fqcn = nullptr;
-    const char *method = nullptr;
+    std::vector<std::string> specs;
     const char *out_path = "src/cli/test.txt";
+    uint64_t lex_above = kLexExtractMinBytes;
+    bool compare = false;
     bool verbose = false;
+    OutputFormat format = OutputFormat::Text;
 
     for (int i = 2; i < argc; i++) {
         if (std::strcmp(argv[i], "--repo-root") == 0) {
@@ -62,12 +120,19 @@ int cmd_extract(int argc, char **argv)
             fqcn = argv[i];
         } else if (std::strcmp(argv[i], "--method") == 0) {
             if (++i >= argc) { usage_extract(argv[0]); return 2; }
-            method = argv[i];
+            specs.push_back(argv[i]);
         } else if (std::strcmp(argv[i], "--out") == 0) {
             if (++i >= argc) { usage_extract(argv[0]); return 2; }
             out_path = argv[i];
+        } else if (std::strcmp(argv[i], "--lex-above") == 0) {
+            if (++i >= argc) { usage_extract(argv[0]); return 2; }
+            lex_above = std::strtoull(argv[i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--compare") == 0) {
+            compare = true;
         } else if (std::strcmp(argv[i], "--verbose") == 0) {
             verbose = true;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) { usage_extract(argv[0]); return 2; }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_extract(argv[0]);
             return 0;
@@ -78,14 +143,24 @@ int cmd_extract(int argc, char **argv)
         }
     }
 
-    if (!fqcn || !method) {
+    if (!fqcn || specs.empty()) {
         std::fprintf(stderr, "Missing required flags: --class and/or --method\n");
         usage_extract(argv[0]);
         return 2;
     }
 
+    std::vector<MethodQuery> queries(specs.size());
+    for (size_t i = 0; i < specs.size(); i++) {
+        if (!parse_method_query(specs[i], &queries[i])) {
+            std::fprintf(stderr, "bad --method spec: %s\n", specs[i].c_str());
+            return 2;
+        }
+    }
+
     ScanOptions opt;
-    std::vector<FileEntry> files = scan_workspace(repo_root, opt);
+    // big generated files are what the lexer path is for
+    opt.max_file_size_bytes = kExtractMaxFileBytes;
+    FileTable files = scan_workspace(repo_root, opt);
 
     std::error_code ec;
     std::string abs_root = std::filesystem::absolute(repo_root, ec).string();
@@ -101,39 +176,69 @@ int cmd_extract(int argc, char **argv)
         return 1;
     }
 
-    Method snip =
-        extract_method_from_file(loc.abs_path, loc.rel_path, method);
+    if (compare) {
+        return compare_paths(loc, queries);
+    }
 
-    if (!snip.found) {
-        std::fprintf(stderr, "extract failed: %s\n", snip.reason.c_str());
+    std::string err;
+    ExtractStats es;
+    std::vector<Method> snips = extract_methods_from_file(loc.abs_path, loc.rel_path, queries, &err, lex_above, &es);
+    if (!err.empty()) {
+        std::fprintf(stderr, "extract failed: %s\n", err.c_str());
+        return 1;
+    }
+
+    std::vector<bool> matched(queries.size(), false);
+    for (const Method &m : snips) {
+        matched[static_cast<size_t>(m.query)] = true;
+    }
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (!matched[i]) {
+            std::fprintf(stderr, "warning: no method with a body matches %s\n", specs[i].c_str());
+        }
+    }
+    if (snips.empty()) {
+        std::fprintf(stderr, "extract failed: method_declaration not found (or no body)\n");
         return 1;
     }
 
     Fd out_file;
     int out_fd = open_out_fd(out_path, &out_file);
 
-    std::string header;
-    header += "FILE: " + snip.rel_path + "\n";
-    header += "METHOD: " + std::string(method) + "\n";
-    header += "REASON: " + snip.reason + "\n";
-    header += "BYTE_RANGE: " + std::to_string(snip.start) + ".." + std::to_string(snip.end) + "\n";
-    header += "----\n";
-
-    if (write_all(out_fd, header.data(), header.size()) < 0) {
-        die("write(out)");
-    }
-    if (write_all(out_fd, snip.text.data(), snip.text.size()) < 0) {
-        die("write(out)");
-    }
-    if (write_all(out_fd, "\n", 1) < 0) {
-        die("write(out)");
+    // snips outlives the writer, so the bodies are queued without copying
+    OutWriter w(out_fd);
+    for (const Method &snip : snips) {
+        if (format == OutputFormat::Jsonl) {
+            JsonRecord(w, "method")
+                .str("file", snip.rel_path)
+                .str("method", queries[static_cast<size_t>(snip.query)].name + snip.params)
+                .str("reason", snip.reason)
+                .unum("start", snip.start)
+                .unum("end", snip.end)
+                .str("text", snip.text)
+                .end();
+            continue;
+        }
+        w.kv("FILE", snip.rel_path);
+        w.put("METHOD: ").put(queries[static_cast<size_t>(snip.query)].name).put(snip.params).put('\n');
+        w.kv("REASON", snip.reason);
+        w.put("BYTE_RANGE: ").put_uint(snip.start).put("..").put_uint(snip.end).put('\n');
+        w.put("----\n");
+        w.put_ref(snip.text);
+        w.put('\n');
     }
+    w.flush();
 
     if (verbose) {
-        std::printf("found: 1\n");
+        std::printf("found: %zu\n", snips.size());
         std::printf("class: %s\n", fqcn);
         std::printf("file: %s\n", loc.rel_path.c_str());
-        std::printf("method: %s\n", method);
+        for (size_t i = 0; i < specs.size(); i++) {
+            std::printf("method: %s%s\n", specs[i].c_str(), matched[i] ? "" : " (not found)");
+        }
+        std::printf("path: %s\n", es.lexed ? "lexer" : (es.fell_back ? "tree-sitter (lexer rejected)" : "tree-sitter"));
+        std::printf("verified: %zu\n", es.verified);
+        std::printf("verify_failed: %zu\n", es.verify_failed);
         std::printf("out: %s\n", out_path);
     }
 
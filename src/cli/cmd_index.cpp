@@ -0,0 +1,133 @@
+
+#include "cli/commands.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "workspace/bloom_index.h"
+#include "workspace/index_io.h"
+#include "workspace/java/ident_index.h"
+#include "workspace/java/parse_cache.h"
+#include "workspace/java/ts_alloc.h"
+#include "workspace/java/type_index.h"
+#include "workspace/scanner.h"
+#include "workspace/trigram_index.h"
+#include "workspace/workspace_index.h"
+
+namespace cli
+{
+
+static void usage_index(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "Usage: %s index [--repo-root <path>] [--index-dir <path>] [--bloom-fp <rate>]\n"
+                 "Builds the on-disk indexes: trigrams for search/snippets --index,\n"
+                 "identifiers and call edges for refs/callers and the context builder,\n"
+                 "the type hierarchy for resolving interface calls, and per-file Bloom\n"
+                 "filters of identifier tokens for cheap negative lookups.\n"
+                 "Defaults: --repo-root .. --index-dir <repo-root>/.codegencli --bloom-fp 0.01\n",
+                 argv0);
+}
+
+
+int cmd_index(int argc, char **argv)
+{
+    const char *repo_root = "..";
+    const char *index_dir = nullptr;
+    double bloom_fp = kDefaultBloomFp;
+
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--repo-root") == 0) {
+            if (++i >= argc) { usage_index(argv[0]); return 2; }
+            repo_root = argv[i];
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_index(argv[0]); return 2; }
+            index_dir = argv[i];
+        } else if (std::strcmp(argv[i], "--bloom-fp") == 0) {
+            if (++i >= argc) { usage_index(argv[0]); return 2; }
+            bloom_fp = std::atof(argv[i]);
+            if (!(bloom_fp > 0.0 && bloom_fp < 1.0)) {
+                std::fprintf(stderr, "--bloom-fp must be between 0 and 1\n");
+                return 2;
+            }
+        } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            usage_index(argv[0]);
+            return 0;
+        } else {
+            std::fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+            usage_index(argv[0]);
+            return 2;
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point t0 = clock::now();
+
+    ScanOptions opt;
+    FileTable files = scan_workspace(repo_root, opt);
+
+    std::string dir = index_dir ? std::string(index_dir) : default_index_dir(files.root());
+    std::string path = trigram_index_path(dir);
+    std::string ident_path = ident_index_path(dir);
+    std::string bloom_path = bloom_index_path(dir);
+    std::string type_path = type_index_path(dir);
+
+    WorkspaceIndexBuildStats st;
+    std::string err;
+    if (!build_workspace_index(files, dir, bloom_fp, &st, &err)) {
+        std::fprintf(stderr, "index: %s\n", err.c_str());
+        return 1;
+    }
+    const TrigramBuildStats &ts = st.trigrams;
+    const IdentBuildStats &is = st.idents;
+    const TypeBuildStats &tys = st.types;
+    const BloomBuildStats &bs = st.blooms;
+    long long parse_us = st.parse_us;
+
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t0).count();
+
+    std::printf("repo_root: %s\n", files.root().c_str());
+    std::printf("trigram_index: %s\n", path.c_str());
+    std::printf("files: %zu\n", ts.files);
+    std::printf("unreadable: %zu\n", ts.unreadable);
+    std::printf("bytes_read: %llu\n", static_cast<unsigned long long>(ts.bytes_read));
+    std::printf("trigrams: %zu\n", ts.trigrams);
+    std::printf("postings: %zu\n", ts.postings);
+    std::printf("postings_bytes: %llu\n", static_cast<unsigned long long>(ts.postings_bytes));
+    std::printf("trigram_index_bytes: %llu\n", static_cast<unsigned long long>(ts.index_bytes));
+    std::printf("ident_index: %s\n", ident_path.c_str());
+    std::printf("parse_failed: %zu\n", is.parse_failed);
+    std::printf("identifiers: %zu\n", is.names);
+    std::printf("decls: %zu\n", is.decls);
+    std::printf("invocations: %zu\n", is.invocations);
+    std::printf("refs: %zu\n", is.refs);
+    std::printf("call_edges: %zu\n", is.call_edges);
+    std::printf("ident_index_bytes: %llu\n", static_cast<unsigned long long>(is.index_bytes));
+    std::printf("type_index: %s\n", type_path.c_str());
+    std::printf("types: %zu\n", tys.types);
+    std::printf("methods: %zu\n", tys.methods);
+    std::printf("supertypes: %zu\n", tys.supertypes);
+    std::printf("type_index_bytes: %llu\n", static_cast<unsigned long long>(tys.index_bytes));
+    std::printf("bloom_index: %s\n", bloom_path.c_str());
+    std::printf("bloom_fp: %g\n", bloom_fp);
+    std::printf("bloom_tokens: %zu\n", bs.tokens);
+    std::printf("bloom_filter_bytes: %llu\n", static_cast<unsigned long long>(bs.filter_bytes));
+    std::printf("bloom_index_bytes: %llu\n", static_cast<unsigned long long>(bs.index_bytes));
+    ParserPoolStats pps = parser_pool_stats();
+    TsAllocStats as = ts_alloc_stats();
+    size_t parsed = is.files - is.parse_failed;
+    std::printf("parses_per_sec: %.0f\n", parse_us > 0 ? parsed * 1e6 / static_cast<double>(parse_us) : 0.0);
+    std::printf("parsers_created: %llu\n", static_cast<unsigned long long>(pps.created));
+    std::printf("parser_reuses: %llu\n", static_cast<unsigned long long>(pps.reused));
+    std::printf("ts_allocs: %llu\n", static_cast<unsigned long long>(as.allocs));
+    std::printf("ts_allocs_pooled: %llu\n", static_cast<unsigned long long>(as.pool_hits));
+    std::printf("ts_frees_pooled: %llu\n", static_cast<unsigned long long>(as.pooled_frees));
+    std::printf("ts_realloc_in_place: %llu\n", static_cast<unsigned long long>(as.realloc_in_place));
+    std::printf("elapsed_ms: %lld\n", ms);
+    return 0;
+}
+
+} // namespace cli
@@ -6,6 +6,11 @@
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
+#include "cli/jsonl.h"
+#include "workspace/bloom_index.h"
+#include "workspace/index_io.h"
 #include "workspace/java/locator.h"
 #include "workspace/scanner.h"
 
@@ -15,7 +20,7 @@ namespace cli
 static void usage_locate(const char *argv0)
 {
     std::fprintf(stderr,
-                 "Usage: %s locate --class <FQCN> [--repo-root <path>] [--verbose]\n"
+                 "Usage: %s locate --class <FQCN> [--repo-root <path>] [--verbose] [--format text|jsonl]\n"
                  "Defaults: --repo-root ..\n"
                  "Example:  %s locate --class com.foo.Bar --repo-root ..\n",
                  argv0, argv0);
@@ -27,6 +32,7 @@ int cmd_locate(int argc, char **argv)
     const char *repo_root = "..";
     const char *fqcn = nullptr;
     bool verbose = false;
+    OutputFormat format = OutputFormat::Text;
 
     for (int i = 2; i < argc; i++) {
         if (std::strcmp(argv[i], "--repo-root") == 0) {
@@ -43,6 +49,11 @@ int cmd_locate(int argc, char **argv)
             fqcn = argv[i];
         } else if (std::strcmp(argv[i], "--verbose") == 0) {
             verbose = true;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) {
+                usage_locate(argv[0]);
+                return 2;
+            }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_locate(argv[0]);
             return 0;
@@ -60,35 +71,62 @@ int cmd_locate(int argc, char **argv)
     }
 
     ScanOptions opt;
-    std::vector<FileEntry> files = scan_workspace(repo_root, opt);
+    FileTable files = scan_workspace(repo_root, opt);
 
     std::error_code ec;
     std::string abs_root = std::filesystem::absolute(repo_root, ec).string();
     if (ec) { abs_root = repo_root; }
 
-    std::unique_ptr<JavaLocator> locator = make_text_java_locator(files);
+    // optional: lets candidates that can't match go unread
+    BloomIndex bloom_index;
+    FileBlooms blooms;
+    std::string err;
+    if (bloom_index.open(bloom_index_path(default_index_dir(files.root())), &err)) {
+        blooms.bind(&bloom_index, files);
+    }
+
+    std::unique_ptr<JavaLocator> locator = make_text_java_locator(files, &blooms);
 
     ClassLocation loc = locator->locate_class(fqcn);
 
+    if (format == OutputFormat::Jsonl) {
+        OutWriter w(STDOUT_FILENO, "write(stdout)");
+        JsonRecord r(w, "class");
+        r.str("class", fqcn).flag("found", loc.found);
+        if (loc.found) {
+            r.str("file", loc.rel_path).str("abs_file", loc.abs_path);
+        }
+        r.str("reason", loc.reason);
+        if (verbose) {
+            r.str("repo_root", abs_root).unum("java_files", files.live_count());
+            r.flag("bloom_index", blooms.bound()).num("bloom_skipped", loc.bloom_skipped);
+        }
+        r.end();
+        return loc.found ? 0 : 1;
+    }
+
+    OutWriter w(STDOUT_FILENO, "write(stdout)");
     if (verbose) {
-        std::printf("repo_root: %s\n", abs_root.c_str());
-        std::printf("java_files: %zu\n", files.size());
+        w.kv("repo_root", abs_root);
+        w.kv_uint("java_files", files.live_count());
+        w.kv("bloom_index", blooms.bound() ? "yes" : "no");
+        w.kv_int("bloom_skipped", loc.bloom_skipped);
     }
 
     if (!loc.found) {
-        std::printf("found: 0\n");
-        std::printf("class: %s\n", fqcn);
-        std::printf("reason: %s\n", loc.reason.c_str());
+        w.kv("found", "0");
+        w.kv("class", fqcn);
+        w.kv("reason", loc.reason);
         return 1;
     }
 
-    std::printf("found: 1\n");
-    std::printf("class: %s\n", fqcn);
-    std::printf("file: %s\n", loc.rel_path.c_str());
+    w.kv("found", "1");
+    w.kv("class", fqcn);
+    w.kv("file", loc.rel_path);
     if (verbose) {
-        std::printf("abs_file: %s\n", loc.abs_path.c_str());
+        w.kv("abs_file", loc.abs_path);
     }
-    std::printf("reason: %s\n", loc.reason.c_str());
+    w.kv("reason", loc.reason);
     return 0;
 }
 
@@ -0,0 +1,207 @@
+
+#include "cli/commands.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/index_io.h"
+#include "workspace/java/ident_index.h"
+#include "workspace/regex_literals.h"
+#include "workspace/scanner.h"
+#include "workspace/search_indexed.h"
+#include "workspace/search_rg.h"
+#include "workspace/workspace_index.h"
+
+namespace cli
+{
+
+static void usage_refs(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "Usage: %s refs --name <identifier> [--repo-root <path>] [--index-dir <path>] [--role decl|invoke|ref|all] [--limit <N>]\n"
+                 "Lists declarations, invocations and references of an identifier from the index built by `index`.\n"
+                 "Files changed since indexing are searched with rg and reported as role=text.\n"
+                 "Defaults: --repo-root .. --index-dir <repo-root>/.codegencli --role all --limit 50\n",
+                 argv0);
+}
+
+
+static bool parse_role_mask(const char *s, uint32_t *mask)
+{
+    if (std::strcmp(s, "decl") == 0) { *mask = IRM_DECL; return true; }
+    if (std::strcmp(s, "invoke") == 0) { *mask = IRM_INVOKE; return true; }
+    if (std::strcmp(s, "ref") == 0) { *mask = IRM_REF; return true; }
+    if (std::strcmp(s, "all") == 0) { *mask = IRM_ALL; return true; }
+    return false;
+}
+
+
+struct RefRow
+{
+    FileId file = kNoFile;
+    uint64_t offset = 0;
+    uint64_t line = 0;   // 0 until resolved
+    const char *role = "";
+};
+
+
+// rg reports lines itself; index rows get theirs by counting newlines once per file.
+static void fill_lines(const FileTable &files, std::vector<RefRow> *rows)
+{
+    std::string src;
+    FileId loaded = kNoFile;
+    for (RefRow &r : *rows) {
+        if (r.line != 0) {
+            continue;
+        }
+        if (r.file != loaded) {
+            loaded = r.file;
+            if (!read_file_bytes(files.abs_path(r.file), &src)) {
+                src.clear();
+            }
+        }
+        size_t end = std::min<size_t>(r.offset, src.size());
+        r.line = 1 + static_cast<uint64_t>(std::count(src.begin(), src.begin() + static_cast<std::ptrdiff_t>(end), '\n'));
+    }
+}
+
+
+int cmd_refs(int argc, char **argv)
+{
+    const char *repo_root = "..";
+    const char *index_dir = nullptr;
+    const char *name = nullptr;
+    uint32_t mask = IRM_ALL;
+    int limit = 50;
+
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--repo-root") == 0) {
+            if (++i >= argc) { usage_refs(argv[0]); return 2; }
+            repo_root = argv[i];
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_refs(argv[0]); return 2; }
+            index_dir = argv[i];
+        } else if (std::strcmp(argv[i], "--name") == 0) {
+            if (++i >= argc) { usage_refs(argv[0]); return 2; }
+            name = argv[i];
+        } else if (std::strcmp(argv[i], "--role") == 0) {
+            if (++i >= argc || !parse_role_mask(argv[i], &mask)) { usage_refs(argv[0]); return 2; }
+        } else if (std::strcmp(argv[i], "--limit") == 0) {
+            if (++i >= argc) { usage_refs(argv[0]); return 2; }
+            limit = std::atoi(argv[i]);
+            if (limit < 0) limit = 0;
+        } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            usage_refs(argv[0]);
+            return 0;
+        } else {
+            std::fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+            usage_refs(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!name) {
+        std::fprintf(stderr, "Missing required flag: --name <identifier>\n");
+        usage_refs(argv[0]);
+        return 2;
+    }
+
+    ScanOptions opt;
+    FileTable files = scan_workspace(repo_root, opt);
+
+    std::string dir = index_dir ? std::string(index_dir) : default_index_dir(files.root());
+    IdentIndex idents;
+    std::string err;
+    if (!idents.open(ident_index_path(dir), &err)) {
+        std::fprintf(stderr, "refs: %s (run `index` first)\n", err.c_str());
+        return 1;
+    }
+
+    std::vector<FileId> to_table;
+    std::vector<FileId> stale;
+    idents.files().resolve(files, &to_table, &stale);
+
+    std::vector<RefRow> rows;
+    std::vector<IdentOccurrence> occ;
+    idents.lookup(name, mask, &occ);
+    for (const IdentOccurrence &o : occ) {
+        FileId f = (o.file < to_table.size()) ? to_table[o.file] : kNoFile;
+        if (f == kNoFile) {
+            continue;
+        }
+        RefRow r;
+        r.file = f;
+        r.offset = o.offset;
+        r.role = ident_role_name(o.role);
+        rows.push_back(r);
+    }
+
+    bool rg_failed = false;
+    if (!stale.empty()) {
+        RgQuery q;
+        q.pattern = regex_token(name);
+        std::vector<bool> keep(files.size(), false);
+        for (FileId id : stale) {
+            keep[id] = true;
+        }
+        if (stale.size() > kMaxStaleForIndex) {
+            // too many to name: walk the scanned tree, keep hits in stale files
+            restrict_to_scan(opt, &q);
+        } else {
+            for (FileId id : stale) {
+                q.paths.push_back(files.abs_path(id));
+            }
+        }
+        RgResult rr = rg_search_json(repo_root, q, &files);
+        rg_failed = rr.exit_code != 0 && rr.exit_code != 1;
+        for (const RgHit &h : rr.hits) {
+            if (h.file_id == kNoFile || !keep[h.file_id]) {
+                continue;
+            }
+            RefRow r;
+            r.file = h.file_id;
+            r.offset = h.match_byte_offset;
+            r.line = h.line_number;
+            r.role = "text";
+            rows.push_back(r);
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(),
+              [&files](const RefRow &a, const RefRow &b)
+              {
+                  if (a.file != b.file) {
+                      return files.rel_path(a.file) < files.rel_path(b.file);
+                  }
+                  return a.offset < b.offset;
+              });
+
+    size_t total = rows.size();
+    size_t n = total;
+    if (static_cast<size_t>(limit) < n) {
+        n = static_cast<size_t>(limit);
+    }
+    rows.resize(n);
+    fill_lines(files, &rows);
+
+    std::printf("name: %s\n", name);
+    std::printf("hits: %zu\n", total);
+    std::printf("showing: %zu\n", n);
+    std::printf("stale_files: %zu%s\n", stale.size(), rg_failed ? " (rg failed)" : "");
+    for (const RefRow &r : rows) {
+        std::string_view rel = files.rel_path(r.file);
+        std::printf("%.*s:%llu byte=%llu role=%s\n",
+                    static_cast<int>(rel.size()), rel.data(),
+                    static_cast<unsigned long long>(r.line),
+                    static_cast<unsigned long long>(r.offset),
+                    r.role);
+    }
+    return 0;
+}
+
+} // namespace cli
@@ -1,4 +1,5 @@
 
+#include "cli/jsonl.h"
 #include "workspace/scanner.h"
 
 #include <cstdio>
@@ -6,15 +7,18 @@
 #include <cstring>
 #include <filesystem>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <unistd.h>
+
 
 namespace cli {
 
 static void usage_scan(const char *argv0) 
 {
   std::fprintf(stderr,
-               "Usage: %s scan [--repo-root <path>] [--limit <N>]\n"
+               "Usage: %s scan [--repo-root <path>] [--limit <N>] [--format text|jsonl]\n"
                "Defaults: --repo-root .. --limit 20\n",
                argv0);
 }
@@ -24,6 +28,7 @@ int cmd_scan(int argc, char **argv)
 {
     const char *repo_root; 
     int limit = 1024;
+    OutputFormat format = OutputFormat::Text;
     for (int i = 2; i < argc; i++) {
         if (std::strcmp(argv[i], "--repo-root") == 0) {
             if (++i >= argc) { usage_scan(argv[0]); return 1; }
@@ -32,6 +37,8 @@ int cmd_scan(int argc, char **argv)
             if (++i >= argc) { usage_scan(argv[0]); return 1; }
             limit = std::atoi(argv[i]);
             if (limit < 0) limit = 0;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) { usage_scan(argv[0]); return 1; }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_scan(argv[0]);
             return 0;
@@ -43,19 +50,30 @@ int cmd_scan(int argc, char **argv)
     }
 
     ScanOptions opt;
-    std::vector<FileEntry> files = scan_workspace(repo_root, opt);
+    FileTable files = scan_workspace(repo_root, opt);
 
     std::error_code ec;
     std::string abs_root = std::filesystem::absolute(repo_root, ec).string();
     if (ec) abs_root = repo_root;
 
-    std::printf("repo_root: %s\n", abs_root.c_str());
-    std::printf("java_files: %zu\n", files.size());
-
     int n = limit;
     if (n > static_cast<int>(files.size())) n = static_cast<int>(files.size());
-    for (int i = 0; i < n; i++) {
-        std::printf("%s\n", files[i].rel_path.c_str());
+
+    if (format == OutputFormat::Jsonl) {
+        OutWriter w(STDOUT_FILENO, "write(stdout)");
+        JsonRecord(w, "scan").str("repo_root", abs_root).unum("java_files", files.live_count()).end();
+        for (FileId id = 0; id < static_cast<FileId>(n); id++) {
+            JsonRecord(w, "file").str("path", files.rel_path(id)).end();
+        }
+        return 0;
+    }
+
+    OutWriter w(STDOUT_FILENO, "write(stdout)");
+    w.kv("repo_root", abs_root);
+    w.kv_uint("java_files", files.live_count());
+
+    for (FileId id = 0; id < static_cast<FileId>(n); id++) {
+        w.put(files.rel_path(id)).put('\n');
     }
 
     return 0;
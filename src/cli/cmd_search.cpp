@@ -1,5 +1,6 @@
 
 #include "cli/commands.h"
+#include "cli/jsonl.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -7,6 +8,9 @@
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
+#include "workspace/search_indexed.h"
 #include "workspace/search_rg.h"
 
 
@@ -17,8 +21,13 @@ namespace cli
 static void usage_search(const char *argv0)
 {
     std::fprintf(stderr,
-                 "Usage: %s search --pattern <regex> [--repo-root <path>] [--glob <glob>]... [--exclude <glob>]... [--limit <N>] [--fixed] [--verbose]\n"
+                 "Usage: %s search --pattern <regex> [--repo-root <path>] [--glob <glob>]... [--exclude <glob>]... [--limit <N>] [--fixed] [--index] [--index-dir <path>] [--verbose]\n"
+                 "                [--format text|jsonl]\n"
                  "Defaults: --repo-root .. --glob *.java --exclude codegen/** --limit 50\n"
+                 "Only files `scan` would list are searched: directories such as target/ and build/\n"
+                 "and files over 2 MB are skipped, .gitignore'd and hidden files are not,\n"
+                 "with or without --index.\n"
+                 "--format jsonl writes a \"search\" record and one \"hit\" record per hit.\n"
                  "Example:  %s search --repo-root .. --pattern \"charge\\\\(\" --glob \"*.java\" --limit 20\n",
                  argv0, argv0);
 }
@@ -29,8 +38,11 @@ int cmd_search(int argc, char **argv)
     const char *repo_root = "..";
     const char *pattern = nullptr;
     bool fixed = false;
+    bool use_index = false;
+    const char *index_dir = "";
     bool verbose = false;
     int limit = 50;
+    OutputFormat format = OutputFormat::Text;
 
     RgQuery q;
     q.globs.push_back("*.java");
@@ -55,8 +67,16 @@ int cmd_search(int argc, char **argv)
             if (limit < 0) limit = 0;
         } else if (std::strcmp(argv[i], "--fixed") == 0) {
             fixed = true;
+        } else if (std::strcmp(argv[i], "--index") == 0) {
+            use_index = true;
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_search(argv[0]); return 2; }
+            index_dir = argv[i];
+            use_index = true;
         } else if (std::strcmp(argv[i], "--verbose") == 0) {
             verbose = true;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) { usage_search(argv[0]); return 2; }
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_search(argv[0]);
             return 0;
@@ -76,27 +96,71 @@ int cmd_search(int argc, char **argv)
     q.pattern = pattern;
     q.fixed_string = fixed;
 
-    RgResult res = rg_search_json(repo_root, q);
+    IndexedSearchStats ist;
+    RgResult res;
+    if (use_index) {
+        res = rg_search_with_index_dir(repo_root, q, index_dir, &ist);
+    } else {
+        // the same files the index covers, so --index changes speed, not hits
+        ScanOptions scan_opt;
+        restrict_to_scan(scan_opt, &q);
+        res = rg_search_json(repo_root, q);
+    }
 
     if (!res.error.empty() && verbose) {
         std::fprintf(stderr, "rg error: %s\n", res.error.c_str());
     }
 
-    std::printf("exit: %d\n", res.exit_code);
-    std::printf("hits: %zu\n", res.hits.size());
-
     size_t n = res.hits.size();
     if (limit >= 0 && static_cast<size_t>(limit) < n) {
         n = static_cast<size_t>(limit);
     }
 
+    if (format == OutputFormat::Jsonl) {
+        OutWriter w(STDOUT_FILENO, "write(stdout)");
+        JsonRecord head(w, "search");
+        head.num("exit", res.exit_code).unum("hits", res.hits.size());
+        if (use_index) {
+            head.flag("index_used", ist.used_index);
+            if (ist.used_index) {
+                head.unum("trigrams", ist.trigrams).unum("words", ist.words).unum("matched", ist.index_matches);
+                head.unum("bloom_skipped", ist.bloom_skipped).unum("stale", ist.stale_files);
+                head.unum("candidates", ist.candidates).unum("files", ist.files_total);
+            } else {
+                head.str("index_fallback", ist.fallback);
+            }
+        }
+        head.end();
+        for (size_t i = 0; i < n; i++) {
+            const RgHit &h = res.hits[i];
+            JsonRecord(w, "hit")
+                .str("file", h.rel_path)
+                .unum("line", h.line_number)
+                .unum("byte", h.match_byte_offset)
+                .unum("len", h.match_len)
+                .end();
+        }
+        return (res.exit_code == 2) ? 1 : 0;
+    }
+
+    OutWriter w(STDOUT_FILENO, "write(stdout)");
+    w.kv_int("exit", res.exit_code);
+    w.kv_uint("hits", res.hits.size());
+    if (use_index) {
+        if (ist.used_index) {
+            w.put("index: trigrams=").put_uint(ist.trigrams).put(" words=").put_uint(ist.words);
+            w.put(" matched=").put_uint(ist.index_matches).put(" bloom_skipped=").put_uint(ist.bloom_skipped);
+            w.put(" stale=").put_uint(ist.stale_files).put(" candidates=").put_uint(ist.candidates);
+            w.put(" files=").put_uint(ist.files_total).put('\n');
+        } else {
+            w.put("index: unused (").put(ist.fallback).put(")\n");
+        }
+    }
+
     for (size_t i = 0; i < n; i++) {
         const RgHit &h = res.hits[i];
-        std::printf("%s:%llu byte=%llu len=%u\n",
-                    h.rel_path.c_str(),
-                    static_cast<unsigned long long>(h.line_number),
-                    static_cast<unsigned long long>(h.match_byte_offset),
-                    h.match_len);
+        w.put(h.rel_path).put(':').put_uint(h.line_number);
+        w.put(" byte=").put_uint(h.match_byte_offset).put(" len=").put_uint(h.match_len).put('\n');
     }
 
     // 0 not err, means no matches
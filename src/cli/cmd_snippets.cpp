@@ -1,4 +1,5 @@
 #include "cli/commands.h"
+#include "cli/jsonl.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -6,12 +7,14 @@
 #include <string>
 #include <vector>
 
+#include "workspace/search_indexed.h"
 #include "workspace/search_rg.h"
 #include "workspace/java/snippet_from_hit.h"
 
 #include "sys/error.h"
 #include "sys/fd.h"
 #include "sys/io.h"
+#include "sys/out_writer.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -22,8 +25,11 @@ namespace cli
 static void usage_snippets(const char *argv0)
 {
     std::fprintf(stderr,
-                 "Usage: %s snippets --pattern <regex> [--repo-root <path>] [--glob <glob>]... [--exclude <glob>]... [--limit <N>] [--out <path|->] [--fixed]\n"
+                 "Usage: %s snippets --pattern <regex> [--repo-root <path>] [--glob <glob>]... [--exclude <glob>]... [--limit <N>] [--out <path|->] [--fixed] [--index] [--index-dir <path>] [--skeleton]\n"
+                 "                 [--format text|jsonl]\n"
                  "Defaults: --repo-root .. --glob *.java --exclude codegen/** --limit 20 --out snippets.txt\n"
+                 "Only files `scan` would list are searched, with or without --index (see search).\n"
+                 "--format jsonl writes a \"search\" record, then one \"snippet\" record per hit as it is cut.\n"
                  "Example:  %s snippets --repo-root .. --pattern 'charge\\(' --glob '*.java' --out snippets.txt\n",
                  argv0, argv0);
 }
@@ -44,13 +50,56 @@ static int open_out_fd(const char *out_path, Fd *out_file)
 }
 
 
+static void write_jsonl(OutWriter &w,
+                        const RgResult &res,
+                        size_t n,
+                        const char *pattern,
+                        const IndexedSearchStats *ist,
+                        bool skeleton)
+{
+    JsonRecord head(w, "search");
+    head.str("pattern", pattern).unum("hits", res.hits.size()).unum("showing", n);
+    if (ist) {
+        head.flag("index_used", ist->used_index);
+        if (ist->used_index) {
+            head.unum("candidates", ist->candidates).unum("files_total", ist->files_total);
+        } else {
+            head.str("index_fallback", ist->fallback);
+        }
+    }
+    head.end();
+    w.flush();
+
+    for (size_t i = 0; i < n; i++) {
+        const RgHit &h = res.hits[i];
+        HitSnippet snip = snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset, skeleton);
+
+        JsonRecord r(w, "snippet");
+        r.str("file", h.rel_path).unum("line", h.line_number).unum("hit_byte", h.match_byte_offset);
+        r.flag("found", snip.found);
+        if (!snip.found) {
+            r.str("reason", snip.reason);
+        } else {
+            r.str("kind", snip.kind).unum("start", snip.start).unum("end", snip.end);
+            r.flag("skeleton", snip.skeleton).str("text", snip.text);
+        }
+        r.end();
+        w.flush();
+    }
+}
+
+
 int cmd_snippets(int argc, char **argv)
 {
     const char *repo_root = "..";
     const char *pattern = nullptr;
     const char *out_path = "etc/snippets.txt";
     bool fixed = false;
+    bool use_index = false;
+    const char *index_dir = "";
     int limit = 20;
+    bool skeleton = false;   // class fallbacks with member bodies elided
+    OutputFormat format = OutputFormat::Text;
 
     RgQuery q;
     q.globs.push_back("*.java");
@@ -78,6 +127,16 @@ int cmd_snippets(int argc, char **argv)
             out_path = argv[i];
         } else if (std::strcmp(argv[i], "--fixed") == 0) {
             fixed = true;
+        } else if (std::strcmp(argv[i], "--skeleton") == 0) {
+            skeleton = true;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            if (++i >= argc || !parse_output_format(argv[i], &format)) { usage_snippets(argv[0]); return 2; }
+        } else if (std::strcmp(argv[i], "--index") == 0) {
+            use_index = true;
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_snippets(argv[0]); return 2; }
+            index_dir = argv[i];
+            use_index = true;
         } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
             usage_snippets(argv[0]);
             return 0;
@@ -97,7 +156,16 @@ int cmd_snippets(int argc, char **argv)
     q.pattern = pattern;
     q.fixed_string = fixed;
 
-    RgResult res = rg_search_json(repo_root, q);
+    IndexedSearchStats ist;
+    RgResult res;
+    if (use_index) {
+        res = rg_search_with_index_dir(repo_root, q, index_dir, &ist);
+    } else {
+        // the same files the index covers, so --index changes speed, not hits
+        ScanOptions scan_opt;
+        restrict_to_scan(scan_opt, &q);
+        res = rg_search_json(repo_root, q);
+    }
     if (res.exit_code == 2) {
         std::fprintf(stderr, "rg failed: %s\n", res.error.c_str());
         return 1;
@@ -111,48 +179,62 @@ int cmd_snippets(int argc, char **argv)
     Fd out_file;
     int out_fd = open_out_fd(out_path, &out_file);
 
-    std::string header;
-    header += "pattern: " + std::string(pattern) + "\n";
-    header += "hits: " + std::to_string(res.hits.size()) + "\n";
-    header += "showing: " + std::to_string(n) + "\n";
-    header += "====\n";
+    OutWriter w(out_fd);
+    if (format == OutputFormat::Jsonl) {
+        write_jsonl(w, res, n, pattern, use_index ? &ist : nullptr, skeleton);
+        return 0;
+    }
 
-    if (write_all(out_fd, header.data(), header.size()) < 0) {
-        die("write(out)");
+    w.kv("pattern", pattern);
+    w.kv_uint("hits", res.hits.size());
+    w.kv_uint("showing", n);
+    if (use_index) {
+        if (ist.used_index) {
+            w.put("index: candidates=").put_uint(ist.candidates).put('/').put_uint(ist.files_total).put('\n');
+        } else {
+            w.put("index: unused (").put(ist.fallback).put(")\n");
+        }
     }
+    w.put("====\n");
+
+    // snippet texts are written by reference, so a batch stays alive until flushed
+    constexpr size_t kBatch = 32;
+    std::vector<HitSnippet> batch;
+    batch.reserve(kBatch);
 
     for (size_t i = 0; i < n; i++) {
         const RgHit &h = res.hits[i];
 
-        HitSnippet snip = snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset);
+        if (batch.size() == kBatch) {
+            w.flush();
+            batch.clear();
+        }
+        batch.push_back(snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset, skeleton));
+        const HitSnippet &snip = batch.back();
 
-        std::string block;
-        block += "\n[SNIPPET]\n";
-        block += "file: " + h.rel_path + "\n";
-        block += "line: " + std::to_string(h.line_number) + "\n";
-        block += "hit_byte: " + std::to_string(h.match_byte_offset) + "\n";
+        w.put("\n[SNIPPET]\n");
+        w.kv("file", h.rel_path);
+        w.kv_uint("line", h.line_number);
+        w.kv_uint("hit_byte", h.match_byte_offset);
 
         if (!snip.found) {
-            block += "found: 0\n";
-            block += "reason: " + snip.reason + "\n";
-            block += "[/SNIPPET]\n";
-            if (write_all(out_fd, block.data(), block.size()) < 0) {
-                die("write(out)");
-            }
+            w.put("found: 0\n");
+            w.kv("reason", snip.reason);
+            w.put("[/SNIPPET]\n");
             continue;
         }
 
-        block += "found: 1\n";
-        block += "kind: " + snip.kind + "\n";
-        block += "range: " + std::to_string(snip.start) + ".." + std::to_string(snip.end) + "\n";
-        block += "----\n";
-        block += snip.text;
-        block += "\n[/SNIPPET]\n";
-
-        if (write_all(out_fd, block.data(), block.size()) < 0) {
-            die("write(out)");
+        w.put("found: 1\n");
+        w.kv("kind", snip.kind);
+        w.put("range: ").put_uint(snip.start).put("..").put_uint(snip.end).put('\n');
+        if (snip.skeleton) {
+            w.put("skeleton: 1\n");
         }
+        w.put("----\n");
+        w.put_ref(snip.text);
+        w.put("\n[/SNIPPET]\n");
     }
+    w.flush();
 
     return 0;
 }
@@ -0,0 +1,316 @@
+
+#include "cli/commands.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/index_io.h"
+#include "workspace/scanner.h"
+#include "workspace/watcher.h"
+#include "workspace/workspace_index.h"
+
+namespace cli
+{
+
+static void usage_watch(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "Usage: %s watch [--repo-root <path>] [--debounce-ms N] [--max-batch-ms N] [--rescan-ms N]\n"
+                 "                [--index-dir <path>] [--reindex] [--verbose]\n"
+                 "Keeps the file list fresh while files change; each batch updates only the\n"
+                 "entries for the paths it touched.\n"
+                 "After each batch the number of files the on-disk indexes (see `index`) no\n"
+                 "longer match is reported as index_stale. --reindex rebuilds all of them from\n"
+                 "scratch instead; there is no per-file index update.\n"
+                 "Defaults: --repo-root .. --debounce-ms 200 --max-batch-ms 2000 --rescan-ms 30000\n"
+                 "          --index-dir <repo-root>/.codegencli\n",
+                 argv0);
+}
+
+
+static bool rel_under(std::string_view rel, std::string_view rel_dir)
+{
+    if (rel_dir.empty()) {
+        return true;
+    }
+    return rel.size() > rel_dir.size() &&
+           rel.compare(0, rel_dir.size(), rel_dir) == 0 &&
+           rel[rel_dir.size()] == '/';
+}
+
+
+static bool remove_file(FileTable &files, const std::string &abs_path)
+{
+    return files.remove(files.find_abs(abs_path));
+}
+
+
+static bool abs_under(const std::string &abs_path, const std::string &dir)
+{
+    return abs_path.size() > dir.size() &&
+           abs_path.compare(0, dir.size(), dir) == 0 &&
+           abs_path[dir.size()] == '/';
+}
+
+
+// rel form of a directory; empty for the root itself, false if outside the root
+static bool rel_dir_of(const FileTable &files, const std::string &dir, std::string_view *rel)
+{
+    if (dir == files.root()) {
+        *rel = {};
+        return true;
+    }
+    return files.rel_of(dir, rel);
+}
+
+
+static size_t remove_subtree(FileTable &files, const std::string &dir)
+{
+    std::string_view rel_dir;
+    if (!rel_dir_of(files, dir, &rel_dir)) {
+        return 0;
+    }
+    size_t n = 0;
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (files.alive(id) && rel_under(files.rel_path(id), rel_dir)) {
+            files.remove(id);
+            n++;
+        }
+    }
+    return n;
+}
+
+
+struct RefreshCounts
+{
+    int changed = 0;
+    int removed = 0;
+};
+
+
+static void refresh_file(const ScanOptions &opt,
+                         FileTable &files,
+                         const std::string &abs_path,
+                         RefreshCounts *rc)
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    std::string_view rel;
+    if (!files.rel_of(abs_path, &rel) || !scan_file(abs_path, opt, &size, &mtime)) {
+        // deleted again, or no longer eligible (e.g. grew past max size)
+        if (remove_file(files, abs_path)) {
+            rc->removed += 1;
+        }
+        return;
+    }
+
+    files.add(rel, size, mtime);
+    rc->changed += 1;
+}
+
+
+// Diff a fresh scan of dir against the current table; used for overflow and unwatched subtrees.
+static void resync_subtree(const ScanOptions &opt,
+                           FileTable &files,
+                           const std::string &dir,
+                           RefreshCounts *rc)
+{
+    std::string_view rel_dir;
+    if (!rel_dir_of(files, dir, &rel_dir)) {
+        return;
+    }
+    FileTable fresh = scan_subtree(files.root(), dir, opt);
+
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (!files.alive(id) || !rel_under(files.rel_path(id), rel_dir)) {
+            continue;
+        }
+        if (fresh.find_rel(files.rel_path(id)) == kNoFile) {
+            files.remove(id);
+            rc->removed += 1;
+        }
+    }
+
+    for (FileId fid = 0; fid < static_cast<FileId>(fresh.size()); fid++) {
+        FileId id = files.find_rel(fresh.rel_path(fid));
+        bool same = id != kNoFile &&
+                    files.size_bytes(id) == fresh.size_bytes(fid) &&
+                    files.mtime(id) == fresh.mtime(fid);
+        if (!same) {
+            refresh_file(opt, files, fresh.abs_path(fid), rc);
+        }
+    }
+}
+
+
+// Opened per batch: `index` may have replaced the files since the last one.
+static void report_index(const FileTable &files, const std::string &dir, bool reindex)
+{
+    size_t stale = 0;
+    {
+        WorkspaceIndex wi;
+        open_workspace_index(files.root(), dir, &wi);
+        if (!wi.has_trigrams && !wi.has_idents && !wi.has_blooms && !wi.has_types) {
+            return;
+        }
+        stale = workspace_index_stale_files(wi, files);
+    }
+    if (stale == 0) {
+        return;
+    }
+    if (!reindex) {
+        std::printf("index_stale: %zu\n", stale);
+        return;
+    }
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point t0 = clock::now();
+    WorkspaceIndexBuildStats st;
+    std::string err;
+    if (!build_workspace_index(files, dir, kDefaultBloomFp, &st, &err)) {
+        std::fprintf(stderr, "watch: reindex: %s\n", err.c_str());
+        std::printf("index_stale: %zu\n", stale);
+        return;
+    }
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t0).count();
+    std::printf("reindexed: stale=%zu files=%zu elapsed_ms=%lld\n", stale, st.trigrams.files, ms);
+}
+
+
+int cmd_watch(int argc, char **argv)
+{
+    const char *repo_root = "..";
+    int debounce_ms = 200;
+    int max_batch_ms = 2000;
+    int rescan_ms = 30000;
+    const char *index_dir = "";
+    bool reindex = false;
+    bool verbose = false;
+
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--repo-root") == 0) {
+            if (++i >= argc) { usage_watch(argv[0]); return 2; }
+            repo_root = argv[i];
+        } else if (std::strcmp(argv[i], "--debounce-ms") == 0) {
+            if (++i >= argc) { usage_watch(argv[0]); return 2; }
+            debounce_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--max-batch-ms") == 0) {
+            if (++i >= argc) { usage_watch(argv[0]); return 2; }
+            max_batch_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--rescan-ms") == 0) {
+            if (++i >= argc) { usage_watch(argv[0]); return 2; }
+            rescan_ms = std::atoi(argv[i]);
+        } else if (std::strcmp(argv[i], "--index-dir") == 0) {
+            if (++i >= argc) { usage_watch(argv[0]); return 2; }
+            index_dir = argv[i];
+        } else if (std::strcmp(argv[i], "--reindex") == 0) {
+            reindex = true;
+        } else if (std::strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            usage_watch(argv[0]);
+            return 0;
+        } else {
+            std::fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+            usage_watch(argv[0]);
+            return 2;
+        }
+    }
+
+    if (debounce_ms < 1) debounce_ms = 1;
+    if (max_batch_ms < debounce_ms) max_batch_ms = debounce_ms;
+    if (rescan_ms < 1000) rescan_ms = 1000;
+
+    ScanOptions opt;
+    FileTable files = scan_workspace(repo_root, opt);
+
+    WorkspaceWatcher watcher(repo_root, opt);
+    std::string err;
+    if (!watcher.start(&err)) {
+        std::fprintf(stderr, "watch: %s\n", err.c_str());
+        return 1;
+    }
+    const std::string &root = watcher.root();
+    std::string idx_dir = *index_dir ? std::string(index_dir) : default_index_dir(root);
+
+    WatchStats ws = watcher.stats();
+    std::printf("repo_root: %s\n", root.c_str());
+    std::printf("java_files: %zu\n", files.live_count());
+    std::printf("watched_dirs: %d\n", ws.watched_dirs);
+    std::printf("unwatched_dirs: %d\n", ws.unwatched_dirs);
+    std::fflush(stdout);
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point next_rescan = clock::now() + std::chrono::milliseconds(rescan_ms);
+
+    for (;;) {
+        WatchBatch batch;
+        bool got = watcher.wait_batch(debounce_ms * 5, debounce_ms, max_batch_ms, &batch);
+
+        RefreshCounts rc;
+        size_t rescanned = 0;
+
+        if (got) {
+            if (batch.overflow) {
+                // lost events; only a full resync is safe, including watches
+                // for directories created meanwhile
+                int rewatched = watcher.rewatch();
+                if (verbose && rewatched > 0) {
+                    std::printf("rewatched_dirs: %d\n", rewatched);
+                }
+                resync_subtree(opt, files, root, &rc);
+                rescanned += 1;
+            } else {
+                for (const std::string &d : batch.removed_dirs) {
+                    rc.removed += static_cast<int>(remove_subtree(files, d));
+                }
+                for (const std::string &abs : batch.removed) {
+                    if (remove_file(files, abs)) {
+                        rc.removed += 1;
+                    }
+                }
+                for (const std::string &d : batch.rescan_dirs) {
+                    resync_subtree(opt, files, d, &rc);
+                    rescanned += 1;
+                }
+                for (const std::string &abs : batch.changed) {
+                    bool rescanned_already = std::any_of(batch.rescan_dirs.begin(), batch.rescan_dirs.end(),
+                                                         [&](const std::string &d) { return abs_under(abs, d); });
+                    if (!rescanned_already) {
+                        refresh_file(opt, files, abs, &rc);
+                    }
+                }
+            }
+        }
+
+        if (clock::now() >= next_rescan) {
+            next_rescan = clock::now() + std::chrono::milliseconds(rescan_ms);
+            int rewatched = watcher.retry_unwatched();
+            if (verbose && rewatched > 0) {
+                std::printf("rewatched_dirs: %d\n", rewatched);
+            }
+            for (const std::string &d : watcher.unwatched()) {
+                resync_subtree(opt, files, d, &rc);
+                rescanned += 1;
+            }
+        }
+
+        if (rc.changed == 0 && rc.removed == 0 && !batch.overflow) {
+            continue;
+        }
+
+        std::printf("batch: events=%d changed=%d removed=%d rescanned_dirs=%zu java_files=%zu%s\n",
+                    batch.events, rc.changed, rc.removed, rescanned, files.live_count(),
+                    batch.overflow ? " overflow=1" : "");
+        report_index(files, idx_dir, reindex);
+        std::fflush(stdout);
+    }
+}
+
+} // namespace cli
@@ -15,6 +15,10 @@ int cmd_prompt(int argc, char **argv);
 int cmd_context(int argc, char **argv);
 int cmd_ask(int argc, char **argv);
 int cmd_raw(int argc, char **argv);
+int cmd_watch(int argc, char **argv);
+int cmd_index(int argc, char **argv);
+int cmd_refs(int argc, char **argv);
+int cmd_callers(int argc, char **argv);
 
 bool handle(int argc, char **argv, int *out_rc) 
 {
@@ -55,6 +59,22 @@ bool handle(int argc, char **argv, int *out_rc)
         *out_rc = cmd_raw(argc, argv);
         return true;
     }
+    if (std::strcmp(argv[1], "watch") == 0) {
+        *out_rc = cmd_watch(argc, argv);
+        return true;
+    }
+    if (std::strcmp(argv[1], "index") == 0) {
+        *out_rc = cmd_index(argc, argv);
+        return true;
+    }
+    if (std::strcmp(argv[1], "refs") == 0) {
+        *out_rc = cmd_refs(argc, argv);
+        return true;
+    }
+    if (std::strcmp(argv[1], "callers") == 0) {
+        *out_rc = cmd_callers(argc, argv);
+        return true;
+    }
     return false;
 }
 
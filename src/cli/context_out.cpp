@@ -0,0 +1,170 @@
+
+#include "cli/context_out.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli/jsonl.h"
+
+namespace cli
+{
+
+void write_context_head(OutWriter &w, const ContextRequest &req, const ContextOptions &opt)
+{
+    w.put("[CONTEXT]\n");
+    w.kv("repo_root", req.repo_root);
+    w.kv("anchor_class", req.anchor_class_fqcn);
+    w.kv("anchor_method", req.anchor_method);
+    w.kv_int("max_hops", opt.max_hops);
+    w.kv_int("max_snippets", opt.max_snippets);
+    w.kv_int("max_bytes", opt.max_bytes);
+    w.kv_int("max_tokens", opt.max_tokens);
+    w.kv_int("max_callers", opt.max_callers);
+    w.kv_int("parse_timeout_ms", opt.parse_timeout_ms);
+    w.kv_int("parse_budget_ms", opt.parse_budget_ms);
+    w.kv_int("deadline_ms", opt.deadline_ms);
+    w.put("====\n");
+}
+
+void write_context_snippet(OutWriter &w, const ContextSnippet &s)
+{
+    w.put("\n[SNIPPET]\n");
+    w.kv_int("hop", s.hop);
+    w.kv_int("score", s.score);
+    w.kv("symbol", s.symbol);
+    w.kv("file", s.rel_path);
+    w.kv("kind", s.kind);
+    w.put("range: ").put_uint(s.start).put("..").put_uint(s.end).put('\n');
+    w.kv_int("tokens", s.tokens);
+    if (s.skeleton) {
+        w.put("skeleton: 1\n");
+    }
+    w.put("----\n");
+    w.put_ref(s.text);
+    w.put("\n[/SNIPPET]\n");
+}
+
+// Every stats field once, in output order, for both formats.
+template <typename Emit>
+static void each_stat(const ContextStats &st, Emit &e)
+{
+    e.num("hops_used", st.hops_used);
+    e.num("snippets_written", st.snippets_written);
+    e.num("bytes_written", st.bytes_written);
+    e.num("tokens_written", st.tokens_written);
+    e.str("token_counter", st.token_counter);
+    e.num("token_budget_skips", st.token_budget_skips);
+    e.num("bytes_before_compaction", st.bytes_before_compaction);
+    e.num("bytes_after_compaction", st.bytes_after_compaction);
+    e.num("skeletons", st.skeletons);
+    e.num("skeleton_bytes_elided", st.skeleton_bytes_elided);
+    e.num("overlap_suppressed", st.overlap_suppressed);
+    e.num("overlap_trimmed", st.overlap_trimmed);
+    e.num("overlap_bytes_saved", st.overlap_bytes_saved);
+    e.num("symbols_seen", st.symbols_seen);
+    e.num("rg_queries", st.rg_queries);
+    e.num("rg_hits_total", st.rg_hits_total);
+    e.num("index_lookups", st.index_lookups);
+    e.num("index_hits_total", st.index_hits_total);
+    e.num("type_lookups", st.type_lookups);
+    e.num("impl_jumps", st.impl_jumps);
+    e.num("receivers_typed", st.receivers_typed);
+    e.num("narrowed_lookups", st.narrowed_lookups);
+    e.num("bloom_skipped_files", st.bloom_skipped_files);
+    e.num("callers_found", st.callers_found);
+    e.num("callers_written", st.callers_written);
+    e.num("parses", st.parses);
+    e.num("parse_ms", st.parse_ms);
+    e.num("parse_timeouts", st.parse_timeouts);
+    e.num("parse_skipped", st.parse_skipped);
+    e.num("lexer_fallbacks", st.lexer_fallbacks);
+    e.list("over_budget_file", "over_budget_files", st.over_budget_files);
+    e.flag("truncated_by_deadline", st.truncated_by_deadline);
+    e.num("rg_killed", st.rg_killed);
+    e.str("pack_cache", st.pack_cache);
+    e.num("pack_cache_files", st.pack_cache_files);
+    e.num("pack_cache_rehashed", st.pack_cache_rehashed);
+}
+
+namespace {
+
+struct TextStats
+{
+    OutWriter &w;
+
+    void num(std::string_view k, int64_t v) { w.kv_int(k, v); }
+    void str(std::string_view k, std::string_view v) { w.kv(k, v); }
+    void flag(std::string_view k, bool v) { w.kv(k, v ? "yes" : "no"); }
+    void list(std::string_view k, std::string_view, const std::vector<std::string> &v)
+    {
+        for (const std::string &x : v) {
+            w.kv(k, x);
+        }
+    }
+};
+
+struct JsonStats
+{
+    JsonRecord &r;
+
+    void num(std::string_view k, int64_t v) { r.num(k, v); }
+    void str(std::string_view k, std::string_view v) { r.str(k, v); }
+    void flag(std::string_view k, bool v) { r.flag(k, v); }
+    void list(std::string_view, std::string_view k, const std::vector<std::string> &v) { r.strs(k, v); }
+};
+
+} // namespace
+
+void write_context_stats(OutWriter &w, const ContextStats &st)
+{
+    w.put("\n[STATS]\n");
+    TextStats e{w};
+    each_stat(st, e);
+    w.put("[/STATS]\n");
+    w.put("[/CONTEXT]\n");
+}
+
+void write_context_head_jsonl(OutWriter &w, const ContextRequest &req, const ContextOptions &opt)
+{
+    JsonRecord(w, "context")
+        .str("repo_root", req.repo_root)
+        .str("anchor_class", req.anchor_class_fqcn)
+        .str("anchor_method", req.anchor_method)
+        .num("max_hops", opt.max_hops)
+        .num("max_snippets", opt.max_snippets)
+        .num("max_bytes", opt.max_bytes)
+        .num("max_tokens", opt.max_tokens)
+        .num("max_callers", opt.max_callers)
+        .num("parse_timeout_ms", opt.parse_timeout_ms)
+        .num("parse_budget_ms", opt.parse_budget_ms)
+        .num("deadline_ms", opt.deadline_ms)
+        .end();
+}
+
+void write_context_snippet_jsonl(OutWriter &w, const ContextSnippet &s)
+{
+    JsonRecord(w, "snippet")
+        .num("hop", s.hop)
+        .num("score", s.score)
+        .str("symbol", s.symbol)
+        .str("file", s.rel_path)
+        .str("kind", s.kind)
+        .unum("start", s.start)
+        .unum("end", s.end)
+        .num("tokens", s.tokens)
+        .flag("skeleton", s.skeleton)
+        .str("text", s.text)
+        .end();
+}
+
+void write_context_stats_jsonl(OutWriter &w, const ContextStats &st)
+{
+    JsonRecord r(w, "stats");
+    JsonStats e{r};
+    each_stat(st, e);
+    r.end();
+}
+
+} // namespace cli
@@ -0,0 +1,25 @@
+
+#pragma once
+
+#include "sys/out_writer.h"
+#include "workspace/context_builder.h"
+
+namespace cli
+{
+
+// The [CONTEXT] block shared by `context` and ask's etc/context.txt.
+void write_context_head(OutWriter &w, const ContextRequest &req, const ContextOptions &opt);
+
+// Snippet text is queued by reference: flush before s goes away.
+void write_context_snippet(OutWriter &w, const ContextSnippet &s);
+
+// [STATS] and the closing [/CONTEXT].
+void write_context_stats(OutWriter &w, const ContextStats &st);
+
+// The same as JSON Lines records: "context", one "snippet" each, "stats".
+// Values are copied, so s need not outlive the call.
+void write_context_head_jsonl(OutWriter &w, const ContextRequest &req, const ContextOptions &opt);
+void write_context_snippet_jsonl(OutWriter &w, const ContextSnippet &s);
+void write_context_stats_jsonl(OutWriter &w, const ContextStats &st);
+
+} // namespace cli
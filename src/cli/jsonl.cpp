@@ -0,0 +1,75 @@
+
+#include "cli/jsonl.h"
+
+#include <cstring>
+
+namespace cli
+{
+
+bool parse_output_format(const char *s, OutputFormat *out)
+{
+    if (std::strcmp(s, "text") == 0) {
+        *out = OutputFormat::Text;
+        return true;
+    }
+    if (std::strcmp(s, "jsonl") == 0) {
+        *out = OutputFormat::Jsonl;
+        return true;
+    }
+    return false;
+}
+
+JsonRecord::JsonRecord(OutWriter &w, std::string_view type)
+    : w_(w)
+{
+    w_.put("{\"type\":").put_json(type);
+}
+
+OutWriter &JsonRecord::key(std::string_view k)
+{
+    return w_.put(",\"").put(k).put("\":");
+}
+
+JsonRecord &JsonRecord::str(std::string_view k, std::string_view value)
+{
+    key(k).put_json(value);
+    return *this;
+}
+
+JsonRecord &JsonRecord::num(std::string_view k, int64_t value)
+{
+    key(k).put_int(value);
+    return *this;
+}
+
+JsonRecord &JsonRecord::unum(std::string_view k, uint64_t value)
+{
+    key(k).put_uint(value);
+    return *this;
+}
+
+JsonRecord &JsonRecord::flag(std::string_view k, bool value)
+{
+    key(k).put(value ? "true" : "false");
+    return *this;
+}
+
+JsonRecord &JsonRecord::strs(std::string_view k, const std::vector<std::string> &values)
+{
+    key(k).put('[');
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0) {
+            w_.put(',');
+        }
+        w_.put_json(values[i]);
+    }
+    w_.put(']');
+    return *this;
+}
+
+void JsonRecord::end()
+{
+    w_.put("}\n");
+}
+
+} // namespace cli
@@ -0,0 +1,44 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sys/out_writer.h"
+
+namespace cli
+{
+
+enum class OutputFormat
+{
+    Text,
+    Jsonl
+};
+
+// "text" or "jsonl"
+bool parse_output_format(const char *s, OutputFormat *out);
+
+// One JSON Lines record, {"type":"<type>",...} and a newline. Keys are
+// written as given; values are escaped.
+class JsonRecord
+{
+public:
+    JsonRecord(OutWriter &w, std::string_view type);
+
+    JsonRecord &str(std::string_view key, std::string_view value);
+    JsonRecord &num(std::string_view key, int64_t value);
+    JsonRecord &unum(std::string_view key, uint64_t value);
+    JsonRecord &flag(std::string_view key, bool value);
+    JsonRecord &strs(std::string_view key, const std::vector<std::string> &values);
+
+    void end();
+
+private:
+    OutWriter &key(std::string_view k);
+
+    OutWriter &w_;
+};
+
+} // namespace cli
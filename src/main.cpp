@@ -3,6 +3,7 @@
 #include <cstring>
 #include "cli/commands.h"
 #include "app/codegen_runner.h"
+#include "workspace/java/ts_alloc.h"
 
 static void usage(const char *argv0) 
 {
@@ -15,6 +16,8 @@ static void usage(const char *argv0)
 
 int main(int argc, char **argv) 
 {
+  install_ts_allocator();
+
   int rc = 0;
   if (cli::handle(argc, argv, &rc)) return rc;
   const char *prompt = "prompt.txt";
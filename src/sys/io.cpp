@@ -3,10 +3,12 @@
 #include "sys/fd.h"
 #include "sys/error.h"
 #include <cerrno>
+#include <climits>
 #include <cstdint>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h> 
+#include <sys/uio.h>
 
 
 ssize_t write_all(int fd, const void *buf, size_t n) 
@@ -25,6 +27,36 @@ ssize_t write_all(int fd, const void *buf, size_t n)
 }
 
 
+ssize_t writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    while (iovcnt > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        ssize_t rc = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += static_cast<size_t>(rc);
+        size_t left = static_cast<size_t>(rc);
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (left > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return static_cast<ssize_t>(total);
+}
+
+
 void write_file_to_fd(const char *path, int out_fd) 
 {
     int in = open(path, O_RDONLY);
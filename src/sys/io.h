@@ -4,8 +4,12 @@
 #include <cstddef>
 // #include <cstdint>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 ssize_t write_all(int fd, const void *buf, size_t n);
 
+// writev until every segment is out; iov is consumed (advanced in place).
+ssize_t writev_all(int fd, struct iovec *iov, int iovcnt);
+
 void write_file_to_fd(const char *path, int out_fd);
 
@@ -0,0 +1,66 @@
+
+#include "sys/mmap_file.h"
+#include "sys/fd.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+MappedFile::~MappedFile() { close(); }
+
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(other.data_), size_(other.size_)
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+
+MappedFile& MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    Fd f(fd);
+
+    struct stat st;
+    if (fstat(f.get(), &st) < 0) return false;
+    if (st.st_size == 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, f.get(), 0);
+    if (p == MAP_FAILED) return false;
+
+    data_ = static_cast<const unsigned char *>(p);
+    size_ = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (data_) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,32 @@
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile& operator=(MappedFile &&other) noexcept;
+
+  // false (and errno set) if the file can't be opened or mapped
+  bool open(const std::string &path);
+  void close();
+
+  const unsigned char *data() const { return data_; }
+  size_t size() const { return size_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+private:
+  const unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+};
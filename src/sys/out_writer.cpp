@@ -0,0 +1,195 @@
+
+#include "sys/out_writer.h"
+
+#include <charconv>
+#include <cstring>
+
+#include "sys/error.h"
+#include "sys/io.h"
+
+
+OutWriter::OutWriter(int fd, const char *what)
+    : fd_(fd), what_(what)
+{
+}
+
+
+OutWriter::~OutWriter()
+{
+    flush();
+}
+
+
+void OutWriter::seal()
+{
+    if (used_ > sealed_) {
+        iov_[niov_].iov_base = buf_ + sealed_;
+        iov_[niov_].iov_len = used_ - sealed_;
+        niov_++;
+        sealed_ = used_;
+    }
+}
+
+
+void OutWriter::flush()
+{
+    seal();
+    if (niov_ == 0) {
+        return;
+    }
+    if (writev_all(fd_, iov_, niov_) < 0) {
+        die(what_);
+    }
+    syscalls_ += 1;
+    niov_ = 0;
+    used_ = 0;
+    sealed_ = 0;
+}
+
+
+OutWriter &OutWriter::put(std::string_view s)
+{
+    if (s.size() > kBufSize) {
+        // too big to copy: send it now, before the caller can drop it
+        flush();
+        if (write_all(fd_, s.data(), s.size()) < 0) {
+            die(what_);
+        }
+        syscalls_ += 1;
+        bytes_ += s.size();
+        return *this;
+    }
+    if (s.size() > kBufSize - used_) {
+        flush();
+    }
+    std::memcpy(buf_ + used_, s.data(), s.size());
+    used_ += s.size();
+    bytes_ += s.size();
+    return *this;
+}
+
+
+OutWriter &OutWriter::put(char c)
+{
+    if (used_ == kBufSize) {
+        flush();
+    }
+    buf_[used_++] = c;
+    bytes_ += 1;
+    return *this;
+}
+
+
+OutWriter &OutWriter::put_int(int64_t v)
+{
+    char tmp[24];
+    std::to_chars_result r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    return put(std::string_view(tmp, static_cast<size_t>(r.ptr - tmp)));
+}
+
+
+OutWriter &OutWriter::put_uint(uint64_t v)
+{
+    char tmp[24];
+    std::to_chars_result r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    return put(std::string_view(tmp, static_cast<size_t>(r.ptr - tmp)));
+}
+
+
+OutWriter &OutWriter::put_ref(std::string_view s)
+{
+    if (s.size() <= kCopyMax) {
+        return put(s);
+    }
+    seal();
+    // keep a slot for the bytes buffered after this piece
+    if (niov_ > kMaxIov - 2) {
+        flush();
+    }
+    iov_[niov_].iov_base = const_cast<char *>(s.data());
+    iov_[niov_].iov_len = s.size();
+    niov_++;
+    bytes_ += s.size();
+    return *this;
+}
+
+
+// Length of the well-formed UTF-8 sequence at s[i] (lead byte >= 0x80), or 0.
+// Overlong forms, surrogates and code points past U+10FFFF are not well-formed.
+static size_t utf8_seq_len(std::string_view s, size_t i)
+{
+    auto byte = [&](size_t k) { return i + k < s.size() ? static_cast<unsigned char>(s[i + k]) : 0; };
+    auto cont = [&](size_t k) { unsigned char b = byte(k); return b >= 0x80 && b <= 0xbf; };
+    unsigned char c = byte(0);
+    if (c >= 0xc2 && c <= 0xdf) {
+        return cont(1) ? 2 : 0;
+    }
+    if (c >= 0xe0 && c <= 0xef) {
+        unsigned char lo = c == 0xe0 ? 0xa0 : 0x80;
+        unsigned char hi = c == 0xed ? 0x9f : 0xbf;
+        return byte(1) >= lo && byte(1) <= hi && cont(2) ? 3 : 0;
+    }
+    if (c >= 0xf0 && c <= 0xf4) {
+        unsigned char lo = c == 0xf0 ? 0x90 : 0x80;
+        unsigned char hi = c == 0xf4 ? 0x8f : 0xbf;
+        return byte(1) >= lo && byte(1) <= hi && cont(2) && cont(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+
+OutWriter &OutWriter::put_json(std::string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    size_t run = 0;   // start of the bytes that need no escaping
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            continue;
+        }
+        size_t len = c >= 0x80 ? utf8_seq_len(s, i) : 0;
+        if (len > 0) {
+            i += len - 1;
+            continue;
+        }
+        put(s.substr(run, i - run));
+        run = i + 1;
+        if (c >= 0x80) {
+            // one replacement character per byte that isn't part of a valid sequence
+            put("\\ufffd");
+            continue;
+        }
+        switch (c) {
+            case '"':  put("\\\""); break;
+            case '\\': put("\\\\"); break;
+            case '\n': put("\\n"); break;
+            case '\r': put("\\r"); break;
+            case '\t': put("\\t"); break;
+            default: {
+                char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                put(std::string_view(u, sizeof(u)));
+            }
+        }
+    }
+    put(s.substr(run));
+    return put('"');
+}
+
+
+OutWriter &OutWriter::kv(std::string_view key, std::string_view value)
+{
+    return put(key).put(": ").put(value).put('\n');
+}
+
+
+OutWriter &OutWriter::kv_int(std::string_view key, int64_t value)
+{
+    return put(key).put(": ").put_int(value).put('\n');
+}
+
+
+OutWriter &OutWriter::kv_uint(std::string_view key, uint64_t value)
+{
+    return put(key).put(": ").put_uint(value).put('\n');
+}
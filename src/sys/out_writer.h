@@ -0,0 +1,61 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <sys/uio.h>
+
+
+// Output for the text commands. Small pieces (keys, numbers formatted with
+// to_chars) are copied into a fixed buffer; snippet bodies are queued by
+// reference and go out with the buffered bytes around them in one writev.
+// Dies with `what` on a write error, like the commands did before.
+class OutWriter
+{
+public:
+    explicit OutWriter(int fd, const char *what = "write(out)");
+    ~OutWriter();
+
+    OutWriter(const OutWriter &) = delete;
+    OutWriter &operator=(const OutWriter &) = delete;
+
+    OutWriter &put(std::string_view s);
+    OutWriter &put(char c);
+    OutWriter &put_int(int64_t v);
+    OutWriter &put_uint(uint64_t v);
+
+    // s must stay valid until the next flush(); big pieces are not copied
+    OutWriter &put_ref(std::string_view s);
+
+    // s as a JSON string, quotes included; valid UTF-8 passes through and
+    // each byte that isn't part of a valid sequence becomes \ufffd
+    OutWriter &put_json(std::string_view s);
+
+    // "key: value\n"
+    OutWriter &kv(std::string_view key, std::string_view value);
+    OutWriter &kv_int(std::string_view key, int64_t value);
+    OutWriter &kv_uint(std::string_view key, uint64_t value);
+
+    void flush();
+
+    uint64_t bytes() const { return bytes_; }
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    static constexpr size_t kBufSize = 16 * 1024;
+    static constexpr int kMaxIov = 64;
+    static constexpr size_t kCopyMax = 256;   // put_ref copies pieces up to this size
+
+    void seal();   // turn the bytes buffered since the last seal into an iovec
+
+    int fd_;
+    const char *what_;
+    char buf_[kBufSize];
+    size_t used_ = 0;
+    size_t sealed_ = 0;
+    struct iovec iov_[kMaxIov];
+    int niov_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t syscalls_ = 0;
+};
@@ -0,0 +1,294 @@
+
+#include "workspace/bloom_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/regex_literals.h"
+
+
+// On-disk layout:
+//   header   64 bytes
+//   files    IndexFileList records + rel paths
+//   filters  nfiles x { u64 bits_off, u32 m_bits, u32 k }   (m_bits == 0: no filter)
+//   bits     filters back to back, each a multiple of 64 bits
+static const char kMagic[8] = {'C', 'G', 'B', 'L', 'M', '0', '0', '2'};
+
+static constexpr size_t kHeaderSize = 64;
+static constexpr size_t kFilterRecSize = 16;
+
+
+static uint64_t hash_token(std::string_view s)
+{
+    // FNV-1a, then a splitmix64 finalizer so both halves are usable for double hashing
+    uint64_t h = 1469598103934665603ull;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+
+// k probes at h1 + i*h2 (Kirsch-Mitzenmacher)
+template <typename F>
+static void for_each_probe(uint64_t h, uint32_t m_bits, uint32_t k, F f)
+{
+    uint32_t h1 = static_cast<uint32_t>(h);
+    uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1u;
+    for (uint32_t i = 0; i < k; i++) {
+        f((h1 + i * h2) % m_bits);
+    }
+}
+
+
+std::string bloom_index_path(const std::string &index_dir)
+{
+    return index_dir + "/blooms.idx";
+}
+
+
+// Identifier tokens for lookups by Java name, plus the is_word_byte runs
+// inside those that hold '$' or non-ASCII bytes, for literal_words.
+static void collect_tokens(const std::string &src, std::vector<std::string_view> *out)
+{
+    out->clear();
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(src.data());
+    size_t n = src.size();
+    size_t i = 0;
+    while (i < n) {
+        if (!is_ident_byte(p[i])) {
+            i++;
+            continue;
+        }
+        size_t j = i;
+        while (j < n && is_ident_byte(p[j])) {
+            j++;
+        }
+        out->emplace_back(src.data() + i, j - i);
+        size_t w = i;
+        while (w < j) {
+            size_t e = w;
+            while (e < j && is_word_byte(p[e])) {
+                e++;
+            }
+            if (e > w && (w > i || e < j)) {
+                out->emplace_back(src.data() + w, e - w);
+            }
+            w = e < j ? e + 1 : j;
+        }
+        i = j;
+    }
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
+
+
+bool build_bloom_index(const FileTable &files,
+                       double fp_rate,
+                       const std::string &out_path,
+                       BloomBuildStats *stats,
+                       std::string *error)
+{
+    if (!(fp_rate > 0.0 && fp_rate < 1.0)) {
+        *error = "bloom false-positive rate must be in (0, 1)";
+        return false;
+    }
+
+    BloomBuildStats st;
+    std::string records;
+    std::string paths;
+    std::string filters;
+    std::string bits;
+
+    // optimal bits per token and probe count for the target rate
+    const double ln2 = std::log(2.0);
+    const double bits_per_token = -std::log(fp_rate) / (ln2 * ln2);
+    const uint32_t k = std::max<uint32_t>(1, static_cast<uint32_t>(std::lround(bits_per_token * ln2)));
+
+    std::string src;
+    std::vector<std::string_view> tokens;
+    std::vector<uint64_t> words;
+
+    uint32_t idx = 0;
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (!files.alive(id)) {
+            continue;
+        }
+        bool readable = read_file_bytes(files.abs_path(id), &src);
+        IndexFileList::append(files, id, readable, &records, &paths);
+        idx++;
+
+        if (!readable) {
+            st.unreadable += 1;
+            index_store<uint64_t>(&filters, 0);
+            index_store<uint32_t>(&filters, 0);
+            index_store<uint32_t>(&filters, 0);
+            continue;
+        }
+
+        collect_tokens(src, &tokens);
+        st.tokens += tokens.size();
+
+        uint64_t m = static_cast<uint64_t>(std::ceil(bits_per_token * static_cast<double>(std::max<size_t>(tokens.size(), 1))));
+        m = std::max<uint64_t>(64, (m + 63) / 64 * 64);
+        uint32_t m_bits = static_cast<uint32_t>(std::min<uint64_t>(m, 1ull << 31));
+
+        words.assign(m_bits / 64, 0);
+        for (std::string_view t : tokens) {
+            for_each_probe(hash_token(t), m_bits, k, [&](uint32_t b) { words[b / 64] |= 1ull << (b % 64); });
+        }
+
+        index_store<uint64_t>(&filters, bits.size());
+        index_store<uint32_t>(&filters, m_bits);
+        index_store<uint32_t>(&filters, k);
+        bits.append(reinterpret_cast<const char *>(words.data()), words.size() * 8);
+    }
+    st.files = idx;
+    st.filter_bytes = bits.size();
+
+    std::string out;
+    out.resize(kHeaderSize, '\0');
+    size_t files_off = out.size();
+    out += records;
+    size_t paths_off = out.size();
+    out += paths;
+    index_pad8(&out);
+    size_t filters_off = out.size();
+    out += filters;
+    size_t bits_off = out.size();
+    out += bits;
+
+    std::memcpy(&out[0], kMagic, sizeof(kMagic));
+    index_store_at<uint32_t>(&out, 8, idx);
+    index_store_at<double>(&out, 16, fp_rate);
+    index_store_at<uint64_t>(&out, 24, files_off);
+    index_store_at<uint64_t>(&out, 32, paths_off);
+    index_store_at<uint64_t>(&out, 40, filters_off);
+    index_store_at<uint64_t>(&out, 48, bits_off);
+    index_store_at<uint64_t>(&out, 56, out.size());
+    st.index_bytes = out.size();
+
+    if (!write_file_atomic(out_path, out, error)) {
+        return false;
+    }
+    if (stats) {
+        *stats = st;
+    }
+    return true;
+}
+
+
+bool BloomIndex::open(const std::string &path, std::string *error)
+{
+    if (!map_.open(path)) {
+        *error = "open(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+    const unsigned char *base = map_.data();
+    size_t size = map_.size();
+
+    if (size < kHeaderSize || std::memcmp(base, kMagic, sizeof(kMagic)) != 0) {
+        *error = "not a bloom index: " + path;
+        map_.close();
+        return false;
+    }
+
+    uint32_t nfiles = index_load<uint32_t>(base + 8);
+    fp_rate_ = index_load<double>(base + 16);
+    uint64_t files_off = index_load<uint64_t>(base + 24);
+    uint64_t paths_off = index_load<uint64_t>(base + 32);
+    uint64_t filters_off = index_load<uint64_t>(base + 40);
+    uint64_t bits_off = index_load<uint64_t>(base + 48);
+    uint64_t total = index_load<uint64_t>(base + 56);
+
+    bool ok = total == size &&
+              files_off == kHeaderSize &&
+              paths_off == files_off + static_cast<uint64_t>(nfiles) * IndexFileList::kRecordSize &&
+              paths_off <= filters_off &&
+              bits_off == filters_off + static_cast<uint64_t>(nfiles) * kFilterRecSize &&
+              bits_off <= size;
+    if (!ok) {
+        *error = "corrupt bloom index: " + path;
+        map_.close();
+        return false;
+    }
+
+    files_.init(base + files_off, base + paths_off, nfiles);
+    filters_ = base + filters_off;
+    bits_ = base + bits_off;
+    bits_size_ = size - bits_off;
+    return true;
+}
+
+
+bool BloomIndex::may_contain(uint32_t i, std::string_view word) const
+{
+    if (!map_ || i >= files_.count()) {
+        return true;
+    }
+    const unsigned char *rec = filters_ + static_cast<size_t>(i) * kFilterRecSize;
+    uint64_t off = index_load<uint64_t>(rec);
+    uint32_t m_bits = index_load<uint32_t>(rec + 8);
+    uint32_t k = index_load<uint32_t>(rec + 12);
+    if (m_bits == 0 || off + m_bits / 8 > bits_size_) {
+        return true;
+    }
+
+    const unsigned char *f = bits_ + off;
+    bool all = true;
+    for_each_probe(hash_token(word), m_bits, k, [&](uint32_t b) {
+        if (!((index_load<uint64_t>(f + (b / 64) * 8) >> (b % 64)) & 1u)) {
+            all = false;
+        }
+    });
+    return all;
+}
+
+
+void FileBlooms::bind(const BloomIndex *index, const FileTable &files)
+{
+    index_ = index;
+    from_table_.assign(files.size(), kStale);
+    if (!index) {
+        return;
+    }
+    std::vector<FileId> to_table;
+    std::vector<FileId> stale;
+    index->files().resolve(files, &to_table, &stale);
+    for (uint32_t i = 0; i < to_table.size(); i++) {
+        if (to_table[i] != kNoFile) {
+            from_table_[to_table[i]] = i;
+        }
+    }
+}
+
+
+bool FileBlooms::may_contain(FileId id, std::string_view word) const
+{
+    if (!index_ || id >= from_table_.size() || from_table_[id] == kStale) {
+        return true;
+    }
+    return index_->may_contain(from_table_[id], word);
+}
+
+
+bool FileBlooms::may_contain_all(FileId id, const std::vector<std::string> &words) const
+{
+    for (const std::string &w : words) {
+        if (!may_contain(id, w)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sys/mmap_file.h"
+#include "workspace/file_table.h"
+#include "workspace/index_io.h"
+
+
+struct BloomBuildStats
+{
+    size_t files = 0;
+    size_t unreadable = 0;
+    size_t tokens = 0;          // distinct tokens summed over files
+    uint64_t filter_bytes = 0;
+    uint64_t index_bytes = 0;
+};
+
+
+std::string bloom_index_path(const std::string &index_dir);
+
+static constexpr double kDefaultBloomFp = 0.01;
+
+// One Bloom filter per file over its identifier-like tokens (is_ident_byte
+// runs, and the is_word_byte runs inside them; comments and strings
+// included, so it never contradicts a text search). Each filter is sized
+// for its own token count at fp_rate.
+bool build_bloom_index(const FileTable &files,
+                       double fp_rate,
+                       const std::string &out_path,
+                       BloomBuildStats *stats,
+                       std::string *error);
+
+
+class BloomIndex
+{
+public:
+    bool open(const std::string &path, std::string *error);
+
+    const IndexFileList &files() const { return files_; }
+    double fp_rate() const { return fp_rate_; }
+
+    // false only when file i's filter proves word absent
+    bool may_contain(uint32_t i, std::string_view word) const;
+
+private:
+    MappedFile map_;
+    IndexFileList files_;
+    double fp_rate_ = 0;
+    const unsigned char *filters_ = nullptr;
+    const unsigned char *bits_ = nullptr;
+    uint64_t bits_size_ = 0;
+};
+
+
+// A BloomIndex addressed by the ids of one FileTable. Files the index
+// can't vouch for (new, changed, unreadable) always "may contain".
+class FileBlooms
+{
+public:
+    void bind(const BloomIndex *index, const FileTable &files);
+
+    bool bound() const { return index_ != nullptr; }
+
+    bool may_contain(FileId id, std::string_view word) const;
+    bool may_contain_all(FileId id, const std::vector<std::string> &words) const;
+
+private:
+    static constexpr uint32_t kStale = 0xffffffffu;
+
+    const BloomIndex *index_ = nullptr;
+    std::vector<uint32_t> from_table_;
+};
@@ -2,24 +2,30 @@
 #include "workspace/context_builder.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "workspace/index_io.h"
+#include "workspace/pack_cache.h"
+#include "workspace/regex_literals.h"
+#include "workspace/search_indexed.h"
 #include "workspace/search_rg.h"
+#include "workspace/token_count.h"
+#include "workspace/java/callers.h"
 #include "workspace/java/locator.h"
 #include "workspace/java/extractor.h"
+#include "workspace/java/java_compact.h"
 #include "workspace/java/dep_harvest.h"
 #include "workspace/java/snippet_from_hit.h"
+#include "workspace/java/parse_cache.h"
 
 
-static bool path_is_main_java(const std::string &p)
-{
-    return p.find("/src/main/java/") != std::string::npos;
-}
-
-static int score_snippet(const std::string &anchor_rel, const HitSnippet &snip)
+static int score_snippet(const FileTable &files, FileId anchor, FileId file, const HitSnippet &snip)
 {
     int score = 0;
 
@@ -29,19 +35,18 @@ static int score_snippet(const std::string &anchor_rel, const HitSnippet &snip)
         score += 30;
     }
 
-    if (path_is_main_java(snip.rel_path)) {
+    if (files.flags(file) & FF_MAIN_SRC) {
         score += 20;
     }
 
-    size_t slash = anchor_rel.rfind('/');
-    if (slash != std::string::npos) {
-        std::string dir = anchor_rel.substr(0, slash + 1);
-        if (snip.rel_path.rfind(dir, 0) == 0) {
-            score += 20;
-        }
+    // same package dir, else same module
+    if (files.dir_id(file) == files.dir_id(anchor)) {
+        score += 20;
+    } else if (files.module_id(file) == files.module_id(anchor)) {
+        score += 10;
     }
 
-    size_t len = snip.end > snip.start ? (snip.end - snip.start) : 0;
+    size_t len = snip.skeleton ? snip.text.size() : snip.end > snip.start ? (snip.end - snip.start) : 0;
     if (len > 8000) {
         score -= 20;
     }
@@ -52,42 +57,563 @@ static int score_snippet(const std::string &anchor_rel, const HitSnippet &snip)
     return score;
 }
 
-static std::string make_snip_key(const HitSnippet &sn)
+static std::string make_snip_key(FileId file, size_t start, size_t end)
+{
+    return std::to_string(file) + ":" + std::to_string(start) + ":" + std::to_string(end);
+}
+
+static std::string make_snip_key(FileId file, const HitSnippet &sn)
 {
-    return sn.rel_path + ":" + std::to_string(sn.start) + ":" + std::to_string(sn.end);
+    return make_snip_key(file, sn.start, sn.end);
 }
 
 static std::string regex_for_symbol_call(const std::string &sym)
 {
     // \bSYM\s*\(
-    return "\\b" + sym + "\\s*\\(";
+    return regex_token(sym) + "\\s*\\(";
 }
 
 
-ContextPack build_context_pack(const ContextRequest &req,
-                               const ContextOptions &opt,
-                               const std::vector<FileEntry> &files)
+static constexpr uint32_t kAnyType = 0xffffffffu;
+
+
+namespace
+{
+
+// Identifier index bound to the current file table.
+struct IdentLookup
+{
+    const IdentIndex *idents = nullptr;
+    std::vector<FileId> to_table;
+    std::vector<std::string> stale_paths;   // abs paths rg must still cover
+};
+
+// Type index bound to the current file table.
+struct TypeLookup
+{
+    const TypeIndex *types = nullptr;
+    std::vector<FileId> to_table;
+    std::vector<std::string> stale_paths;
+};
+
+struct TypedDecl
+{
+    FileId file = kNoFile;
+    uint32_t start = 0;
+    uint32_t end = 0;
+    bool impl = false;   // reached from an interface/abstract declaration
+};
+
+} // namespace
+
+
+// Maps an index's file list onto the table; false when too much changed
+// since indexing for the index to be worth consulting.
+static bool bind_index_files(const IndexFileList &list,
+                             const ContextRequest &req,
+                             const FileTable &files,
+                             std::vector<FileId> *to_table,
+                             std::vector<std::string> *stale_paths)
+{
+    std::vector<FileId> stale;
+    list.resolve(files, to_table, &stale);
+    if (stale.size() > kMaxStaleForIndex) {
+        return false;
+    }
+
+    RgQuery q;
+    q.globs = req.globs;
+    q.excludes = req.excludes;
+    for (FileId id : stale) {
+        if (rg_query_accepts(q, files.rel_path(id))) {
+            stale_paths->push_back(files.abs_path(id));
+        }
+    }
+    return true;
+}
+
+
+static bool bind_ident_index(const WorkspaceIndex *index,
+                             const ContextRequest &req,
+                             const FileTable &files,
+                             IdentLookup *out)
+{
+    if (!index || !index->has_idents ||
+        !bind_index_files(index->idents.files(), req, files, &out->to_table, &out->stale_paths)) {
+        return false;
+    }
+    out->idents = &index->idents;
+    return true;
+}
+
+
+static bool bind_type_index(const WorkspaceIndex *index,
+                            const ContextRequest &req,
+                            const FileTable &files,
+                            TypeLookup *out)
+{
+    if (!index || !index->has_types ||
+        !bind_index_files(index->types.files(), req, files, &out->to_table, &out->stale_paths)) {
+        return false;
+    }
+    out->types = &index->types;
+    return true;
+}
+
+
+// Method declarations named sym that have a body. A bodyless one (interface
+// or abstract method) is replaced by the implementations below its type,
+// so the snippet is code rather than the whole interface.
+// only_type limits this to methods declared by that index-local type.
+static void type_hits_for_symbol(const TypeLookup &lk,
+                                 const FileTable &files,
+                                 const RgQuery &q,
+                                 const std::string &sym,
+                                 uint32_t only_type,
+                                 std::vector<TypedDecl> *out,
+                                 int *impl_jumps)
+{
+    std::vector<MethodDecl> decls;
+    std::vector<MethodDecl> impls;
+    lk.types->methods_named(sym, &decls);
+
+    std::unordered_set<uint64_t> seen;
+    auto add = [&](const MethodDecl &m, bool impl)
+    {
+        FileId f = (m.file < lk.to_table.size()) ? lk.to_table[m.file] : kNoFile;
+        if (f == kNoFile || !rg_query_accepts(q, files.rel_path(f))) {
+            return;
+        }
+        if (!seen.insert((static_cast<uint64_t>(f) << 32) | m.start).second) {
+            return;
+        }
+        out->push_back(TypedDecl{f, m.start, m.end, impl});
+    };
+
+    for (const MethodDecl &m : decls) {
+        if (m.ctor || (only_type != kAnyType && m.type != only_type)) {
+            continue;
+        }
+        if (m.has_body) {
+            add(m, false);
+            continue;
+        }
+        lk.types->implementations(m.type, sym, &impls);
+        if (!impls.empty()) {
+            *impl_jumps += 1;
+        }
+        for (const MethodDecl &im : impls) {
+            add(im, true);
+        }
+    }
+}
+
+
+// Declarations of sym, or its call sites when nothing declares it in the
+// workspace, as hits the snippet path can consume like rg's.
+static void index_hits_for_symbol(const IdentLookup &lk,
+                                  const FileTable &files,
+                                  const RgQuery &q,
+                                  const std::string &sym,
+                                  std::vector<RgHit> *out)
+{
+    std::vector<IdentOccurrence> occ;
+    lk.idents->lookup(sym, IRM_DECL, &occ);
+    if (occ.empty()) {
+        lk.idents->lookup(sym, IRM_INVOKE, &occ);
+    }
+    for (const IdentOccurrence &o : occ) {
+        FileId f = (o.file < lk.to_table.size()) ? lk.to_table[o.file] : kNoFile;
+        if (f == kNoFile || !rg_query_accepts(q, files.rel_path(f))) {
+            continue;
+        }
+        RgHit h;
+        h.file_id = f;
+        h.abs_path = files.abs_path(f);
+        h.rel_path = std::string(files.rel_path(f));
+        h.match_byte_offset = o.offset;
+        h.match_len = static_cast<uint32_t>(sym.size());
+        out->push_back(std::move(h));
+    }
+}
+
+
+static bool ends_with_path(std::string_view rel, const std::string &fqcn)
+{
+    std::string tail = fqcn;
+    std::replace(tail.begin(), tail.end(), '.', '/');
+    tail += ".java";
+    return rel.size() >= tail.size() && rel.compare(rel.size() - tail.size(), tail.size(), tail) == 0 &&
+           (rel.size() == tail.size() || rel[rel.size() - tail.size() - 1] == '/');
+}
+
+
+static bool pack_full(const ContextOptions &opt, const ContextStats &st)
+{
+    return st.snippets_written >= opt.max_snippets || st.bytes_written >= opt.max_bytes ||
+           (opt.max_tokens > 0 && st.tokens_written >= opt.max_tokens);
+}
+
+
+// Compacts text when enabled and counts its size before and after.
+static void compact_snippet(const ContextOptions &opt, std::string *text, int *before, int *after)
+{
+    *before = static_cast<int>(text->size());
+    if (opt.compact_snippets) {
+        CompactOptions co;
+        co.strip_annotations = opt.strip_annotations;
+        *text = compact_java(*text, co);
+    }
+    *after = static_cast<int>(text->size());
+}
+
+
+// Whether text, once compacted, still fits the byte and token budgets;
+// counts its tokens into *tokens.
+static bool fits_budget(const ContextOptions &opt, TokenCounter &tc, std::string *text,
+                        int *tokens, ContextStats *st)
+{
+    int before = 0;
+    int after = 0;
+    compact_snippet(opt, text, &before, &after);
+    if (st->bytes_written + after > opt.max_bytes) {
+        return false;
+    }
+    *tokens = static_cast<int>(tc.count(*text));
+    if (opt.max_tokens > 0 && st->tokens_written + *tokens > opt.max_tokens) {
+        st->token_budget_skips += 1;
+        return false;
+    }
+    st->bytes_before_compaction += before;
+    st->bytes_after_compaction += after;
+    return true;
+}
+
+
+// Source ranges already written, per file, sorted and merged. Skeletons are
+// not added: their text leaves most of their range out.
+struct EmittedRanges
+{
+    using Range = std::pair<size_t, size_t>;
+    std::unordered_map<FileId, std::vector<Range>> by_file;
+
+    void add(FileId file, size_t start, size_t end)
+    {
+        std::vector<Range> &v = by_file[file];
+        auto it = std::lower_bound(v.begin(), v.end(), Range(start, end));
+        it = v.insert(it, Range(start, end));
+        if (it != v.begin() && std::prev(it)->second >= it->first) {
+            --it;
+        }
+        auto next = std::next(it);
+        while (next != v.end() && next->first <= it->second) {
+            it->second = std::max(it->second, next->second);
+            next = v.erase(next);
+        }
+    }
+
+    // Parts of [start, end) already written, in order.
+    std::vector<Range> overlaps(FileId file, size_t start, size_t end) const
+    {
+        std::vector<Range> out;
+        auto f = by_file.find(file);
+        if (f == by_file.end()) {
+            return out;
+        }
+        const std::vector<Range> &v = f->second;
+        auto it = std::upper_bound(v.begin(), v.end(), Range(start, SIZE_MAX));
+        if (it != v.begin()) {
+            --it;
+        }
+        for (; it != v.end() && it->first < end; ++it) {
+            if (it->second > start) {
+                out.emplace_back(std::max(it->first, start), std::min(it->second, end));
+            }
+        }
+        return out;
+    }
+};
+
+
+// Cuts the parts of a source-range snippet already in the pack out of its
+// text, leaving a "..." line for each. False if nothing new is left.
+static bool drop_emitted(const EmittedRanges &emitted, FileId file, size_t start, size_t end,
+                         std::string *text, ContextStats *st)
+{
+    std::vector<EmittedRanges::Range> ov = emitted.overlaps(file, start, end);
+    if (ov.empty()) {
+        return true;
+    }
+    if (ov.size() == 1 && ov[0].first == start && ov[0].second == end) {
+        st->overlap_suppressed += 1;
+        st->overlap_bytes_saved += static_cast<int>(text->size());
+        return false;
+    }
+    std::string out;
+    size_t pos = start;
+    for (const EmittedRanges::Range &r : ov) {
+        out.append(*text, pos - start, r.first - pos);
+        out += "\n...\n";
+        pos = r.second;
+    }
+    out.append(*text, pos - start, end - pos);
+    st->overlap_trimmed += 1;
+    st->overlap_bytes_saved += static_cast<int>(text->size()) - static_cast<int>(out.size());
+    *text = std::move(out);
+    return true;
+}
+
+
+// True once the deadline has passed; marks the pack as cut short.
+static bool past_deadline(std::chrono::steady_clock::time_point deadline, ContextStats *st)
+{
+    if (st->truncated_by_deadline) {
+        return true;
+    }
+    if (std::chrono::steady_clock::now() < deadline) {
+        return false;
+    }
+    st->truncated_by_deadline = true;
+    return true;
+}
+
+
+static void note_rg(const RgResult &rr, ContextStats *st)
+{
+    if (rr.killed_at_deadline) {
+        st->rg_killed += 1;
+        st->truncated_by_deadline = true;
+    }
+}
+
+
+// Look for callee only in the type its receiver resolves to, through the
+// file's imports: its declaration (or implementations) from the type
+// index, else an rg over just the located class file. False when the
+// type can't be pinned down or doesn't declare the method, so the caller
+// goes on to the global search.
+static bool narrow_by_receiver(const CalleeRef &callee,
+                               const JavaImports &imports,
+                               const TypeLookup *types,
+                               JavaLocator &locator,
+                               std::unordered_map<std::string, ClassLocation> *located,
+                               const FileTable &files,
+                               const ContextRequest &req,
+                               const RgQuery &q,
+                               std::vector<TypedDecl> *typed,
+                               RgResult *rr,
+                               ContextStats *st)
+{
+    std::vector<std::string> fqcns = candidate_fqcns(imports, callee.receiver_type);
+
+    if (types) {
+        std::vector<TypeDecl> decls;
+        types->types->types_named(callee.receiver_type, &decls);
+        for (const std::string &fqcn : fqcns) {
+            for (const TypeDecl &td : decls) {
+                if (td.fqcn == fqcn) {
+                    type_hits_for_symbol(*types, files, q, callee.name, td.id, typed, &st->impl_jumps);
+                }
+            }
+            if (!typed->empty()) {
+                return true;
+            }
+        }
+    }
+
+    for (const std::string &fqcn : fqcns) {
+        auto it = located->find(fqcn);
+        if (it == located->end()) {
+            it = located->emplace(fqcn, locator.locate_class(fqcn)).first;
+            st->bloom_skipped_files += it->second.bloom_skipped;
+        }
+        const ClassLocation &loc = it->second;
+        // the locator falls back to any file of that name; only an exact path counts here
+        if (!loc.found || !ends_with_path(loc.rel_path, fqcn) || !rg_query_accepts(q, loc.rel_path)) {
+            continue;
+        }
+        RgQuery one = q;
+        one.paths = {loc.abs_path};
+        st->rg_queries += 1;
+        *rr = rg_search_json(req.repo_root, one, &files);
+        note_rg(*rr, st);
+        if (rr->exit_code == 2) {
+            rr->hits.clear();
+        }
+        st->rg_hits_total += static_cast<int>(rr->hits.size());
+        if (!rr->hits.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Top opt.max_callers declarations calling the anchor method, scored like
+// callee snippets. Each caller is one snippet however often it calls.
+static void add_callers(const ContextRequest &req,
+                        const ContextOptions &opt,
+                        const FileTable &files,
+                        const WorkspaceIndex *index,
+                        const ClassLocation &loc,
+                        const Method &anchor,
+                        std::chrono::steady_clock::time_point deadline,
+                        TokenCounter &tc,
+                        std::unordered_set<std::string> *seen_snips,
+                        EmittedRanges *emitted,
+                        SnippetSink *sink,
+                        ContextPack *pack)
+{
+    RgQuery q;
+    q.globs = req.globs;
+    q.excludes = req.excludes;
+    q.deadline = deadline;
+
+    std::vector<CallerSite> sites;
+    const IdentIndex *idents = (index && index->has_idents) ? &index->idents : nullptr;
+    CallerStats cst;
+    find_callers(req.repo_root, files, idents, q, req.anchor_method, &sites, &cst);
+    if (idents) {
+        pack->stats.index_lookups += 1;
+        pack->stats.index_hits_total += static_cast<int>(cst.index_edges);
+    }
+    if (!idents || cst.stale_files > 0) {
+        pack->stats.rg_queries += 1;
+        pack->stats.rg_hits_total += static_cast<int>(cst.rg_hits);
+    }
+
+    struct Cand
+    {
+        FileId file = kNoFile;
+        HitSnippet snip;
+        int score = 0;
+    };
+
+    std::vector<Cand> cands;
+    std::unordered_set<std::string> distinct;
+    for (const CallerSite &site : sites) {
+        // recursion
+        if (site.file == loc.file_id && site.caller_start == anchor.start) {
+            continue;
+        }
+        if (!distinct.insert(make_snip_key(site.file, site.caller_start, site.caller_end)).second) {
+            continue;
+        }
+        Cand c;
+        c.file = site.file;
+        c.snip.found = true;
+        c.snip.abs_path = files.abs_path(site.file);
+        c.snip.rel_path = std::string(files.rel_path(site.file));
+        c.snip.kind = "method_declaration";
+        c.snip.start = site.caller_start;
+        c.snip.end = site.caller_end;
+        c.score = score_snippet(files, loc.file_id, site.file, c.snip);
+        cands.push_back(std::move(c));
+    }
+    pack->stats.callers_found = static_cast<int>(cands.size());
+
+    std::stable_sort(cands.begin(), cands.end(),
+                     [](const Cand &a, const Cand &b)
+                     {
+                         return a.score > b.score;
+                     });
+
+    std::string src;
+    FileId loaded = kNoFile;
+    for (Cand &c : cands) {
+        if (pack->stats.callers_written >= opt.max_callers ||
+            pack->stats.snippets_written >= opt.max_snippets) {
+            break;
+        }
+        if (c.file != loaded) {
+            loaded = c.file;
+            if (!read_file_bytes(c.snip.abs_path, &src)) {
+                src.clear();
+            }
+        }
+        if (c.snip.end > src.size() || c.snip.start >= c.snip.end) {
+            continue;
+        }
+        std::string text = src.substr(c.snip.start, c.snip.end - c.snip.start);
+        if (!drop_emitted(*emitted, c.file, c.snip.start, c.snip.end, &text, &pack->stats)) {
+            continue;
+        }
+        int tokens = 0;
+        if (!fits_budget(opt, tc, &text, &tokens, &pack->stats)) {
+            continue;
+        }
+        seen_snips->insert(make_snip_key(c.file, c.snip));
+        emitted->add(c.file, c.snip.start, c.snip.end);
+
+        ContextSnippet s;
+        s.file_id = c.file;
+        s.rel_path = c.snip.rel_path;
+        s.abs_path = c.snip.abs_path;
+        s.kind = c.snip.kind;
+        s.start = c.snip.start;
+        s.end = c.snip.end;
+        s.score = c.score;
+        s.hop = 0;
+        s.symbol = "CALLER";
+        s.text = std::move(text);
+        s.tokens = tokens;
+
+        pack->stats.snippets_written += 1;
+        pack->stats.bytes_written += static_cast<int>(s.text.size());
+        pack->stats.tokens_written += tokens;
+        pack->stats.callers_written += 1;
+        pack->snippets.push_back(std::move(s));
+        if (sink) {
+            sink->accept(pack->snippets.back());
+        }
+    }
+}
+
+
+static ContextPack build_pack(const ContextRequest &req,
+                              const ContextOptions &opt,
+                              const FileTable &files,
+                              const WorkspaceIndex *index,
+                              std::chrono::steady_clock::time_point deadline,
+                              SnippetSink *sink)
 {
     ContextPack pack;
 
+    TokenCounter tc;
+    if (!opt.token_vocab.empty()) {
+        std::string err;
+        tc.load_vocab(opt.token_vocab, &err);
+    }
+    pack.stats.token_counter = tc.method();
+
+    FileBlooms blooms;
+    if (index && index->has_blooms) {
+        blooms.bind(&index->blooms, files);
+    }
+
     // Resolve anchor class file.
-    std::unique_ptr<JavaLocator> locator = make_text_java_locator(files);
+    std::unique_ptr<JavaLocator> locator = make_text_java_locator(files, &blooms);
     ClassLocation loc = locator->locate_class(req.anchor_class_fqcn);
-    if (!loc.found) {
+    pack.stats.bloom_skipped_files += loc.bloom_skipped;
+    if (!loc.found || past_deadline(deadline, &pack.stats)) {
         pack.stats.hops_used = 0;
         return pack;
     }
 
     // Extract anchor method.
+    pack.anchor_file = loc.file_id;
     Method anchor = extract_method_from_file(loc.abs_path, loc.rel_path, req.anchor_method);
     if (!anchor.found) {
         pack.stats.hops_used = 0;
         return pack;
     }
 
+    EmittedRanges emitted;
+
     // Add anchor snippet first.
     if (opt.include_anchor_in_snippets) {
         ContextSnippet s;
+        s.file_id = loc.file_id;
         s.rel_path = loc.rel_path;
         s.abs_path = loc.abs_path;
         s.kind = "method_declaration";
@@ -97,39 +623,71 @@ ContextPack build_context_pack(const ContextRequest &req,
         s.hop = 0;
         s.symbol = "ANCHOR";
         s.text = anchor.text;
-        pack.snippets.push_back(std::move(s));
+        int before = 0;
+        int after = 0;
+        compact_snippet(opt, &s.text, &before, &after);
+        pack.stats.bytes_before_compaction += before;
+        pack.stats.bytes_after_compaction += after;
+        s.tokens = static_cast<int>(tc.count(s.text));
+        pack.stats.tokens_written += s.tokens;
+        emitted.add(loc.file_id, anchor.start, anchor.end);
         pack.stats.snippets_written += 1;
-        pack.stats.bytes_written += static_cast<int>(anchor.text.size());
+        pack.stats.bytes_written += static_cast<int>(s.text.size());
+        pack.snippets.push_back(std::move(s));
+        if (sink) {
+            sink->accept(pack.snippets.back());
+        }
     }
 
     struct Pending
     {
-        std::string rel_path;
-        std::string abs_path;
+        FileId file = kNoFile;
         std::string kind;
         size_t start = 0;
         size_t end = 0;
     };
 
+    IdentLookup ident;
+    bool use_index = bind_ident_index(index, req, files, &ident);
+
+    TypeLookup types;
+    bool use_types = bind_type_index(index, req, files, &types);
+    std::string typed_src;
+    FileId typed_loaded = kNoFile;
+
+    // receiver types resolved through the locator, by fqcn
+    std::unordered_map<std::string, ClassLocation> located;
+
+    // without identifiers, trigrams and Bloom filters can still narrow rg's file list
+    ScanOptions scan_opt;
+    std::unique_ptr<IndexedSearcher> searcher;
+    if (!use_index && index && (index->has_trigrams || index->has_blooms)) {
+        searcher = std::make_unique<IndexedSearcher>(*index, files, scan_opt);
+    }
+
     std::vector<Pending> frontier;
-    frontier.push_back(Pending{loc.rel_path, loc.abs_path, "method_declaration", anchor.start, anchor.end});
+    frontier.push_back(Pending{loc.file_id, "method_declaration", anchor.start, anchor.end});
 
     std::unordered_set<std::string> seen_snips;
     seen_snips.reserve(512);
 
+    if (opt.max_callers > 0 && !past_deadline(deadline, &pack.stats)) {
+        add_callers(req, opt, files, index, loc, anchor, deadline, tc, &seen_snips, &emitted, sink, &pack);
+    }
+
     // Prevent re-expanding the exact same symbol at the same hop too much.
     std::unordered_set<std::string> seen_symbols;
     seen_symbols.reserve(512);
 
     for (int hop = 0; hop < opt.max_hops; hop++) {
-        if (pack.stats.snippets_written >= opt.max_snippets || pack.stats.bytes_written >= opt.max_bytes) {
+        if (pack_full(opt, pack.stats) || past_deadline(deadline, &pack.stats)) {
             break;
         }
 
         std::vector<Pending> next_frontier;
 
         for (const Pending &p : frontier) {
-            if (pack.stats.snippets_written >= opt.max_snippets || pack.stats.bytes_written >= opt.max_bytes) {
+            if (pack_full(opt, pack.stats) || past_deadline(deadline, &pack.stats)) {
                 break;
             }
 
@@ -137,21 +695,23 @@ ContextPack build_context_pack(const ContextRequest &req,
                 continue;
             }
 
-            std::vector<std::string> callees = harvest_callees_in_range(p.abs_path, p.start, p.end);
+            CallHarvest harvest = harvest_calls_in_range(files.abs_path(p.file), p.start, p.end);
+            std::vector<CalleeRef> &callees = harvest.callees;
 
             if (static_cast<int>(callees.size()) > opt.max_symbols_per_method) {
                 callees.resize(static_cast<size_t>(opt.max_symbols_per_method));
             }
 
-            for (const std::string &sym : callees) {
-                if (pack.stats.snippets_written >= opt.max_snippets || pack.stats.bytes_written >= opt.max_bytes) {
+            for (const CalleeRef &callee : callees) {
+                const std::string &sym = callee.name;
+                if (pack_full(opt, pack.stats) || past_deadline(deadline, &pack.stats)) {
                     break;
                 }
 
                 pack.stats.symbols_seen += 1;
 
                 // Avoid exploding on repeated symbols.
-                std::string sym_key = std::to_string(hop) + ":" + sym;
+                std::string sym_key = std::to_string(hop) + ":" + callee.receiver_type + ":" + sym;
                 if (!seen_symbols.insert(sym_key).second) {
                     continue;
                 }
@@ -161,15 +721,70 @@ ContextPack build_context_pack(const ContextRequest &req,
                 q.fixed_string = false;
                 q.globs = req.globs;
                 q.excludes = req.excludes;
-
-                pack.stats.rg_queries += 1;
-
-                RgResult rr = rg_search_json(req.repo_root, q);
-                if (rr.exit_code == 2) {
-                    continue;
+                q.deadline = deadline;
+
+                RgResult rr;
+                std::vector<TypedDecl> typed;
+                bool narrowed = false;
+                if (!callee.receiver_type.empty()) {
+                    pack.stats.receivers_typed += 1;
+                    narrowed = narrow_by_receiver(callee, harvest.imports, use_types ? &types : nullptr,
+                                                  *locator, &located, files, req, q, &typed, &rr, &pack.stats);
+                }
+                if (!narrowed && use_types) {
+                    type_hits_for_symbol(types, files, q, sym, kAnyType, &typed, &pack.stats.impl_jumps);
+                }
+                if (narrowed) {
+                    pack.stats.narrowed_lookups += 1;
+                } else if (!typed.empty()) {
+                    pack.stats.type_lookups += 1;
+                    if (!types.stale_paths.empty()) {
+                        q.paths = types.stale_paths;
+                        pack.stats.rg_queries += 1;
+                        rr = rg_search_json(req.repo_root, q, &files);
+                        note_rg(rr, &pack.stats);
+                        if (rr.exit_code == 2) {
+                            rr.hits.clear();
+                        }
+                        pack.stats.rg_hits_total += static_cast<int>(rr.hits.size());
+                    }
+                } else if (use_index) {
+                    pack.stats.index_lookups += 1;
+                    index_hits_for_symbol(ident, files, q, sym, &rr.hits);
+                    pack.stats.index_hits_total += static_cast<int>(rr.hits.size());
+
+                    // files edited since indexing: the index can't vouch for them
+                    if (!ident.stale_paths.empty()) {
+                        q.paths = ident.stale_paths;
+                        pack.stats.rg_queries += 1;
+                        RgResult fresh = rg_search_json(req.repo_root, q, &files);
+                        note_rg(fresh, &pack.stats);
+                        if (fresh.exit_code != 2) {
+                            pack.stats.rg_hits_total += static_cast<int>(fresh.hits.size());
+                            for (RgHit &h : fresh.hits) {
+                                rr.hits.push_back(std::move(h));
+                            }
+                        }
+                    }
+                } else if (searcher) {
+                    IndexedSearchStats ist;
+                    pack.stats.rg_queries += 1;
+                    rr = searcher->search(req.repo_root, q, &ist);
+                    note_rg(rr, &pack.stats);
+                    pack.stats.bloom_skipped_files += static_cast<int>(ist.bloom_skipped);
+                    if (rr.exit_code == 2) {
+                        continue;
+                    }
+                    pack.stats.rg_hits_total += static_cast<int>(rr.hits.size());
+                } else {
+                    pack.stats.rg_queries += 1;
+                    rr = rg_search_json(req.repo_root, q, &files);
+                    note_rg(rr, &pack.stats);
+                    if (rr.exit_code == 2) {
+                        continue;
+                    }
+                    pack.stats.rg_hits_total += static_cast<int>(rr.hits.size());
                 }
-
-                pack.stats.rg_hits_total += static_cast<int>(rr.hits.size());
 
                 size_t take = rr.hits.size();
                 if (take > static_cast<size_t>(opt.max_rg_hits_per_symbol)) {
@@ -178,6 +793,7 @@ ContextPack build_context_pack(const ContextRequest &req,
 
                 struct Cand
                 {
+                    FileId file = kNoFile;
                     HitSnippet snip;
                     int score = 0;
                 };
@@ -187,22 +803,59 @@ ContextPack build_context_pack(const ContextRequest &req,
 
                 for (size_t i = 0; i < take; i++) {
                     const RgHit &h = rr.hits[i];
-                    HitSnippet sn = snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset);
+                    // outside the scanned workspace (excluded dir, oversized)
+                    if (h.file_id == kNoFile) {
+                        continue;
+                    }
+                    if (past_deadline(deadline, &pack.stats)) {
+                        break;
+                    }
+                    HitSnippet sn = snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset, opt.class_skeletons);
                     if (!sn.found) {
                         continue;
                     }
 
-                    std::string key = make_snip_key(sn);
+                    std::string key = make_snip_key(h.file_id, sn);
                     if (seen_snips.find(key) != seen_snips.end()) {
                         continue;
                     }
 
                     Cand c;
-                    c.score = score_snippet(loc.rel_path, sn);
+                    c.file = h.file_id;
+                    c.score = score_snippet(files, loc.file_id, h.file_id, sn);
                     c.snip = std::move(sn);
                     cands.push_back(std::move(c));
                 }
 
+                for (const TypedDecl &td : typed) {
+                    if (cands.size() >= static_cast<size_t>(opt.max_rg_hits_per_symbol)) {
+                        break;
+                    }
+                    Cand c;
+                    c.file = td.file;
+                    c.snip.found = true;
+                    c.snip.abs_path = files.abs_path(td.file);
+                    c.snip.rel_path = std::string(files.rel_path(td.file));
+                    c.snip.kind = "method_declaration";
+                    c.snip.start = td.start;
+                    c.snip.end = td.end;
+                    if (seen_snips.find(make_snip_key(c.file, c.snip)) != seen_snips.end()) {
+                        continue;
+                    }
+                    if (td.file != typed_loaded) {
+                        typed_loaded = td.file;
+                        if (!read_file_bytes(c.snip.abs_path, &typed_src)) {
+                            typed_src.clear();
+                        }
+                    }
+                    if (td.end > typed_src.size() || td.start >= td.end) {
+                        continue;
+                    }
+                    c.snip.text = typed_src.substr(td.start, td.end - td.start);
+                    c.score = score_snippet(files, loc.file_id, td.file, c.snip) + (td.impl ? 10 : 0);
+                    cands.push_back(std::move(c));
+                }
+
                 if (cands.empty()) {
                     continue;
                 }
@@ -218,13 +871,15 @@ ContextPack build_context_pack(const ContextRequest &req,
                     emit_count = 1;
                 }
 
-                for (int k = 0; k < emit_count && k < static_cast<int>(cands.size()); k++) {
-                    const Cand &best = cands[static_cast<size_t>(k)];
+                int emitted_here = 0;
+                for (size_t k = 0; k < cands.size() && emitted_here < emit_count; k++) {
+                    const Cand &best = cands[k];
 
-                    std::string key = make_snip_key(best.snip);
+                    std::string key = make_snip_key(best.file, best.snip);
                     seen_snips.insert(key);
 
                     ContextSnippet s;
+                    s.file_id = best.file;
                     s.rel_path = best.snip.rel_path;
                     s.abs_path = best.snip.abs_path;
                     s.kind = best.snip.kind;
@@ -234,27 +889,45 @@ ContextPack build_context_pack(const ContextRequest &req,
                     s.hop = hop + 1;
                     s.symbol = sym;
                     s.text = best.snip.text;
+                    s.skeleton = best.snip.skeleton;
 
-                    if (pack.stats.bytes_written + static_cast<int>(s.text.size()) > opt.max_bytes) {
+                    // a range already in the pack costs nothing; try the next candidate
+                    if (!s.skeleton &&
+                        !drop_emitted(emitted, best.file, best.snip.start, best.snip.end, &s.text, &pack.stats)) {
+                        continue;
+                    }
+                    if (!fits_budget(opt, tc, &s.text, &s.tokens, &pack.stats)) {
                         break;
                     }
+                    emitted_here += 1;
+                    if (!s.skeleton) {
+                        emitted.add(best.file, best.snip.start, best.snip.end);
+                    }
 
                     pack.snippets.push_back(std::move(s));
+                    if (sink) {
+                        sink->accept(pack.snippets.back());
+                    }
                     pack.stats.snippets_written += 1;
                     pack.stats.bytes_written += static_cast<int>(pack.snippets.back().text.size());
+                    pack.stats.tokens_written += pack.snippets.back().tokens;
+                    if (best.snip.skeleton) {
+                        pack.stats.skeletons += 1;
+                        pack.stats.skeleton_bytes_elided +=
+                            static_cast<int>(best.snip.end - best.snip.start - best.snip.text.size());
+                    }
 
                     // Expand further if this is a method/ctor.
                     if (best.snip.kind == "method_declaration" || best.snip.kind == "constructor_declaration") {
                         Pending np;
-                        np.rel_path = best.snip.rel_path;
-                        np.abs_path = best.snip.abs_path;
+                        np.file = best.file;
                         np.kind = best.snip.kind;
                         np.start = best.snip.start;
                         np.end = best.snip.end;
                         next_frontier.push_back(std::move(np));
                     }
 
-                    if (pack.stats.snippets_written >= opt.max_snippets || pack.stats.bytes_written >= opt.max_bytes) {
+                    if (pack_full(opt, pack.stats)) {
                         break;
                     }
                 }
@@ -272,3 +945,69 @@ ContextPack build_context_pack(const ContextRequest &req,
     return pack;
 }
 
+
+ContextPack build_context_pack(const ContextRequest &req,
+                               const ContextOptions &opt,
+                               const FileTable &files,
+                               const WorkspaceIndex *index,
+                               SnippetSink *sink)
+{
+    std::string cache_path;
+    std::string cache_state = "off";
+    if (!opt.pack_cache_dir.empty()) {
+        cache_path = pack_cache_path(opt.pack_cache_dir, req, opt, index);
+        ContextPack cached;
+        if (load_cached_pack(cache_path, files, &cached, &cache_state)) {
+            if (sink) {
+                for (const ContextSnippet &s : cached.snippets) {
+                    sink->accept(s);
+                }
+            }
+            return cached;
+        }
+    }
+
+    ParseBudget budget;
+    budget.per_parse_us = static_cast<uint64_t>(std::max(opt.parse_timeout_ms, 0)) * 1000;
+    budget.total_us = static_cast<uint64_t>(std::max(opt.parse_budget_ms, 0)) * 1000;
+    budget.max_file_bytes = static_cast<uint64_t>(std::max(opt.max_parse_bytes, 0));
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point deadline = clock::time_point::max();
+    if (opt.deadline_ms > 0) {
+        deadline = clock::now() + std::chrono::milliseconds(opt.deadline_ms);
+        // parsing can't run past the deadline either
+        uint64_t cap = static_cast<uint64_t>(opt.deadline_ms) * 1000;
+        if (budget.total_us == 0 || budget.total_us > cap) {
+            budget.total_us = cap;
+        }
+    }
+
+    ParseBudget *prev = parse_budget();
+    set_parse_budget(&budget);
+    ContextPack pack = build_pack(req, opt, files, index, deadline, sink);
+    set_parse_budget(prev);
+
+    ContextStats &st = pack.stats;
+    st.parses = static_cast<int>(budget.parses);
+    st.parse_ms = static_cast<int>(budget.spent_us / 1000);
+    st.parse_timeouts = static_cast<int>(budget.timed_out);
+    st.parse_skipped = static_cast<int>(budget.skipped_size + budget.skipped_exhausted);
+    st.lexer_fallbacks = static_cast<int>(budget.lexer_fallbacks);
+    for (const std::string &abs : budget.refused) {
+        std::string_view rel;
+        st.over_budget_files.push_back(files.rel_of(abs, &rel) ? std::string(rel) : abs);
+    }
+    std::sort(st.over_budget_files.begin(), st.over_budget_files.end());
+
+    st.pack_cache = cache_state;
+    // a pack cut short by time or by the parse budget would come out
+    // differently next run
+    bool complete = !st.truncated_by_deadline && st.parse_timeouts == 0 && st.rg_killed == 0 &&
+                    st.parse_skipped == 0 && st.lexer_fallbacks == 0;
+    if (!cache_path.empty() && complete && !pack.snippets.empty()) {
+        std::string err;
+        store_cached_pack(cache_path, files, pack, &err);
+    }
+    return pack;
+}
@@ -6,10 +6,12 @@
 #include <vector>
 
 #include "workspace/scanner.h"
+#include "workspace/workspace_index.h"
 
 
 struct ContextSnippet
 {
+    FileId file_id = kNoFile;
     std::string rel_path;
     std::string abs_path;
 
@@ -22,6 +24,8 @@ struct ContextSnippet
 
     std::string symbol; // which symbol caused this snippet (callee name)
     std::string text;
+    int tokens = 0;     // estimated model tokens of text
+    bool skeleton = false;   // class with elided member bodies (see HitSnippet)
 };
 
 struct ContextStats
@@ -29,10 +33,50 @@ struct ContextStats
     int hops_used = 0;
     int snippets_written = 0;
     int bytes_written = 0;
+    int tokens_written = 0;
+    int token_budget_skips = 0;    // snippets left out because max_tokens would overflow
+    // snippet bytes before and after compaction, for the snippets written
+    int bytes_before_compaction = 0;
+    int bytes_after_compaction = 0;
+    int skeletons = 0;               // class skeletons written
+    int skeleton_bytes_elided = 0;   // class bytes they left out
+    // snippets dropped because their range was already written, snippets
+    // written without the parts that were, and the bytes that saved
+    int overlap_suppressed = 0;
+    int overlap_trimmed = 0;
+    int overlap_bytes_saved = 0;
+    std::string token_counter;     // "bpe" with a vocabulary, else "heuristic"
 
     int symbols_seen = 0;
     int rg_queries = 0;
     int rg_hits_total = 0;
+
+    int index_lookups = 0;     // callee lookups answered by the identifier index
+    int index_hits_total = 0;
+    int bloom_skipped_files = 0;   // files a Bloom filter kept from being read or searched
+
+    int type_lookups = 0;          // callees resolved to declarations by the type index
+    int impl_jumps = 0;            // interface/abstract methods replaced by implementations
+
+    int receivers_typed = 0;       // callees whose receiver type was inferred
+    int narrowed_lookups = 0;      // of those, answered from the receiver's own type
+
+    int callers_found = 0;         // distinct declarations calling the anchor method
+    int callers_written = 0;
+
+    int parses = 0;                // tree-sitter parses run (cache hits not counted)
+    int parse_ms = 0;
+    int parse_timeouts = 0;
+    int parse_skipped = 0;         // refused: too big, or the run's budget was spent
+    int lexer_fallbacks = 0;       // over-budget files handled by the lexer instead
+    std::vector<std::string> over_budget_files;   // rel paths
+
+    bool truncated_by_deadline = false;   // stopped early; the pack is what was gathered by then
+    int rg_killed = 0;
+
+    std::string pack_cache = "off";   // off, hit, or why it missed: miss, stale, corrupt
+    int pack_cache_files = 0;         // files checked on a hit
+    int pack_cache_rehashed = 0;      // of those, hashed because their mtime moved
 };
 
 struct ContextRequest
@@ -52,21 +96,67 @@ struct ContextOptions
     int max_hops = 2;
     int max_snippets = 20;
     int max_bytes = 120000;
+    // model tokens for all snippets, 0 for no limit; counted with
+    // token_vocab (see TokenCounter) or, without one, a heuristic
+    int max_tokens = 0;
+    std::string token_vocab;
 
     int max_symbols_per_method = 12;
     int max_rg_hits_per_symbol = 6;
     int max_snippets_per_symbol = 1;
 
+    // methods calling the anchor, best scored first; 0 leaves them out
+    int max_callers = 0;
+
     bool include_anchor_in_snippets = true;
+
+    // drop comments and blank lines and collapse indentation in snippet text
+    // before it is counted against the budgets (see compact_java)
+    bool compact_snippets = false;
+    bool strip_annotations = false;   // with compact_snippets
+
+    // hits outside any method yield a class skeleton instead of the whole class
+    bool class_skeletons = true;
+
+    // tree-sitter limits for the run, 0 for none (see ParseBudget). Files over
+    // them are skipped as snippet sources; the anchor falls back to the lexer.
+    int parse_timeout_ms = 2000;
+    int parse_budget_ms = 30000;
+    int max_parse_bytes = 0;
+
+    // wall-clock limit for the whole build, 0 for none; checked between
+    // stages, and in-flight rg runs are killed when it passes
+    int deadline_ms = 0;
+
+    // reuse packs saved under <pack_cache_dir>/packs while the files they
+    // came from are unchanged (see pack_cache.h); empty for no cache
+    std::string pack_cache_dir;
 };
 
 struct ContextPack
 {
+    FileId anchor_file = kNoFile;
     std::vector<ContextSnippet> snippets;
     ContextStats stats;
 };
 
+// Receives each snippet as soon as the builder accepts it, in pack order, so
+// output can be written while the rest of the pack is still being built.
+class SnippetSink
+{
+public:
+    virtual ~SnippetSink() = default;
+    virtual void accept(const ContextSnippet &s) = 0;
+};
+
+// With a type index, callees resolve straight to method declarations, and
+// interface/abstract ones to their implementations. Otherwise, with an
+// identifier index, callees are looked up by declaration (else call
+// site) instead of a repo-wide rg; files changed since indexing still go
+// through rg, restricted to just those files.
 ContextPack build_context_pack(const ContextRequest &req,
                                const ContextOptions &opt,
-                               const std::vector<FileEntry> &files);
+                               const FileTable &files,
+                               const WorkspaceIndex *index = nullptr,
+                               SnippetSink *sink = nullptr);
 
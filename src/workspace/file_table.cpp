@@ -0,0 +1,274 @@
+
+#include "workspace/file_table.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+static uint64_t hash_path(std::string_view s)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ull;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+// Offset of "<seg>/" when it is a whole path segment of rel, else npos.
+static size_t find_segment(std::string_view rel, std::string_view seg)
+{
+    size_t pos = 0;
+    while ((pos = rel.find(seg, pos)) != std::string_view::npos) {
+        bool starts = (pos == 0 || rel[pos - 1] == '/');
+        bool ends = (pos + seg.size() < rel.size() && rel[pos + seg.size()] == '/');
+        if (starts && ends) {
+            return pos;
+        }
+        pos += 1;
+    }
+    return std::string_view::npos;
+}
+
+
+static std::string_view trim_slash(std::string_view s)
+{
+    while (!s.empty() && s.back() == '/') {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+
+FileTable::FileTable(const std::string &root_abs)
+    : root_(root_abs)
+{
+    while (root_.size() > 1 && root_.back() == '/') {
+        root_.pop_back();
+    }
+}
+
+
+void FileTable::reserve(size_t n, size_t path_bytes)
+{
+    path_off_.reserve(n);
+    path_len_.reserve(n);
+    size_.reserve(n);
+    mtime_.reserve(n);
+    flags_.reserve(n);
+    dir_.reserve(n);
+    module_.reserve(n);
+    arena_.reserve(path_bytes);
+}
+
+
+FileId FileTable::lookup(std::string_view rel) const
+{
+    if (slots_.empty()) {
+        return kNoFile;
+    }
+    size_t mask = slots_.size() - 1;
+    size_t i = static_cast<size_t>(hash_path(rel)) & mask;
+    for (;;) {
+        FileId id = slots_[i];
+        if (id == kNoFile) {
+            return kNoFile;
+        }
+        if (rel_path(id) == rel) {
+            return id;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+
+void FileTable::index_insert(FileId id)
+{
+    size_t mask = slots_.size() - 1;
+    size_t i = static_cast<size_t>(hash_path(rel_path(id))) & mask;
+    while (slots_[i] != kNoFile) {
+        i = (i + 1) & mask;
+    }
+    slots_[i] = id;
+}
+
+
+void FileTable::rehash(size_t nslots)
+{
+    slots_.assign(nslots, kNoFile);
+    for (FileId id = 0; id < size(); id++) {
+        index_insert(id);
+    }
+}
+
+
+FileId FileTable::add(std::string_view rel_path_in, uint64_t size_bytes, int64_t mtime)
+{
+    FileId id = lookup(rel_path_in);
+    if (id != kNoFile) {
+        if (flags_[id] & FF_REMOVED) {
+            flags_[id] &= ~FF_REMOVED;
+            live_ += 1;
+        }
+        size_[id] = size_bytes;
+        mtime_[id] = mtime;
+        return id;
+    }
+
+    id = static_cast<FileId>(size());
+    path_off_.push_back(static_cast<uint32_t>(arena_.size()));
+    path_len_.push_back(static_cast<uint32_t>(rel_path_in.size()));
+    arena_.append(rel_path_in.data(), rel_path_in.size());
+    size_.push_back(size_bytes);
+    mtime_.push_back(mtime);
+    flags_.push_back(0);
+    dir_.push_back(0);
+    module_.push_back(0);
+    classify(id);
+    live_ += 1;
+
+    // keep load factor <= 1/2
+    if ((size() * 2) > slots_.size()) {
+        rehash(std::max<size_t>(64, slots_.size() * 2));
+    } else {
+        index_insert(id);
+    }
+    return id;
+}
+
+
+uint32_t FileTable::intern_dir(std::string_view dir)
+{
+    auto it = dir_index_.find(std::string(dir));
+    if (it != dir_index_.end()) {
+        return it->second;
+    }
+    uint32_t d = static_cast<uint32_t>(dir_names_.size());
+    dir_names_.emplace_back(dir);
+    dir_index_.emplace(dir_names_.back(), d);
+    return d;
+}
+
+
+// Done once per path so scorers only test bits and compare ids.
+void FileTable::classify(FileId id)
+{
+    std::string_view rel = rel_path(id);
+    uint32_t f = 0;
+
+    size_t main_pos = find_segment(rel, "src/main/java");
+    size_t test_pos = find_segment(rel, "src/test/java");
+    if (main_pos != std::string_view::npos) {
+        f |= FF_MAIN_SRC;
+    } else if (test_pos != std::string_view::npos) {
+        f |= FF_TEST_SRC;
+    }
+
+    // target/ and build/ only count ahead of the source root, not as package names
+    size_t src_pos = find_segment(rel, "src");
+    size_t target_pos = find_segment(rel, "target");
+    size_t build_pos = find_segment(rel, "build");
+    if (target_pos > src_pos) target_pos = std::string_view::npos;
+    if (build_pos > src_pos) build_pos = std::string_view::npos;
+    if (target_pos != std::string_view::npos || build_pos != std::string_view::npos) {
+        f |= FF_BUILD_OUTPUT;
+    }
+    if (find_segment(rel, "generated") != std::string_view::npos ||
+        find_segment(rel, "generated-sources") != std::string_view::npos ||
+        find_segment(rel, "generated-test-sources") != std::string_view::npos) {
+        f |= FF_GENERATED;
+    }
+
+    // module root: whatever precedes the first src/, target/ or build/ segment
+    size_t mod_end = std::min({src_pos, target_pos, build_pos});
+    std::string_view module = (mod_end == std::string_view::npos) ? std::string_view{} : rel.substr(0, mod_end);
+
+    size_t slash = rel.rfind('/');
+    std::string_view dir = (slash == std::string_view::npos) ? std::string_view{} : rel.substr(0, slash);
+
+    flags_[id] = (flags_[id] & FF_REMOVED) | f;
+    dir_[id] = intern_dir(dir);
+    module_[id] = intern_dir(trim_slash(module));
+}
+
+
+bool FileTable::remove(FileId id)
+{
+    if (!alive(id)) {
+        return false;
+    }
+    flags_[id] |= FF_REMOVED;
+    live_ -= 1;
+    return true;
+}
+
+
+std::string FileTable::abs_path(FileId id) const
+{
+    std::string_view rel = rel_path(id);
+    std::string out;
+    out.reserve(root_.size() + 1 + rel.size());
+    out += root_;
+    out += '/';
+    out.append(rel.data(), rel.size());
+    return out;
+}
+
+
+FileId FileTable::find_rel(std::string_view rel) const
+{
+    FileId id = lookup(rel);
+    return (id != kNoFile && alive(id)) ? id : kNoFile;
+}
+
+
+bool FileTable::rel_of(std::string_view abs, std::string_view *rel) const
+{
+    if (abs.size() <= root_.size() + 1 ||
+        abs.compare(0, root_.size(), root_) != 0 ||
+        abs[root_.size()] != '/') {
+        return false;
+    }
+    *rel = abs.substr(root_.size() + 1);
+    return true;
+}
+
+
+FileId FileTable::find_abs(std::string_view abs) const
+{
+    std::string_view rel;
+    if (!rel_of(abs, &rel)) {
+        return kNoFile;
+    }
+    return find_rel(rel);
+}
+
+
+void FileTable::sort_by_path()
+{
+    std::vector<FileId> order;
+    order.reserve(live_);
+    for (FileId id = 0; id < size(); id++) {
+        if (alive(id)) {
+            order.push_back(id);
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [this](FileId a, FileId b) { return rel_path(a) < rel_path(b); });
+
+    FileTable t(root_);
+    size_t bytes = 0;
+    for (FileId id : order) {
+        bytes += path_len_[id];
+    }
+    t.reserve(order.size(), bytes);
+    for (FileId id : order) {
+        FileId nid = t.add(rel_path(id), size_[id], mtime_[id]);
+        t.flags_[nid] = flags_[id];
+    }
+    *this = std::move(t);
+}
@@ -0,0 +1,103 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+using FileId = uint32_t;
+
+static constexpr FileId kNoFile = 0xffffffffu;
+
+// per-file flag bits; the path classes are derived from the rel path on insert
+enum FileFlags : uint32_t
+{
+    FF_MAIN_SRC     = 1u << 0,   // .../src/main/java/...
+    FF_TEST_SRC     = 1u << 1,   // .../src/test/java/...
+    FF_GENERATED    = 1u << 2,   // generated/, generated-sources/, ...
+    FF_BUILD_OUTPUT = 1u << 3,   // .../target/..., .../build/...
+
+    FF_REMOVED      = 1u << 31
+};
+
+
+// Workspace file list as a struct of arrays. Relative paths are interned back
+// to back in one arena; the absolute path is always root + "/" + rel and is
+// only materialized on request. Ids are dense and stable for the table's
+// lifetime (removal leaves a tombstone; re-adding a path revives its id).
+class FileTable
+{
+public:
+    FileTable() = default;
+    explicit FileTable(const std::string &root_abs);
+
+    const std::string &root() const { return root_; }
+
+    // ids ever assigned, including removed ones; iterate 0..size() and skip !alive()
+    size_t size() const { return path_off_.size(); }
+    size_t live_count() const { return live_; }
+    size_t arena_bytes() const { return arena_.size(); }
+
+    // Insert, or update size/mtime of an existing path (reviving it if removed).
+    FileId add(std::string_view rel_path, uint64_t size_bytes, int64_t mtime);
+    bool remove(FileId id);
+
+    bool alive(FileId id) const { return id < size() && !(flags_[id] & FF_REMOVED); }
+
+    std::string_view rel_path(FileId id) const
+    {
+        return std::string_view(arena_.data() + path_off_[id], path_len_[id]);
+    }
+    std::string abs_path(FileId id) const;
+    uint64_t size_bytes(FileId id) const { return size_[id]; }
+    int64_t mtime(FileId id) const { return mtime_[id]; }
+    uint32_t flags(FileId id) const { return flags_[id]; }
+
+    // Interned directory ids. dir_id is the file's parent directory (its
+    // package dir for Java sources); module_id is the directory that holds
+    // the module's src/ (or target/, build/), "" for a root-level module.
+    uint32_t dir_id(FileId id) const { return dir_[id]; }
+    uint32_t module_id(FileId id) const { return module_[id]; }
+    const std::string &dir_name(uint32_t dir) const { return dir_names_[dir]; }
+
+    // kNoFile if unknown or removed
+    FileId find_rel(std::string_view rel) const;
+    FileId find_abs(std::string_view abs) const;
+
+    // rel part of abs if it lies under root, else false
+    bool rel_of(std::string_view abs, std::string_view *rel) const;
+
+    // Renumber live files in path order and drop tombstones; invalidates ids.
+    void sort_by_path();
+
+    void reserve(size_t n, size_t path_bytes);
+
+private:
+    FileId lookup(std::string_view rel) const;
+    void index_insert(FileId id);
+    void rehash(size_t nslots);
+    uint32_t intern_dir(std::string_view dir);
+    void classify(FileId id);
+
+    std::string root_;   // absolute, no trailing '/'
+    std::string arena_;
+
+    std::vector<uint32_t> path_off_;
+    std::vector<uint32_t> path_len_;
+    std::vector<uint64_t> size_;
+    std::vector<int64_t>  mtime_;
+    std::vector<uint32_t> flags_;
+    std::vector<uint32_t> dir_;
+    std::vector<uint32_t> module_;
+
+    std::vector<std::string> dir_names_;
+    std::unordered_map<std::string, uint32_t> dir_index_;
+
+    // open addressing over ids, keyed by rel path hash
+    std::vector<FileId> slots_;
+    size_t live_ = 0;
+};
@@ -0,0 +1,137 @@
+
+#include "workspace/index_io.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sys/fd.h"
+#include "sys/io.h"
+
+
+namespace fs = std::filesystem;
+
+
+static constexpr uint64_t kUnusableSize = ~0ull;
+
+
+std::string default_index_dir(const std::string &repo_root)
+{
+    std::string dir = repo_root;
+    while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+    }
+    return dir + "/.codegencli";
+}
+
+
+bool read_file_bytes(const std::string &path, std::string *out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    Fd f(fd);
+
+    out->clear();
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (r == 0) break;
+        out->append(buf, static_cast<size_t>(r));
+    }
+    return true;
+}
+
+
+bool write_file_atomic(const std::string &path, const std::string &bytes, std::string *error)
+{
+    std::error_code ec;
+    fs::path parent = fs::path(path).parent_path();
+    if (!parent.empty()) {
+        fs::create_directories(parent, ec);
+    }
+
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        *error = "open(" + tmp + "): " + std::strerror(errno);
+        return false;
+    }
+    {
+        Fd f(fd);
+        if (write_all(f.get(), bytes.data(), bytes.size()) < 0) {
+            *error = "write(" + tmp + "): " + std::strerror(errno);
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) < 0) {
+        *error = "rename(" + path + "): " + std::strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+void IndexFileList::append(const FileTable &files, FileId id, bool usable,
+                           std::string *records, std::string *paths)
+{
+    std::string_view rel = files.rel_path(id);
+    index_store<uint64_t>(records, usable ? files.size_bytes(id) : kUnusableSize);
+    index_store<int64_t>(records, files.mtime(id));
+    index_store<uint32_t>(records, static_cast<uint32_t>(paths->size()));
+    index_store<uint32_t>(records, static_cast<uint32_t>(rel.size()));
+    paths->append(rel.data(), rel.size());
+}
+
+
+std::string_view IndexFileList::rel_path(uint32_t i) const
+{
+    const unsigned char *r = records_ + static_cast<size_t>(i) * kRecordSize;
+    uint32_t off = index_load<uint32_t>(r + 16);
+    uint32_t len = index_load<uint32_t>(r + 20);
+    return std::string_view(reinterpret_cast<const char *>(paths_) + off, len);
+}
+
+
+bool IndexFileList::usable(uint32_t i) const
+{
+    return size_bytes(i) != kUnusableSize;
+}
+
+
+void IndexFileList::resolve(const FileTable &files,
+                            std::vector<FileId> *to_table,
+                            std::vector<FileId> *stale) const
+{
+    to_table->assign(count_, kNoFile);
+    stale->clear();
+
+    std::vector<bool> covered(files.size(), false);
+    for (uint32_t i = 0; i < count_; i++) {
+        FileId id = files.find_rel(rel_path(i));
+        if (id != kNoFile && size_bytes(i) == files.size_bytes(id) && mtime(i) == files.mtime(id)) {
+            (*to_table)[i] = id;
+            covered[id] = true;
+        }
+    }
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (files.alive(id) && !covered[id]) {
+            stale->push_back(id);
+        }
+    }
+}
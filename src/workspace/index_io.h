@@ -0,0 +1,122 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/file_table.h"
+
+
+// Helpers shared by the on-disk index files. Everything is host byte order:
+// indexes are local caches rebuilt by the index command, not an exchange format.
+
+template <typename T>
+inline T index_load(const unsigned char *p)
+{
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+template <typename T>
+inline void index_store(std::string *out, T v)
+{
+    out->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+
+template <typename T>
+inline void index_store_at(std::string *out, size_t off, T v)
+{
+    std::memcpy(&(*out)[off], &v, sizeof(v));
+}
+
+
+inline void index_pad8(std::string *out)
+{
+    while (out->size() % 8) {
+        out->push_back('\0');
+    }
+}
+
+
+inline void put_varint(std::vector<uint8_t> *out, uint32_t v)
+{
+    while (v >= 0x80) {
+        out->push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(v));
+}
+
+
+// nullptr on truncated input
+inline const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint32_t *v)
+{
+    uint32_t x = 0;
+    int shift = 0;
+    while (p < end && shift <= 28) {
+        unsigned char b = *p++;
+        x |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return p;
+        }
+        shift += 7;
+    }
+    return nullptr;
+}
+
+
+// Where the index command writes its files: <repo_root>/.codegencli
+std::string default_index_dir(const std::string &repo_root);
+
+bool read_file_bytes(const std::string &path, std::string *out);
+
+// Write to path.tmp and rename over path, creating the parent directory.
+bool write_file_atomic(const std::string &path, const std::string &bytes, std::string *error);
+
+
+// The per-file section every index starts with: { u64 size, i64 mtime,
+// u32 path_off, u32 path_len } records plus a blob of rel paths. Index-local
+// file ids are positions in this list.
+class IndexFileList
+{
+public:
+    static constexpr size_t kRecordSize = 24;
+
+    // Append a record for a live table file; unusable ones never match on resolve.
+    static void append(const FileTable &files, FileId id, bool usable,
+                       std::string *records, std::string *paths);
+
+    void init(const unsigned char *records, const unsigned char *paths, uint32_t count)
+    {
+        records_ = records;
+        paths_ = paths;
+        count_ = count;
+    }
+
+    uint32_t count() const { return count_; }
+    std::string_view rel_path(uint32_t i) const;
+    uint64_t size_bytes(uint32_t i) const { return index_load<uint64_t>(records_ + i * kRecordSize); }
+    int64_t mtime(uint32_t i) const { return index_load<int64_t>(records_ + i * kRecordSize + 8); }
+    // false if the file failed to read or parse at index time; mtime is still recorded
+    bool usable(uint32_t i) const;
+
+    // to_table[i] is the table id of index file i when its size and mtime
+    // still match, kNoFile otherwise. stale gets every live table file the
+    // index can't vouch for (new, changed, or unreadable at index time).
+    void resolve(const FileTable &files,
+                 std::vector<FileId> *to_table,
+                 std::vector<FileId> *stale) const;
+
+private:
+    const unsigned char *records_ = nullptr;
+    const unsigned char *paths_ = nullptr;
+    uint32_t count_ = 0;
+};
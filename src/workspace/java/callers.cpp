@@ -0,0 +1,154 @@
+
+#include "workspace/java/callers.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "workspace/java/snippet_from_hit.h"
+#include "workspace/regex_literals.h"
+#include "workspace/search_indexed.h"
+
+
+// Name of a method/constructor declaration: the first identifier followed by
+// '(' that isn't an annotation. Sets *at to its offset in text.
+static std::string declared_name(const std::string &text, size_t *at)
+{
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!is_ident_byte(static_cast<unsigned char>(text[i]))) {
+            i++;
+            continue;
+        }
+        size_t a = i;
+        while (i < text.size() && is_ident_byte(static_cast<unsigned char>(text[i]))) {
+            i++;
+        }
+        size_t j = i;
+        while (j < text.size() && (text[j] == ' ' || text[j] == '\t' || text[j] == '\n' || text[j] == '\r')) {
+            j++;
+        }
+        bool annotation = a > 0 && text[a - 1] == '@';
+        if (j < text.size() && text[j] == '(' && !annotation) {
+            *at = a;
+            return text.substr(a, i - a);
+        }
+    }
+    return std::string();
+}
+
+
+// keep: table ids whose hits count; null keeps every hit.
+static void rg_callers(const std::string &repo_root,
+                       const FileTable &files,
+                       const RgQuery &scope,
+                       const std::string &method,
+                       const std::vector<bool> *keep,
+                       std::vector<CallerSite> *out,
+                       CallerStats *st)
+{
+    RgQuery q = scope;
+    q.pattern = regex_token(method) + "\\s*\\(";
+    q.fixed_string = false;
+
+    RgResult rr = rg_search_json(repo_root, q, &files);
+    if (!rr.killed_at_deadline && rr.exit_code != 0 && rr.exit_code != 1) {
+        st->rg_failed = true;
+        return;
+    }
+
+    for (const RgHit &h : rr.hits) {
+        if (h.file_id == kNoFile || (keep && !(*keep)[h.file_id])) {
+            continue;
+        }
+        st->rg_hits += 1;
+        HitSnippet sn = snippet_from_hit(h.abs_path, h.rel_path, h.match_byte_offset);
+        if (!sn.found || (sn.kind != "method_declaration" && sn.kind != "constructor_declaration")) {
+            continue;
+        }
+        size_t name_at = 0;
+        std::string name = declared_name(sn.text, &name_at);
+        // the declaration of method itself, not a call
+        if (sn.start + name_at == h.match_byte_offset) {
+            continue;
+        }
+        CallerSite c;
+        c.file = h.file_id;
+        c.call_offset = h.match_byte_offset;
+        c.caller_start = sn.start;
+        c.caller_end = sn.end;
+        c.caller_name = std::move(name);
+        out->push_back(std::move(c));
+    }
+}
+
+
+void find_callers(const std::string &repo_root,
+                  const FileTable &files,
+                  const IdentIndex *idents,
+                  const RgQuery &q,
+                  const std::string &method,
+                  std::vector<CallerSite> *out,
+                  CallerStats *stats)
+{
+    CallerStats local;
+    CallerStats *st = stats ? stats : &local;
+    *st = CallerStats{};
+    out->clear();
+
+    if (!idents) {
+        rg_callers(repo_root, files, q, method, nullptr, out, st);
+    } else {
+        std::vector<FileId> to_table;
+        std::vector<FileId> stale;
+        idents->files().resolve(files, &to_table, &stale);
+
+        std::vector<CallEdge> edges;
+        idents->callers(method, &edges);
+        for (const CallEdge &e : edges) {
+            FileId f = (e.file < to_table.size()) ? to_table[e.file] : kNoFile;
+            if (f == kNoFile || !rg_query_accepts(q, files.rel_path(f))) {
+                continue;
+            }
+            CallerSite c;
+            c.file = f;
+            c.call_offset = e.call_offset;
+            c.caller_start = e.caller_start;
+            c.caller_end = e.caller_end;
+            c.caller_name = std::string(e.caller_name);
+            c.from_index = true;
+            out->push_back(std::move(c));
+        }
+        st->index_edges = out->size();
+
+        RgQuery sq = q;
+        std::vector<bool> keep(files.size(), false);
+        for (FileId id : stale) {
+            if (rg_query_accepts(q, files.rel_path(id))) {
+                keep[id] = true;
+                st->stale_files += 1;
+            }
+        }
+        if (st->stale_files > kMaxStaleForIndex) {
+            // walk the scanned tree and keep only hits in the stale files
+            restrict_to_scan(ScanOptions(), &sq);
+            rg_callers(repo_root, files, sq, method, &keep, out, st);
+        } else if (st->stale_files > 0) {
+            for (FileId id : stale) {
+                if (keep[id]) {
+                    sq.paths.push_back(files.abs_path(id));
+                }
+            }
+            rg_callers(repo_root, files, sq, method, nullptr, out, st);
+        }
+    }
+
+    std::sort(out->begin(), out->end(),
+              [&files](const CallerSite &a, const CallerSite &b)
+              {
+                  if (a.file != b.file) {
+                      return files.rel_path(a.file) < files.rel_path(b.file);
+                  }
+                  return a.call_offset < b.call_offset;
+              });
+}
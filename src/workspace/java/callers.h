@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "workspace/file_table.h"
+#include "workspace/java/ident_index.h"
+#include "workspace/search_rg.h"
+
+
+// A method or constructor declaration that invokes some method by name.
+struct CallerSite
+{
+    FileId file = kNoFile;
+    uint64_t call_offset = 0;    // start of the invoked name
+    size_t caller_start = 0;     // enclosing declaration
+    size_t caller_end = 0;
+    std::string caller_name;
+    bool from_index = false;     // false: found by rg in a file the index can't vouch for
+};
+
+
+struct CallerStats
+{
+    size_t index_edges = 0;
+    size_t stale_files = 0;
+    size_t rg_hits = 0;
+    bool rg_failed = false;
+};
+
+
+// Call sites of method (by simple name) within q's globs/excludes, in
+// (path, offset) order. With idents, edges come from the index and only
+// files changed since indexing are searched with rg (by walking the tree
+// past kMaxStaleForIndex of them); without it, everything goes through rg
+// and each hit's enclosing declaration is parsed. rg_failed is set when rg
+// exits with anything but 0 or 1, e.g. 127 when it couldn't be started.
+void find_callers(const std::string &repo_root,
+                  const FileTable &files,
+                  const IdentIndex *idents,
+                  const RgQuery &q,
+                  const std::string &method,
+                  std::vector<CallerSite> *out,
+                  CallerStats *stats);
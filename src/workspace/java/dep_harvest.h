@@ -6,6 +6,40 @@
 #include <vector>
 
 
+struct CalleeRef
+{
+    std::string name;
+    std::string receiver;        // object expression text; empty for an unqualified call
+    std::string receiver_type;   // simple type name when it could be inferred, else empty
+};
+
+struct JavaImports
+{
+    std::string package;
+    std::vector<std::string> single;     // a.b.Foo
+    std::vector<std::string> wildcard;   // a.b, from import a.b.*
+};
+
+struct CallHarvest
+{
+    bool ok = false;
+    std::string enclosing_type;          // simple name of the type declaring the method
+    std::vector<CalleeRef> callees;      // one per (name, receiver_type), sorted by name
+    JavaImports imports;
+};
+
+// Callees of the method/constructor at node_start with their receivers.
+// Receiver types come from the method's parameters and locals, the
+// enclosing types' fields, or a capitalized name taken as a static call;
+// unqualified and this. calls get the enclosing type.
+CallHarvest harvest_calls_in_range(const std::string &abs_path,
+                                   size_t node_start,
+                                   size_t node_end);
+
+// Fully qualified names simple may refer to in a file with these imports,
+// most likely first: explicit import, same package, wildcard imports.
+std::vector<std::string> candidate_fqcns(const JavaImports &imports, const std::string &simple);
+
 // Extract method callee names inside a method/constructor node byte range.
 std::vector<std::string> harvest_callees_in_range(const std::string &abs_path,
                                                   size_t node_start,
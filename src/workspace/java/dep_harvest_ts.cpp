@@ -3,43 +3,16 @@
 
 #include <algorithm>
 #include <cstdint>
-#include <cstring>
-#include <fstream>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <tree_sitter/api.h>
 
-extern "C"
-{
-const TSLanguage *tree_sitter_java(void);
-}
-
-
-static bool read_entire_file(const std::string &path, std::string &out)
-{
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        return false;
-    }
-
-    in.seekg(0, std::ios::end);
-    std::streamoff n = in.tellg();
-    if (n < 0) {
-        return false;
-    }
-    in.seekg(0, std::ios::beg);
-
-    out.assign(static_cast<size_t>(n), '\0');
-    if (n == 0) {
-        return true;
-    }
-
-    in.read(out.data(), n);
-    return in.good() || in.eof();
-}
+#include "workspace/java/java_grammar.h"
+#include "workspace/java/parse_cache.h"
 
 
 static std::string_view node_text_view(const std::string &src, TSNode n)
@@ -53,21 +26,14 @@ static std::string_view node_text_view(const std::string &src, TSNode n)
 }
 
 
-static bool node_type_is(TSNode n, const char *type)
-{
-    const char *t = ts_node_type(n);
-    return t && std::strcmp(t, type) == 0;
-}
-
-
-static TSNode find_invocation_name_node(TSNode node)
+static TSNode find_invocation_name_node(const JavaGrammar &g, TSNode node)
 {
     // example
     // in f() : a(x)
     // (method_invocation
     //   name: (identifier)        // "a"
     //   arguments: (argument_list (identifier)))  // "x"
-    TSNode name = ts_node_child_by_field_name(node, "name", 4);
+    TSNode name = ts_node_child_by_field_id(node, g.field_name);
     if (!ts_node_is_null(name)) {
         return name;
     }
@@ -80,7 +46,7 @@ static TSNode find_invocation_name_node(TSNode node)
     //   member: (identifier)             ; "println"
     //   arguments: (argument_list
     //               (string_literal)))
-    TSNode member = ts_node_child_by_field_name(node, "member", 6);
+    TSNode member = ts_node_child_by_field_id(node, g.field_member);
     if (!ts_node_is_null(member)) {
         return member;
     }
@@ -88,11 +54,7 @@ static TSNode find_invocation_name_node(TSNode node)
     uint32_t nchild = ts_node_named_child_count(node);
     for (uint32_t i = 0; i < nchild; i++) {
         TSNode c = ts_node_named_child(node, i);
-        const char *t = ts_node_type(c);
-        if (!t) {
-            continue;
-        }
-        if (std::strcmp(t, "identifier") == 0) {
+        if (ts_node_symbol(c) == g.identifier) {
             return c;
         }
     }
@@ -117,63 +79,42 @@ static bool is_noise_method(const std::string &name)
 }
 
 
+// Smallest node spanning node_start, climbed to its method/constructor; null if none.
+static TSNode find_callable(const JavaGrammar &g, TSNode root, size_t node_start)
+{
+    uint32_t b = static_cast<uint32_t>(node_start);
+    TSNode cur = ts_node_descendant_for_byte_range(root, b, b);
+    while (!ts_node_is_null(cur)) {
+        if (g.is(cur, JK_CALLABLE)) {
+            return cur;
+        }
+        cur = ts_node_parent(cur);
+    }
+    return TSNode{};
+}
+
+
 std::vector<std::string> harvest_callees_in_range(const std::string &abs_path,
                                                   size_t node_start,
                                                   size_t node_end)
 {
     std::vector<std::string> out;
 
-    std::string src;
-    if (!read_entire_file(abs_path, src)) {
+    ParsedFilePtr pf = parse_java_file(abs_path);
+    if (!pf->ok) {
         return out;
     }
+    const std::string &src = pf->src;
 
     if (node_start >= src.size() || node_end > src.size() || node_start >= node_end) {
         return out;
     }
 
-    TSParser *parser = ts_parser_new();
-    if (!parser) {
-        return out;
-    }
-
-    if (!ts_parser_set_language(parser, tree_sitter_java())) {
-        ts_parser_delete(parser);
-        return out;
-    }
-
-    TSTree *tree = ts_parser_parse_string(parser, nullptr, src.data(), static_cast<uint32_t>(src.size()));
-    if (!tree) {
-        ts_parser_delete(parser);
-        return out;
-    }
-
-    TSNode root = ts_tree_root_node(tree);
+    TSNode root = ts_tree_root_node(pf->tree);
+    const JavaGrammar &g = java_grammar();
 
-    // Locate the smallest node spanning the range start; climb to method/constructor.
-    uint32_t b = static_cast<uint32_t>(node_start);
-    TSNode leaf = ts_node_descendant_for_byte_range(root, b, b);
-    if (ts_node_is_null(leaf)) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
-        return out;
-    }
-
-    TSNode cur = leaf;
-    while (!ts_node_is_null(cur)) {
-        if (node_type_is(cur, "method_declaration") || node_type_is(cur, "constructor_declaration")) {
-            break;
-        }
-        TSNode p = ts_node_parent(cur);
-        if (ts_node_is_null(p)) {
-            break;
-        }
-        cur = p;
-    }
-
-    if (ts_node_is_null(cur) || !(node_type_is(cur, "method_declaration") || node_type_is(cur, "constructor_declaration"))) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
+    TSNode cur = find_callable(g, root, node_start);
+    if (ts_node_is_null(cur)) {
         return out;
     }
 
@@ -183,8 +124,8 @@ std::vector<std::string> harvest_callees_in_range(const std::string &abs_path,
     TSTreeCursor cursor = ts_tree_cursor_new(cur);
     for (;;) {
         TSNode n = ts_tree_cursor_current_node(&cursor);
-        if (node_type_is(n, "method_invocation")) {
-            TSNode name_node = find_invocation_name_node(n);
+        if (ts_node_symbol(n) == g.method_invocation) {
+            TSNode name_node = find_invocation_name_node(g, n);
             if (!ts_node_is_null(name_node)) {
                 std::string_view sv = node_text_view(src, name_node);
                 if (!sv.empty()) {
@@ -220,11 +161,237 @@ std::vector<std::string> harvest_callees_in_range(const std::string &abs_path,
     }
 
     ts_tree_cursor_delete(&cursor);
-    ts_tree_delete(tree);
-    ts_parser_delete(parser);
 
     // Keep output stable.
     std::sort(out.begin(), out.end());
     return out;
 }
 
+
+
+static void read_imports(const JavaGrammar &g, const std::string &src, TSNode root, JavaImports *out)
+{
+    uint32_t n = ts_node_named_child_count(root);
+    for (uint32_t i = 0; i < n; i++) {
+        TSNode c = ts_node_named_child(root, i);
+        TSSymbol sym = ts_node_symbol(c);
+        uint32_t m = ts_node_named_child_count(c);
+        if (m == 0) {
+            continue;
+        }
+        if (sym == g.package_declaration) {
+            out->package = std::string(node_text_view(src, ts_node_named_child(c, m - 1)));
+        } else if (sym == g.import_declaration) {
+            // static imports name members, not types
+            if (node_text_view(src, c).substr(0, 13) == "import static") {
+                continue;
+            }
+            std::string name(node_text_view(src, ts_node_named_child(c, 0)));
+            if (ts_node_symbol(ts_node_named_child(c, m - 1)) == g.asterisk) {
+                out->wildcard.push_back(std::move(name));
+            } else {
+                out->single.push_back(std::move(name));
+            }
+        }
+    }
+}
+
+
+// name -> declared simple type, for every declarator under a declaration node
+static void add_declarators(const JavaGrammar &g, const std::string &src, TSNode decl,
+                            std::unordered_map<std::string, std::string> *types)
+{
+    std::string_view type = java_type_simple_name(g, src, ts_node_child_by_field_id(decl, g.field_type));
+    if (type.empty() || type == "var") {
+        return;
+    }
+    TSNode name = ts_node_child_by_field_id(decl, g.field_name);
+    if (!ts_node_is_null(name)) {
+        (*types)[std::string(node_text_view(src, name))] = std::string(type);
+    }
+    uint32_t n = ts_node_named_child_count(decl);
+    for (uint32_t i = 0; i < n; i++) {
+        TSNode d = ts_node_named_child(decl, i);
+        if (ts_node_symbol(d) != g.variable_declarator) {
+            continue;
+        }
+        TSNode dn = ts_node_child_by_field_id(d, g.field_name);
+        if (!ts_node_is_null(dn)) {
+            (*types)[std::string(node_text_view(src, dn))] = std::string(type);
+        }
+    }
+}
+
+
+static std::string receiver_type_of(const JavaGrammar &g,
+                                    const std::string &src,
+                                    TSNode obj,
+                                    const std::unordered_map<std::string, std::string> &locals,
+                                    const std::unordered_map<std::string, std::string> &fields,
+                                    const std::string &enclosing)
+{
+    if (ts_node_is_null(obj) || ts_node_symbol(obj) == g.this_) {
+        return enclosing;
+    }
+    TSSymbol sym = ts_node_symbol(obj);
+    if (sym == g.identifier) {
+        std::string name(node_text_view(src, obj));
+        auto it = locals.find(name);
+        if (it != locals.end()) {
+            return it->second;
+        }
+        it = fields.find(name);
+        if (it != fields.end()) {
+            return it->second;
+        }
+        // Foo.bar(): a static call, by Java naming convention
+        if (!name.empty() && name[0] >= 'A' && name[0] <= 'Z') {
+            return name;
+        }
+        return std::string();
+    }
+    if (sym == g.field_access) {
+        TSNode o = ts_node_child_by_field_id(obj, g.field_object);
+        TSNode f = ts_node_child_by_field_id(obj, g.field_field);
+        if (!ts_node_is_null(o) && ts_node_symbol(o) == g.this_ && !ts_node_is_null(f)) {
+            auto it = fields.find(std::string(node_text_view(src, f)));
+            if (it != fields.end()) {
+                return it->second;
+            }
+        }
+    }
+    return std::string();
+}
+
+
+CallHarvest harvest_calls_in_range(const std::string &abs_path,
+                                   size_t node_start,
+                                   size_t node_end)
+{
+    CallHarvest out;
+
+    ParsedFilePtr pf = parse_java_file(abs_path);
+    if (!pf->ok) {
+        return out;
+    }
+    const std::string &src = pf->src;
+    if (node_start >= src.size() || node_end > src.size() || node_start >= node_end) {
+        return out;
+    }
+
+    TSNode root = ts_tree_root_node(pf->tree);
+    const JavaGrammar &g = java_grammar();
+
+    TSNode callable = find_callable(g, root, node_start);
+    if (ts_node_is_null(callable)) {
+        return out;
+    }
+    out.ok = true;
+    read_imports(g, src, root, &out.imports);
+
+    // fields of every enclosing type, innermost wins
+    std::unordered_map<std::string, std::string> fields;
+    for (TSNode t = ts_node_parent(callable); !ts_node_is_null(t); t = ts_node_parent(t)) {
+        if (!g.is(t, JK_TYPE_DECL)) {
+            continue;
+        }
+        if (out.enclosing_type.empty()) {
+            TSNode name = ts_node_child_by_field_id(t, g.field_name);
+            if (!ts_node_is_null(name)) {
+                out.enclosing_type = std::string(node_text_view(src, name));
+            }
+        }
+        TSNode body = ts_node_child_by_field_id(t, g.field_body);
+        uint32_t n = ts_node_is_null(body) ? 0 : ts_node_named_child_count(body);
+        std::unordered_map<std::string, std::string> own;
+        for (uint32_t i = 0; i < n; i++) {
+            TSNode c = ts_node_named_child(body, i);
+            if (ts_node_symbol(c) == g.field_declaration) {
+                add_declarators(g, src, c, &own);
+            }
+        }
+        for (auto &kv : own) {
+            fields.emplace(kv.first, std::move(kv.second));
+        }
+    }
+
+    // parameters and locals anywhere in the method; scopes aren't tracked
+    std::unordered_map<std::string, std::string> locals;
+    std::vector<TSNode> calls;
+    TSTreeCursor cursor = ts_tree_cursor_new(callable);
+    for (;;) {
+        TSNode n = ts_tree_cursor_current_node(&cursor);
+        TSSymbol sym = ts_node_symbol(n);
+        if (sym == g.formal_parameter || sym == g.local_variable_declaration || sym == g.enhanced_for_statement) {
+            add_declarators(g, src, n, &locals);
+        } else if (sym == g.method_invocation) {
+            calls.push_back(n);
+        }
+
+        if (ts_tree_cursor_goto_first_child(&cursor)) {
+            continue;
+        }
+        if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+            continue;
+        }
+        bool climbed = false;
+        while (ts_tree_cursor_goto_parent(&cursor)) {
+            if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+                climbed = true;
+                break;
+            }
+        }
+        if (!climbed) {
+            break;
+        }
+    }
+    ts_tree_cursor_delete(&cursor);
+
+    std::unordered_set<std::string> seen;
+    for (TSNode call : calls) {
+        TSNode name_node = find_invocation_name_node(g, call);
+        if (ts_node_is_null(name_node)) {
+            continue;
+        }
+        std::string name(node_text_view(src, name_node));
+        if (name.empty() || is_noise_method(name)) {
+            continue;
+        }
+        TSNode obj = ts_node_child_by_field_id(call, g.field_object);
+        CalleeRef c;
+        c.name = std::move(name);
+        c.receiver_type = receiver_type_of(g, src, obj, locals, fields, out.enclosing_type);
+        if (!ts_node_is_null(obj)) {
+            c.receiver = std::string(node_text_view(src, obj).substr(0, 120));
+        }
+        if (seen.insert(c.name + "\n" + c.receiver_type).second) {
+            out.callees.push_back(std::move(c));
+        }
+    }
+
+    std::stable_sort(out.callees.begin(), out.callees.end(),
+                     [](const CalleeRef &a, const CalleeRef &b)
+                     {
+                         return a.name < b.name;
+                     });
+    return out;
+}
+
+
+std::vector<std::string> candidate_fqcns(const JavaImports &imports, const std::string &simple)
+{
+    std::vector<std::string> out;
+    const std::string dotted = "." + simple;
+    for (const std::string &imp : imports.single) {
+        if (imp == simple || (imp.size() > dotted.size() &&
+                              imp.compare(imp.size() - dotted.size(), dotted.size(), dotted) == 0)) {
+            out.push_back(imp);
+            return out;   // an explicit import is unambiguous
+        }
+    }
+    out.push_back(imports.package.empty() ? simple : imports.package + dotted);
+    for (const std::string &w : imports.wildcard) {
+        out.push_back(w + dotted);
+    }
+    return out;
+}
@@ -2,7 +2,10 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 struct Method
@@ -18,10 +21,62 @@ struct Method
 
     std::string reason;
     std::string text;
+
+    // set by extract_methods_from_file
+    int query = -1;        // index of the MethodQuery matched
+    std::string params;    // parameter list as written, e.g. "(String card, long cents)"
+};
+
+
+// A method to extract: "name", "name/2" (parameter count) or
+// "name(String,int)" (parameter types, see method_param_type_key).
+struct MethodQuery
+{
+    std::string name;
+    int param_count = -1;                  // -1: any
+    bool has_types = false;
+    std::vector<std::string> param_types;  // already in method_param_type_key form
 };
 
+bool parse_method_query(const std::string &spec, MethodQuery *out);
+
 
 Method extract_method_from_file(const std::string &abs_path,
                                 const std::string &rel_path,
                                 const std::string &method_name);
 
+// Files at least this big are lexed (see java_lexer.h) instead of parsed;
+// each match is then checked by parsing just its own text, and the file is
+// parsed in full if a check fails, a query has no match or braces don't
+// balance.
+constexpr uint64_t kLexExtractMinBytes = 1ull << 20;
+
+struct ExtractStats
+{
+    bool lexed = false;        // matches came from the lexer
+    bool fell_back = false;    // lexer result rejected, full parse used
+    size_t verified = 0;
+    size_t verify_failed = 0;
+};
+
+// Parse once and return every declaration with a body that matches any of
+// the queries, overloads included, in source order. Empty with *error set
+// when the file can't be read or parsed.
+std::vector<Method> extract_methods_from_file(const std::string &abs_path,
+                                              const std::string &rel_path,
+                                              const std::vector<MethodQuery> &queries,
+                                              std::string *error,
+                                              uint64_t lex_min_bytes = kLexExtractMinBytes,
+                                              ExtractStats *stats = nullptr);
+
+// Lexer-only matching over an in-memory buffer; no tree-sitter involved.
+// *balanced as for java_lex_callables.
+std::vector<Method> extract_methods_lexed(const char *src, size_t n,
+                                          const std::string &abs_path,
+                                          const std::string &rel_path,
+                                          const std::vector<MethodQuery> &queries,
+                                          bool *balanced = nullptr);
+
+// Canonical parameter type for MethodQuery matching: no spaces, type
+// arguments or package qualifier; [] and ... kept ("java.util.List<X>[]" -> "List[]").
+std::string method_param_type_key(std::string_view type_text);
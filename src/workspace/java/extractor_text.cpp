@@ -1,207 +1,234 @@
 
 #include "workspace/java/extractor.h"
 
-#include <cctype>
-#include <fstream>
+#include <cstdlib>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/java/java_lexer.h"
 
 
 static bool is_ident_char(char c)
 {
-    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    unsigned char u = static_cast<unsigned char>(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') ||
+           u == '_' || u == '$' || u >= 0x80;
 }
 
-static bool read_entire_file(const std::string &path, std::string &out)
+
+static bool is_space(char c)
 {
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        return false;
-    }
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
 
-    in.seekg(0, std::ios::end);
-    std::streamoff n = in.tellg();
-    if (n < 0) {
-        return false;
-    }
 
-    out.assign(static_cast<size_t>(n), '\0');
-    if (n == 0) {
-        return true;
+static std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && is_space(s.front())) {
+        s.remove_prefix(1);
     }
-
-    in.seekg(0, std::ios::beg);
-    in.read(&out[0], n);
-    return in.good() || in.eof();
+    while (!s.empty() && is_space(s.back())) {
+        s.remove_suffix(1);
+    }
+    return s;
 }
 
 
-static bool match_word_before_paren(const std::string &s, size_t pos, const std::string &name)
+// Top-level comma split; <>, () and [] nest.
+static std::vector<std::string_view> split_top_level(std::string_view s)
 {
-    // Check s[pos..pos+name.size()) == name AND next non-space is '('
-    if (pos + name.size() > s.size()) {
-        return false;
+    std::vector<std::string_view> out;
+    int depth = 0;
+    size_t from = 0;
+    for (size_t i = 0; i <= s.size(); i++) {
+        char c = i < s.size() ? s[i] : ',';
+        if (c == '<' || c == '(' || c == '[') {
+            depth++;
+        } else if (c == '>' || c == ')' || c == ']') {
+            depth--;
+        } else if (c == ',' && depth <= 0) {
+            out.push_back(trim(s.substr(from, i - from)));
+            from = i + 1;
+        }
     }
+    return out;
+}
 
-    if (s.compare(pos, name.size(), name) != 0) {
-        return false;
-    }
 
-    // Word boundary before
-    if (pos > 0 && is_ident_char(s[pos - 1])) {
-        return false;
+std::string method_param_type_key(std::string_view type_text)
+{
+    std::string t;
+    t.reserve(type_text.size());
+    int depth = 0;
+    for (char c : type_text) {
+        if (c == '<') {
+            depth++;
+        } else if (c == '>') {
+            depth--;
+        } else if (depth == 0 && !is_space(c)) {
+            t.push_back(c);
+        }
     }
-
-    // Word boundary after name
-    size_t after = pos + name.size();
-    if (after < s.size() && is_ident_char(s[after])) {
-        return false;
+    size_t suffix = t.find("...");
+    if (suffix == std::string::npos) {
+        suffix = t.find('[');
     }
-
-    // Skip whitespace to find '('
-    size_t i = after;
-    while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i]))) {
-        i++;
+    size_t dot = t.rfind('.', suffix == std::string::npos ? std::string::npos : suffix);
+    if (dot != std::string::npos && (suffix == std::string::npos || dot < suffix)) {
+        t.erase(0, dot + 1);
     }
-
-    return (i < s.size() && s[i] == '(');
+    return t;
 }
 
 
-static bool find_method_header(const std::string &src, 
-                               const std::string &method_name, 
-                               size_t *out_name_pos)
+bool parse_method_query(const std::string &spec, MethodQuery *out)
 {
-    // v1: find the first occurrence of "methodName (" with word boundaries.
-    // This may match calls inside other methods; later we will refine.
-    for (size_t i = 0; i < src.size(); i++) {
-        if (src[i] != method_name[0]) {
-            continue;
+    *out = MethodQuery{};
+    size_t paren = spec.find('(');
+    size_t slash = spec.find('/');
+
+    if (paren != std::string::npos) {
+        if (spec.back() != ')') {
+            return false;
         }
-        if (match_word_before_paren(src, i, method_name)) {
-            *out_name_pos = i;
-            return true;
+        out->name = spec.substr(0, paren);
+        out->has_types = true;
+        std::string_view inner = std::string_view(spec).substr(paren + 1, spec.size() - paren - 2);
+        if (!trim(inner).empty()) {
+            for (std::string_view t : split_top_level(inner)) {
+                if (t.empty()) {
+                    return false;
+                }
+                out->param_types.push_back(method_param_type_key(t));
+            }
         }
+        out->param_count = static_cast<int>(out->param_types.size());
+    } else if (slash != std::string::npos) {
+        out->name = spec.substr(0, slash);
+        const char *digits = spec.c_str() + slash + 1;
+        char *end = nullptr;
+        long n = std::strtol(digits, &end, 10);
+        if (end == digits || *end != '\0' || n < 0) {
+            return false;
+        }
+        out->param_count = static_cast<int>(n);
+    } else {
+        out->name = spec;
     }
-    return false;
+    return !out->name.empty();
 }
 
 
-static bool find_open_brace_after_paren_list(const std::string &src, size_t name_pos, size_t *out_brace_pos)
+// Type of one declared parameter, e.g. "@Nonnull final Map<K, V> m" -> "Map<K, V>",
+// "int a[]" -> "int[]". Empty for the receiver parameter (Foo this).
+static std::string lexed_param_type(std::string_view p)
 {
-    // Starting from name_pos, find the parameter list (...) then the opening '{' of the body.
-    // We need to skip nested parentheses in generics/annotations? v1 keeps it simple:
-    // - find the first '(' after name
-    // - match until its corresponding ')'
-    // - then skip whitespace/throws/annotations and find '{'
-
-    size_t i = name_pos;
+    for (;;) {
+        p = trim(p);
+        if (!p.empty() && p.front() == '@') {
+            size_t i = 1;
+            while (i < p.size() && (is_ident_char(p[i]) || p[i] == '.')) {
+                i++;
+            }
+            while (i < p.size() && is_space(p[i])) {
+                i++;
+            }
+            if (i < p.size() && p[i] == '(') {
+                int depth = 0;
+                for (; i < p.size(); i++) {
+                    if (p[i] == '(') depth++;
+                    if (p[i] == ')' && --depth == 0) {
+                        i++;
+                        break;
+                    }
+                }
+            }
+            p.remove_prefix(i);
+        } else if (p.size() > 6 && p.compare(0, 5, "final") == 0 && !is_ident_char(p[5])) {
+            p.remove_prefix(5);
+        } else {
+            break;
+        }
+    }
 
-    while (i < src.size() && src[i] != '(') {
-        i++;
+    std::string dims;
+    while (p.size() >= 2 && p.back() == ']') {
+        p.remove_suffix(1);
+        p = trim(p);
+        if (!p.empty() && p.back() == '[') {
+            p.remove_suffix(1);
+            p = trim(p);
+        }
+        dims += "[]";
     }
-    if (i >= src.size()) {
-        return false;
+    size_t b = p.size();
+    while (b > 0 && is_ident_char(p[b - 1])) {
+        b--;
     }
+    if (p.substr(b) == "this") {
+        return std::string();
+    }
+    return std::string(trim(p.substr(0, b))) + dims;
+}
+
 
-    int paren = 0;
-    for (; i < src.size(); i++) {
-        if (src[i] == '(') {
-            paren++;
-        } else if (src[i] == ')') {
-            paren--;
-            if (paren == 0) {
-                i++; // move past ')'
-                break;
+static bool lexed_params_match(std::string_view params, const MethodQuery &q)
+{
+    if (q.param_count < 0) {
+        return true;
+    }
+    std::vector<std::string> types;
+    if (!trim(params).empty()) {
+        for (std::string_view p : split_top_level(params)) {
+            std::string t = lexed_param_type(p);
+            if (!t.empty()) {
+                types.push_back(std::move(t));
             }
         }
     }
-    if (paren != 0) {
+    if (static_cast<int>(types.size()) != q.param_count) {
         return false;
     }
-
-    // Now find the next '{' that begins the method body.
-    // v1: skip whitespace and allow "throws ..." until '{'
-    for (; i < src.size(); i++) {
-        char c = src[i];
-        if (std::isspace(static_cast<unsigned char>(c))) {
-            continue;
-        }
-        if (c == '{') {
-            *out_brace_pos = i;
-            return true;
-        }
-        // If we hit ';' before '{', it might be an abstract method/interface method.
-        if (c == ';') {
+    if (!q.has_types) {
+        return true;
+    }
+    for (size_t i = 0; i < types.size(); i++) {
+        if (method_param_type_key(types[i]) != q.param_types[i]) {
             return false;
         }
-        // Otherwise keep scanning (handles "throws X, Y" etc.)
     }
-
-    return false;
+    return true;
 }
 
-static bool brace_match_block(const std::string &src, size_t open_brace_pos, size_t *out_end_pos_exclusive)
-{
-    // v1 brace matcher (does not ignore braces in strings/comments yet).
-    int depth = 0;
 
-    for (size_t i = open_brace_pos; i < src.size(); i++) {
-        if (src[i] == '{') {
-            depth++;
-        } else if (src[i] == '}') {
-            depth--;
-            if (depth == 0) {
-                *out_end_pos_exclusive = i + 1; // include closing brace
-                return true;
+std::vector<Method> extract_methods_lexed(const char *src, size_t n,
+                                          const std::string &abs_path,
+                                          const std::string &rel_path,
+                                          const std::vector<MethodQuery> &queries,
+                                          bool *balanced)
+{
+    std::vector<Method> out;
+    for (const LexedCallable &d : java_lex_callables(src, n, balanced)) {
+        std::string_view name(src + d.name, d.name_end - d.name);
+        std::string_view params(src + d.params + 1, d.params_end - d.params - 2);
+        for (size_t qi = 0; qi < queries.size(); qi++) {
+            if (name != queries[qi].name || !lexed_params_match(params, queries[qi])) {
+                continue;
             }
+            Method m;
+            m.found = true;
+            m.abs_path = abs_path;
+            m.rel_path = rel_path;
+            m.start = d.start;
+            m.end = d.end;
+            m.text.assign(src + d.start, d.end - d.start);
+            m.query = static_cast<int>(qi);
+            m.params.assign(src + d.params, d.params_end - d.params);
+            m.reason = "lexer declaration match";
+            out.push_back(std::move(m));
+            break;
         }
     }
-
-    return false;
-}
-
-
-MethodSnippet extract_method_from_file(const std::string &abs_path,
-                                       const std::string &rel_path,
-                                       const std::string &method_name)
-{
-    MethodSnippet out;
-    out.abs_path = abs_path;
-    out.rel_path = rel_path;
-
-    std::string src;
-    if (!read_entire_file(abs_path, src)) {
-        out.found = false;
-        out.reason = "failed to read file";
-        return out;
-    }
-
-    size_t name_pos = 0;
-    if (!find_method_header(src, method_name, &name_pos)) {
-        out.found = false;
-        out.reason = "method name not found";
-        return out;
-    }
-
-    size_t open_brace = 0;
-    if (!find_open_brace_after_paren_list(src, name_pos, &open_brace)) {
-        out.found = false;
-        out.reason = "found name, but could not locate method body '{' (maybe abstract/interface?)";
-        return out;
-    }
-
-    size_t end_excl = 0;
-    if (!brace_match_block(src, open_brace, &end_excl)) {
-        out.found = false;
-        out.reason = "failed to brace-match method body";
-        return out;
-    }
-
-    out.found = true;
-    out.start = name_pos;
-    out.end = end_excl;
-    out.text = src.substr(name_pos, end_excl - name_pos);
-    out.reason = "extracted by name+paren+brace match (v1)";
     return out;
 }
-
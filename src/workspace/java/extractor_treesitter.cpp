@@ -1,44 +1,18 @@
 
 #include "workspace/java/extractor.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
-#include <cstring>
-#include <fstream>
 #include <string>
 #include <string_view>
+#include <sys/stat.h>
+#include <vector>
 #include <tree_sitter/api.h>
 
-
-extern "C"
-{
-// from external/tree-sitter-java/src/parser.c
-const TSLanguage *tree_sitter_java(void);
-}
-
-
-static bool read_entire_file(const std::string &path, std::string &out)
-{
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        return false;
-    }
-
-    in.seekg(0, std::ios::end);
-    std::streamoff n = in.tellg();
-    if (n < 0) {
-        return false;
-    }
-    in.seekg(0, std::ios::beg);
-
-    out.assign(static_cast<size_t>(n), '\0');
-    if (n == 0) {
-        return true;
-    }
-
-    in.read(out.data(), n);
-    return in.good() || in.eof();
-}
+#include "sys/mmap_file.h"
+#include "workspace/java/java_grammar.h"
+#include "workspace/java/parse_cache.h"
 
 
 static std::string_view node_text_view(const std::string &src, TSNode n)
@@ -52,25 +26,18 @@ static std::string_view node_text_view(const std::string &src, TSNode n)
 }
 
 
-static bool node_type_is(TSNode n, const char *type)
-{
-    const char *t = ts_node_type(n);
-    return t && std::strcmp(t, type) == 0;
-}
-
-
-static bool method_has_body(TSNode method_decl)
+static bool method_has_body(const JavaGrammar &g, TSNode method_decl)
 {
     // In tree-sitter-java, method_declaration normally has a "body" field when implemented.
     // Abstract/interface methods usually end with ';' and have no body.
-    TSNode body = ts_node_child_by_field_name(method_decl, "body", 4);
+    TSNode body = ts_node_child_by_field_id(method_decl, g.field_body);
     if (ts_node_is_null(body)) {
         return false;
     }
 
     // Body should be a "block" for implemented methods.
     // (If grammar changes, this is still a safe check.)
-    if (node_type_is(body, "block")) {
+    if (ts_node_symbol(body) == g.block) {
         return true;
     }
 
@@ -83,16 +50,17 @@ static bool find_first_method_decl(TSNode root,
                                   const std::string &method_name,
                                   TSNode *out_method)
 {
+    const JavaGrammar &g = java_grammar();
     TSTreeCursor cur = ts_tree_cursor_new(root);
     bool found = false;
     for (;;) {
         TSNode n = ts_tree_cursor_current_node(&cur);
-        if (node_type_is(n, "method_declaration")) {
-            TSNode name = ts_node_child_by_field_name(n, "name", 4);
+        if (ts_node_symbol(n) == g.method_declaration) {
+            TSNode name = ts_node_child_by_field_id(n, g.field_name);
             if (!ts_node_is_null(name)) {
                 std::string_view name_sv = node_text_view(src, name);
                 if (name_sv == method_name) {
-                    if (method_has_body(n)) {
+                    if (method_has_body(g, n)) {
                         *out_method = n;
                         found = true;
                         break;
@@ -121,62 +89,99 @@ static bool find_first_method_decl(TSNode root,
 }
 
 
-Method extract_method_from_file(const std::string &abs_path,
-                                const std::string &rel_path,
-                                const std::string &method_name)
+// Decls derived by the parse cache; avoids walking the whole tree.
+static bool find_first_method_decl_in_outline(const ParsedFile &pf,
+                                              const std::string &method_name,
+                                              uint32_t *out_a,
+                                              uint32_t *out_b)
+{
+    const JavaGrammar &g = java_grammar();
+    for (const JavaDecl &d : pf.decls) {
+        if (d.symbol == g.method_declaration && d.has_body && d.name == method_name) {
+            *out_a = d.start;
+            *out_b = d.end;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Used when the parse budget refused the file: first lexed declaration named
+// method_name, constructors included.
+static Method extract_method_lexed(const std::string &abs_path,
+                                   const std::string &rel_path,
+                                   const std::string &method_name,
+                                   const std::string &why)
 {
     Method out;
     out.abs_path = abs_path;
     out.rel_path = rel_path;
 
-    std::string src;
-    if (!read_entire_file(abs_path, src)) {
-        out.found = false;
-        out.reason = "failed to read file";
+    MappedFile map;
+    if (!map.open(abs_path) || map.size() == 0) {
+        out.reason = why;
         return out;
     }
-
-    TSParser *parser = ts_parser_new();
-    if (!parser) {
-        out.found = false;
-        out.reason = "ts_parser_new failed";
-        return out;
+    if (ParseBudget *b = parse_budget()) {
+        b->lexer_fallbacks += 1;
     }
-
-    if (!ts_parser_set_language(parser, tree_sitter_java())) {
-        ts_parser_delete(parser);
-        out.found = false;
-        out.reason = "ts_parser_set_language(java) failed";
+    MethodQuery q;
+    q.name = method_name;
+    std::vector<Method> found = extract_methods_lexed(reinterpret_cast<const char *>(map.data()), map.size(),
+                                                      abs_path, rel_path, {q});
+    if (found.empty()) {
+        out.reason = why + "; lexer found no declaration";
         return out;
     }
+    out = std::move(found.front());
+    out.query = -1;
+    out.params.clear();
+    out.reason = "lexer declaration match (" + why + ")";
+    return out;
+}
 
-    TSTree *tree = ts_parser_parse_string(parser, nullptr, src.data(), static_cast<uint32_t>(src.size()));
-    if (!tree) {
-        ts_parser_delete(parser);
+
+Method extract_method_from_file(const std::string &abs_path,
+                                const std::string &rel_path,
+                                const std::string &method_name)
+{
+    Method out;
+    out.abs_path = abs_path;
+    out.rel_path = rel_path;
+
+    ParsedFilePtr pf = parse_java_file(abs_path);
+    if (!pf->ok) {
+        if (pf->over_budget) {
+            return extract_method_lexed(abs_path, rel_path, method_name, pf->error);
+        }
         out.found = false;
-        out.reason = "ts_parser_parse_string failed";
+        out.reason = pf->error;
         return out;
     }
-
-    TSNode root = ts_tree_root_node(tree);
-
-    TSNode method = TSNode{};
-    bool ok = find_first_method_decl(root, src, method_name, &method);
+    const std::string &src = pf->src;
+
+    uint32_t a = 0;
+    uint32_t b = 0;
+    bool ok = false;
+    if (pf->has_decls) {
+        ok = find_first_method_decl_in_outline(*pf, method_name, &a, &b);
+    } else {
+        TSNode method = TSNode{};
+        ok = find_first_method_decl(ts_tree_root_node(pf->tree), src, method_name, &method);
+        if (ok) {
+            a = ts_node_start_byte(method);
+            b = ts_node_end_byte(method);
+        }
+    }
 
     if (!ok) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
         out.found = false;
         out.reason = "method_declaration not found (or no body)";
         return out;
     }
 
-    uint32_t a = ts_node_start_byte(method);
-    uint32_t b = ts_node_end_byte(method);
-
     if (a > b || b > src.size()) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
         out.found = false;
         out.reason = "invalid node byte range";
         return out;
@@ -187,9 +192,197 @@ Method extract_method_from_file(const std::string &abs_path,
     out.end = static_cast<size_t>(b);
     out.text = src.substr(out.start, out.end - out.start);
     out.reason = "tree-sitter method_declaration match";
+    return out;
+}
 
-    ts_tree_delete(tree);
-    ts_parser_delete(parser);
+
+// Type of one parameter in method_param_type_key form.
+static std::string param_type_key(const JavaGrammar &g, const std::string &src, TSNode param)
+{
+    TSNode type = ts_node_child_by_field_id(param, g.field_type);
+    if (ts_node_is_null(type)) {
+        // spread_parameter has no type field: (type) ... (variable_declarator)
+        if (ts_node_named_child_count(param) == 0) {
+            return std::string();
+        }
+        type = ts_node_named_child(param, 0);
+    }
+    std::string key = method_param_type_key(node_text_view(src, type));
+    if (ts_node_symbol(param) == g.spread_parameter) {
+        key += "...";
+    }
+    return key;
+}
+
+
+static bool params_match(const JavaGrammar &g, const std::string &src, TSNode params, const MethodQuery &q)
+{
+    if (q.param_count < 0) {
+        return true;
+    }
+    std::vector<TSNode> ps;
+    uint32_t n = ts_node_is_null(params) ? 0 : ts_node_named_child_count(params);
+    for (uint32_t i = 0; i < n; i++) {
+        TSNode p = ts_node_named_child(params, i);
+        TSSymbol s = ts_node_symbol(p);
+        if (s == g.formal_parameter || s == g.spread_parameter) {
+            ps.push_back(p);
+        }
+    }
+    if (static_cast<int>(ps.size()) != q.param_count) {
+        return false;
+    }
+    if (!q.has_types) {
+        return true;
+    }
+    for (size_t i = 0; i < ps.size(); i++) {
+        if (param_type_key(g, src, ps[i]) != q.param_types[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static std::vector<Method> extract_methods_parsed(const ParsedFile &pf,
+                                                  const std::string &abs_path,
+                                                  const std::string &rel_path,
+                                                  const std::vector<MethodQuery> &queries)
+{
+    std::vector<Method> out;
+    const std::string &src = pf.src;
+    const JavaGrammar &g = java_grammar();
+
+    TSTreeCursor cur = ts_tree_cursor_new(ts_tree_root_node(pf.tree));
+    for (;;) {
+        TSNode n = ts_tree_cursor_current_node(&cur);
+        if (g.is(n, JK_CALLABLE) && method_has_body(g, n)) {
+            TSNode name = ts_node_child_by_field_id(n, g.field_name);
+            std::string_view name_sv = ts_node_is_null(name) ? std::string_view() : node_text_view(src, name);
+            TSNode params = ts_node_child_by_field_id(n, g.field_parameters);
+            for (size_t qi = 0; qi < queries.size(); qi++) {
+                if (name_sv != queries[qi].name || !params_match(g, src, params, queries[qi])) {
+                    continue;
+                }
+                uint32_t a = ts_node_start_byte(n);
+                uint32_t b = ts_node_end_byte(n);
+                if (a > b || b > src.size()) {
+                    break;
+                }
+                Method m;
+                m.found = true;
+                m.abs_path = abs_path;
+                m.rel_path = rel_path;
+                m.start = a;
+                m.end = b;
+                m.text = src.substr(a, b - a);
+                m.query = static_cast<int>(qi);
+                m.params = ts_node_is_null(params) ? std::string() : std::string(node_text_view(src, params));
+                m.reason = "tree-sitter declaration match";
+                out.push_back(std::move(m));
+                break;   // first matching query claims it
+            }
+        }
+
+        // dfs; declarations nest (local and anonymous classes)
+        if (ts_tree_cursor_goto_first_child(&cur)) continue;
+        if (ts_tree_cursor_goto_next_sibling(&cur)) continue;
+        bool backtracked = false;
+        while (ts_tree_cursor_goto_parent(&cur)) {
+            if (ts_tree_cursor_goto_next_sibling(&cur)) {
+                backtracked = true;
+                break;
+            }
+        }
+        if (!backtracked) {
+            break;
+        }
+    }
+    ts_tree_cursor_delete(&cur);
     return out;
 }
 
+
+// Parse just the lexed match inside a dummy class and check that tree-sitter
+// sees one declaration spanning all of it, with the same name and parameters.
+static bool verify_lexed(const Method &m, const MethodQuery &q)
+{
+    static const char kOpen[] = "class __Verify {\n";
+    std::string buf = kOpen;
+    buf += m.text;
+    buf += "\n}\n";
+
+    std::string err;
+    TSTree *tree = parse_java_buffer(buf.data(), buf.size(), &err);
+    if (!tree) {
+        return false;
+    }
+    const JavaGrammar &g = java_grammar();
+    uint32_t a = sizeof(kOpen) - 1;
+    uint32_t b = a + static_cast<uint32_t>(m.text.size());
+    TSNode root = ts_tree_root_node(tree);
+    bool ok = false;
+    if (!ts_node_has_error(root)) {
+        TSNode n = ts_node_descendant_for_byte_range(root, a, b);
+        if (g.is(n, JK_CALLABLE) && ts_node_start_byte(n) == a && ts_node_end_byte(n) == b &&
+            method_has_body(g, n)) {
+            TSNode name = ts_node_child_by_field_id(n, g.field_name);
+            ok = !ts_node_is_null(name) && node_text_view(buf, name) == q.name &&
+                 params_match(g, buf, ts_node_child_by_field_id(n, g.field_parameters), q);
+        }
+    }
+    ts_tree_delete(tree);
+    return ok;
+}
+
+
+std::vector<Method> extract_methods_from_file(const std::string &abs_path,
+                                              const std::string &rel_path,
+                                              const std::vector<MethodQuery> &queries,
+                                              std::string *error,
+                                              uint64_t lex_min_bytes,
+                                              ExtractStats *stats)
+{
+    ExtractStats local;
+    if (!stats) {
+        stats = &local;
+    }
+    *stats = ExtractStats{};
+
+    struct stat st;
+    if (::stat(abs_path.c_str(), &st) == 0 && st.st_size > 0 &&
+        static_cast<uint64_t>(st.st_size) >= lex_min_bytes) {
+        MappedFile map;
+        if (!map.open(abs_path)) {
+            *error = "failed to read file";
+            return {};
+        }
+        bool balanced = false;
+        std::vector<Method> out = extract_methods_lexed(reinterpret_cast<const char *>(map.data()), map.size(),
+                                                        abs_path, rel_path, queries, &balanced);
+        std::vector<bool> matched(queries.size(), false);
+        for (const Method &m : out) {
+            matched[static_cast<size_t>(m.query)] = true;
+            if (verify_lexed(m, queries[static_cast<size_t>(m.query)])) {
+                stats->verified++;
+            } else {
+                stats->verify_failed++;
+            }
+        }
+        // A query the lexer found nothing for may be a declaration it
+        // misread; only the parse can say it is really absent.
+        bool all_matched = std::find(matched.begin(), matched.end(), false) == matched.end();
+        if (balanced && all_matched && stats->verify_failed == 0) {
+            stats->lexed = true;
+            return out;
+        }
+        stats->fell_back = true;
+    }
+
+    ParsedFilePtr pf = parse_java_file(abs_path);
+    if (!pf->ok) {
+        *error = pf->error;
+        return {};
+    }
+    return extract_methods_parsed(*pf, abs_path, rel_path, queries);
+}
@@ -0,0 +1,115 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sys/mmap_file.h"
+#include "workspace/file_table.h"
+#include "workspace/index_io.h"
+
+
+class TypeIndexBuilder;
+
+
+enum IdentRole : uint8_t
+{
+    IR_DECL   = 0,   // name of a method, constructor or type declaration
+    IR_INVOKE = 1,   // name of a method_invocation
+    IR_REF    = 2    // any other identifier / type_identifier
+};
+
+
+enum IdentRoleMask : uint32_t
+{
+    IRM_DECL   = 1u << IR_DECL,
+    IRM_INVOKE = 1u << IR_INVOKE,
+    IRM_REF    = 1u << IR_REF,
+    IRM_ALL    = IRM_DECL | IRM_INVOKE | IRM_REF
+};
+
+const char *ident_role_name(IdentRole r);
+
+
+struct IdentOccurrence
+{
+    uint32_t file = 0;     // index-local id, see IndexFileList
+    uint32_t offset = 0;   // start byte of the identifier
+    IdentRole role = IR_REF;
+};
+
+
+// One call site of a method, with the declaration it sits in.
+struct CallEdge
+{
+    uint32_t file = 0;           // index-local id, see IndexFileList
+    uint32_t call_offset = 0;    // start byte of the invoked name
+    uint32_t caller_start = 0;   // byte range of the enclosing method/constructor declaration
+    uint32_t caller_end = 0;
+    std::string_view caller_name;   // points into the mapped index
+};
+
+
+struct IdentBuildStats
+{
+    size_t files = 0;
+    size_t parse_failed = 0;
+    size_t names = 0;
+    size_t decls = 0;
+    size_t invocations = 0;
+    size_t refs = 0;
+    size_t call_edges = 0;
+    uint64_t index_bytes = 0;
+};
+
+
+std::string ident_index_path(const std::string &index_dir);
+
+// Parse every live file and record each identifier token with its role,
+// plus a call-graph edge for every invocation inside a method/constructor.
+// Files that fail to read or parse get an unusable record (stale on resolve).
+// With types, each parsed file is also handed to it, so the type index
+// costs no second parse.
+bool build_ident_index(const FileTable &files,
+                       const std::string &out_path,
+                       IdentBuildStats *stats,
+                       std::string *error,
+                       TypeIndexBuilder *types = nullptr);
+
+
+// identifier -> occurrences, mmap'd; a lookup is one hash probe plus a
+// contiguous run of fixed-size postings in (file, offset) order.
+class IdentIndex
+{
+public:
+    bool open(const std::string &path, std::string *error);
+
+    const IndexFileList &files() const { return files_; }
+    uint32_t name_count() const { return nnames_; }
+
+    // Occurrences of name whose role is in role_mask; false if the name was never seen.
+    bool lookup(std::string_view name, uint32_t role_mask, std::vector<IdentOccurrence> *out) const;
+
+    // Call sites of callee by simple name, each with its enclosing declaration;
+    // false if the name was never seen.
+    bool callers(std::string_view callee, std::vector<CallEdge> *out) const;
+
+private:
+    const unsigned char *find_entry(std::string_view name) const;
+    std::string_view name_at(uint32_t id) const;
+
+    MappedFile map_;
+    IndexFileList files_;
+    uint32_t nnames_ = 0;
+    uint32_t nslots_ = 0;
+    const unsigned char *names_ = nullptr;
+    const unsigned char *entries_ = nullptr;
+    const unsigned char *slots_ = nullptr;
+    const unsigned char *post_ = nullptr;
+    uint64_t npost_ = 0;
+    const unsigned char *edges_ = nullptr;
+    uint64_t nedges_ = 0;
+};
@@ -0,0 +1,517 @@
+
+#include "workspace/java/ident_index.h"
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <tree_sitter/api.h>
+
+#include "workspace/java/java_grammar.h"
+#include "workspace/java/parse_cache.h"
+#include "workspace/java/type_index.h"
+
+
+// On-disk layout:
+//   header   112 bytes
+//   files    IndexFileList records + rel paths
+//   names    identifier bytes back to back
+//   entries  nnames x { u32 name_off, u32 name_len, u32 post_start, u32 post_count,
+//                       u32 edge_start, u32 edge_count }
+//   slots    nslots x u32 entry index (0xffffffff = empty), open addressing, nslots = 2^k
+//   postings { u32 file, u32 offset | role << 30 }, grouped by entry, (file, offset) order
+//   edges    { u32 file, u32 call_offset, u32 caller_start, u32 caller_end, u32 caller_name },
+//            grouped by callee entry, (file, offset) order
+static const char kMagic[8] = {'C', 'G', 'I', 'D', 'X', '0', '0', '2'};
+
+static constexpr size_t kHeaderSize = 112;
+static constexpr size_t kEntrySize = 24;
+static constexpr size_t kPostSize = 8;
+static constexpr size_t kEdgeSize = 20;
+static constexpr uint32_t kEmptySlot = 0xffffffffu;
+static constexpr uint32_t kOffsetMask = (1u << 30) - 1;
+
+
+static uint64_t hash_name(std::string_view s)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ull;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+const char *ident_role_name(IdentRole r)
+{
+    switch (r) {
+    case IR_DECL: return "decl";
+    case IR_INVOKE: return "invoke";
+    case IR_REF: return "ref";
+    }
+    return "ref";
+}
+
+
+std::string ident_index_path(const std::string &index_dir)
+{
+    return index_dir + "/idents.idx";
+}
+
+
+namespace
+{
+
+struct Occ
+{
+    uint32_t name;
+    uint32_t file;
+    uint32_t off_role;
+};
+
+
+// an invocation of name from inside a callable declaration
+struct Edge
+{
+    uint32_t name;
+    uint32_t file;
+    uint32_t call_offset;
+    uint32_t caller_start;
+    uint32_t caller_end;
+    uint32_t caller_name;
+};
+
+
+class IdentCollector
+{
+public:
+    explicit IdentCollector(const JavaGrammar &g) : g_(g) {}
+
+    // Pre-order walk, so offsets come out ascending per file.
+    void collect(const ParsedFile &pf, uint32_t file, IdentBuildStats *st)
+    {
+        TSNode root = ts_tree_root_node(pf.tree);
+        TSTreeCursor c = ts_tree_cursor_new(root);
+        parents_.clear();
+        callers_.clear();
+
+        for (;;) {
+            TSNode n = ts_tree_cursor_current_node(&c);
+            TSSymbol sym = ts_node_symbol(n);
+
+            if (sym == g_.identifier || sym == g_.type_identifier) {
+                IdentRole role = role_of(ts_tree_cursor_current_field_id(&c));
+                uint32_t id = add(pf.src, n, role, file, st);
+                if (role == IR_INVOKE && id != kEmptySlot && !callers_.empty()) {
+                    const Caller &cl = callers_.back();
+                    edges.push_back(Edge{id, file, ts_node_start_byte(n), cl.start, cl.end, cl.name});
+                }
+            } else if (ts_tree_cursor_goto_first_child(&c)) {
+                parents_.push_back(sym);
+                if (g_.kind_of(sym) & JK_CALLABLE) {
+                    enter_callable(pf.src, n);
+                }
+                continue;
+            }
+
+            bool done = false;
+            while (!ts_tree_cursor_goto_next_sibling(&c)) {
+                if (!ts_tree_cursor_goto_parent(&c)) {
+                    done = true;
+                    break;
+                }
+                if (!callers_.empty() && callers_.back().depth == parents_.size()) {
+                    callers_.pop_back();
+                }
+                parents_.pop_back();
+            }
+            if (done) {
+                break;
+            }
+        }
+        ts_tree_cursor_delete(&c);
+    }
+
+    std::deque<std::string> names;
+    std::vector<Occ> occs;
+    std::vector<Edge> edges;
+
+private:
+    struct Caller
+    {
+        size_t depth;   // parents_.size() while inside it
+        uint32_t start;
+        uint32_t end;
+        uint32_t name;
+    };
+
+    void enter_callable(const std::string &src, TSNode n)
+    {
+        uint32_t name = kEmptySlot;
+        TSNode nn = ts_node_child_by_field_id(n, g_.field_name);
+        if (!ts_node_is_null(nn)) {
+            name = intern(src, nn);
+        }
+        if (name == kEmptySlot) {
+            // unnamed: calls inside still belong to whatever encloses it
+            if (callers_.empty()) {
+                return;
+            }
+            Caller outer = callers_.back();
+            outer.depth = parents_.size();
+            callers_.push_back(outer);
+            return;
+        }
+        callers_.push_back(Caller{parents_.size(), ts_node_start_byte(n), ts_node_end_byte(n), name});
+    }
+
+    uint32_t intern(const std::string &src, TSNode n)
+    {
+        uint32_t a = ts_node_start_byte(n);
+        uint32_t b = ts_node_end_byte(n);
+        if (a >= b || b > src.size() || a > kOffsetMask) {
+            return kEmptySlot;
+        }
+        std::string_view text(src.data() + a, b - a);
+
+        auto it = ids_.find(text);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.emplace_back(text);
+        ids_.emplace(names.back(), id);
+        return id;
+    }
+
+    IdentRole role_of(TSFieldId field) const
+    {
+        if (parents_.empty() || field == 0) {
+            return IR_REF;
+        }
+        TSSymbol parent = parents_.back();
+        if (field == g_.field_name && (g_.kind_of(parent) & JK_PREFERRED)) {
+            return IR_DECL;
+        }
+        if (parent == g_.method_invocation &&
+            (field == g_.field_name || (g_.field_member != 0 && field == g_.field_member))) {
+            return IR_INVOKE;
+        }
+        return IR_REF;
+    }
+
+    uint32_t add(const std::string &src, TSNode n, IdentRole role, uint32_t file, IdentBuildStats *st)
+    {
+        uint32_t id = intern(src, n);
+        if (id == kEmptySlot) {
+            return id;
+        }
+        occs.push_back(Occ{id, file, ts_node_start_byte(n) | (static_cast<uint32_t>(role) << 30)});
+
+        if (role == IR_DECL) st->decls += 1;
+        else if (role == IR_INVOKE) st->invocations += 1;
+        else st->refs += 1;
+        return id;
+    }
+
+    const JavaGrammar &g_;
+    std::vector<TSSymbol> parents_;
+    std::vector<Caller> callers_;
+    // keys view into names, which never moves its elements
+    std::unordered_map<std::string_view, uint32_t> ids_;
+};
+
+} // namespace
+
+
+bool build_ident_index(const FileTable &files,
+                       const std::string &out_path,
+                       IdentBuildStats *stats,
+                       std::string *error,
+                       TypeIndexBuilder *types)
+{
+    IdentBuildStats st;
+    IdentCollector col(java_grammar());
+
+    std::string records;
+    std::string paths;
+
+    uint32_t idx = 0;
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (!files.alive(id)) {
+            continue;
+        }
+        ParsedFilePtr pf = parse_java_file(files.abs_path(id));
+        bool usable = pf->ok && pf->src.size() <= kOffsetMask;
+        IndexFileList::append(files, id, usable, &records, &paths);
+        if (types) {
+            types->add_file(files, id, usable ? pf.get() : nullptr);
+        }
+        if (usable) {
+            col.collect(*pf, idx, &st);
+        } else {
+            st.parse_failed += 1;
+        }
+        idx++;
+    }
+    st.files = idx;
+    st.names = col.names.size();
+    st.call_edges = col.edges.size();
+
+    // counting sort by name; stable, so each run stays in (file, offset) order
+    uint32_t nnames = static_cast<uint32_t>(col.names.size());
+    std::vector<uint32_t> start(nnames + 1, 0);
+    for (const Occ &o : col.occs) {
+        start[o.name + 1] += 1;
+    }
+    for (uint32_t i = 0; i < nnames; i++) {
+        start[i + 1] += start[i];
+    }
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    std::string post(col.occs.size() * kPostSize, '\0');
+    for (const Occ &o : col.occs) {
+        size_t at = static_cast<size_t>(fill[o.name]++) * kPostSize;
+        index_store_at<uint32_t>(&post, at, o.file);
+        index_store_at<uint32_t>(&post, at + 4, o.off_role);
+    }
+
+    // same again for call edges, keyed by callee
+    std::vector<uint32_t> estart(nnames + 1, 0);
+    for (const Edge &e : col.edges) {
+        estart[e.name + 1] += 1;
+    }
+    for (uint32_t i = 0; i < nnames; i++) {
+        estart[i + 1] += estart[i];
+    }
+    std::vector<uint32_t> efill(estart.begin(), estart.end() - 1);
+    std::string edges(col.edges.size() * kEdgeSize, '\0');
+    for (const Edge &e : col.edges) {
+        size_t at = static_cast<size_t>(efill[e.name]++) * kEdgeSize;
+        index_store_at<uint32_t>(&edges, at, e.file);
+        index_store_at<uint32_t>(&edges, at + 4, e.call_offset);
+        index_store_at<uint32_t>(&edges, at + 8, e.caller_start);
+        index_store_at<uint32_t>(&edges, at + 12, e.caller_end);
+        index_store_at<uint32_t>(&edges, at + 16, e.caller_name);
+    }
+
+    uint32_t nslots = 64;
+    while (nslots < nnames * 2) {
+        nslots *= 2;
+    }
+    std::vector<uint32_t> slots(nslots, kEmptySlot);
+    for (uint32_t i = 0; i < nnames; i++) {
+        uint32_t s = static_cast<uint32_t>(hash_name(col.names[i])) & (nslots - 1);
+        while (slots[s] != kEmptySlot) {
+            s = (s + 1) & (nslots - 1);
+        }
+        slots[s] = i;
+    }
+
+    std::string out;
+    out.resize(kHeaderSize, '\0');
+    size_t files_off = out.size();
+    out += records;
+    size_t paths_off = out.size();
+    out += paths;
+
+    size_t names_off = out.size();
+    std::vector<uint32_t> name_pos(nnames);
+    for (uint32_t i = 0; i < nnames; i++) {
+        name_pos[i] = static_cast<uint32_t>(out.size() - names_off);
+        out += col.names[i];
+    }
+    index_pad8(&out);
+
+    size_t entries_off = out.size();
+    for (uint32_t i = 0; i < nnames; i++) {
+        index_store<uint32_t>(&out, name_pos[i]);
+        index_store<uint32_t>(&out, static_cast<uint32_t>(col.names[i].size()));
+        index_store<uint32_t>(&out, start[i]);
+        index_store<uint32_t>(&out, start[i + 1] - start[i]);
+        index_store<uint32_t>(&out, estart[i]);
+        index_store<uint32_t>(&out, estart[i + 1] - estart[i]);
+    }
+    size_t slots_off = out.size();
+    for (uint32_t s : slots) {
+        index_store<uint32_t>(&out, s);
+    }
+    index_pad8(&out);
+    size_t post_off = out.size();
+    out += post;
+    size_t edges_off = out.size();
+    out += edges;
+
+    std::memcpy(&out[0], kMagic, sizeof(kMagic));
+    index_store_at<uint32_t>(&out, 8, idx);
+    index_store_at<uint32_t>(&out, 12, nnames);
+    index_store_at<uint32_t>(&out, 16, nslots);
+    index_store_at<uint64_t>(&out, 24, files_off);
+    index_store_at<uint64_t>(&out, 32, paths_off);
+    index_store_at<uint64_t>(&out, 40, names_off);
+    index_store_at<uint64_t>(&out, 48, entries_off);
+    index_store_at<uint64_t>(&out, 56, slots_off);
+    index_store_at<uint64_t>(&out, 64, post_off);
+    index_store_at<uint64_t>(&out, 72, static_cast<uint64_t>(col.occs.size()));
+    index_store_at<uint64_t>(&out, 80, edges_off);
+    index_store_at<uint64_t>(&out, 88, static_cast<uint64_t>(col.edges.size()));
+    index_store_at<uint64_t>(&out, 96, out.size());
+    st.index_bytes = out.size();
+
+    if (!write_file_atomic(out_path, out, error)) {
+        return false;
+    }
+    if (stats) {
+        *stats = st;
+    }
+    return true;
+}
+
+
+bool IdentIndex::open(const std::string &path, std::string *error)
+{
+    if (!map_.open(path)) {
+        *error = "open(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+    const unsigned char *base = map_.data();
+    size_t size = map_.size();
+
+    if (size < kHeaderSize || std::memcmp(base, kMagic, sizeof(kMagic)) != 0) {
+        *error = "not an identifier index: " + path;
+        map_.close();
+        return false;
+    }
+
+    uint32_t nfiles = index_load<uint32_t>(base + 8);
+    nnames_ = index_load<uint32_t>(base + 12);
+    nslots_ = index_load<uint32_t>(base + 16);
+    uint64_t files_off = index_load<uint64_t>(base + 24);
+    uint64_t paths_off = index_load<uint64_t>(base + 32);
+    uint64_t names_off = index_load<uint64_t>(base + 40);
+    uint64_t entries_off = index_load<uint64_t>(base + 48);
+    uint64_t slots_off = index_load<uint64_t>(base + 56);
+    uint64_t post_off = index_load<uint64_t>(base + 64);
+    npost_ = index_load<uint64_t>(base + 72);
+    uint64_t edges_off = index_load<uint64_t>(base + 80);
+    nedges_ = index_load<uint64_t>(base + 88);
+    uint64_t total = index_load<uint64_t>(base + 96);
+
+    bool ok = total == size &&
+              nslots_ != 0 && (nslots_ & (nslots_ - 1)) == 0 &&
+              files_off == kHeaderSize &&
+              paths_off == files_off + static_cast<uint64_t>(nfiles) * IndexFileList::kRecordSize &&
+              paths_off <= names_off && names_off <= entries_off &&
+              slots_off == entries_off + static_cast<uint64_t>(nnames_) * kEntrySize &&
+              slots_off + static_cast<uint64_t>(nslots_) * 4 <= post_off &&
+              edges_off == post_off + npost_ * kPostSize &&
+              edges_off + nedges_ * kEdgeSize == size;
+    if (!ok) {
+        *error = "corrupt identifier index: " + path;
+        map_.close();
+        return false;
+    }
+
+    files_.init(base + files_off, base + paths_off, nfiles);
+    names_ = base + names_off;
+    entries_ = base + entries_off;
+    slots_ = base + slots_off;
+    post_ = base + post_off;
+    edges_ = base + edges_off;
+    return true;
+}
+
+
+const unsigned char *IdentIndex::find_entry(std::string_view name) const
+{
+    if (!map_) {
+        return nullptr;
+    }
+    uint32_t mask = nslots_ - 1;
+    uint32_t s = static_cast<uint32_t>(hash_name(name)) & mask;
+    for (;;) {
+        uint32_t e = index_load<uint32_t>(slots_ + static_cast<size_t>(s) * 4);
+        if (e == kEmptySlot || e >= nnames_) {
+            return nullptr;
+        }
+        const unsigned char *ent = entries_ + static_cast<size_t>(e) * kEntrySize;
+        uint32_t noff = index_load<uint32_t>(ent);
+        uint32_t nlen = index_load<uint32_t>(ent + 4);
+        if (nlen == name.size() && std::memcmp(names_ + noff, name.data(), nlen) == 0) {
+            return ent;
+        }
+        s = (s + 1) & mask;
+    }
+}
+
+
+std::string_view IdentIndex::name_at(uint32_t id) const
+{
+    if (id >= nnames_) {
+        return std::string_view();
+    }
+    const unsigned char *ent = entries_ + static_cast<size_t>(id) * kEntrySize;
+    return std::string_view(reinterpret_cast<const char *>(names_) + index_load<uint32_t>(ent),
+                            index_load<uint32_t>(ent + 4));
+}
+
+
+bool IdentIndex::lookup(std::string_view name, uint32_t role_mask, std::vector<IdentOccurrence> *out) const
+{
+    out->clear();
+    const unsigned char *ent = find_entry(name);
+    if (!ent) {
+        return false;
+    }
+    uint32_t first = index_load<uint32_t>(ent + 8);
+    uint32_t count = index_load<uint32_t>(ent + 12);
+    if (static_cast<uint64_t>(first) + count > npost_) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char *p = post_ + static_cast<size_t>(first + i) * kPostSize;
+        uint32_t off_role = index_load<uint32_t>(p + 4);
+        IdentRole role = static_cast<IdentRole>(off_role >> 30);
+        if (!(role_mask & (1u << role))) {
+            continue;
+        }
+        IdentOccurrence o;
+        o.file = index_load<uint32_t>(p);
+        o.offset = off_role & kOffsetMask;
+        o.role = role;
+        out->push_back(o);
+    }
+    return true;
+}
+
+
+bool IdentIndex::callers(std::string_view callee, std::vector<CallEdge> *out) const
+{
+    out->clear();
+    const unsigned char *ent = find_entry(callee);
+    if (!ent) {
+        return false;
+    }
+    uint32_t first = index_load<uint32_t>(ent + 16);
+    uint32_t count = index_load<uint32_t>(ent + 20);
+    if (static_cast<uint64_t>(first) + count > nedges_) {
+        return false;
+    }
+    out->reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char *p = edges_ + static_cast<size_t>(first + i) * kEdgeSize;
+        CallEdge e;
+        e.file = index_load<uint32_t>(p);
+        e.call_offset = index_load<uint32_t>(p + 4);
+        e.caller_start = index_load<uint32_t>(p + 8);
+        e.caller_end = index_load<uint32_t>(p + 12);
+        e.caller_name = name_at(index_load<uint32_t>(p + 16));
+        out->push_back(e);
+    }
+    return true;
+}
@@ -0,0 +1,188 @@
+
+#include "workspace/java/java_compact.h"
+
+#include "workspace/java/java_lexer.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+
+static bool is_ident_char(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '$' || c >= 0x80;
+}
+
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f';
+}
+
+
+// End of the annotation starting at '@' (name, then an argument list if one
+// follows), or at if it is "@interface".
+static size_t skip_annotation(const char *s, size_t n, size_t at)
+{
+    size_t i = at + 1;
+    for (;;) {
+        size_t b = i;
+        while (i < n && is_ident_char(static_cast<unsigned char>(s[i]))) {
+            i++;
+        }
+        if (i == b) {
+            return at;
+        }
+        if (b == at + 1 && i - b == 9 && std::memcmp(s + b, "interface", 9) == 0) {
+            return at;
+        }
+        if (i + 1 < n && s[i] == '.' && is_ident_char(static_cast<unsigned char>(s[i + 1]))) {
+            i++;
+            continue;
+        }
+        break;
+    }
+
+    size_t k = i;
+    while (k < n && (is_blank(s[k]) || s[k] == '\n')) {
+        k++;
+    }
+    if (k < n && s[k] == '(') {
+        int depth = 0;
+        while (k < n) {
+            size_t j = java_skip_noncode(s, n, k);
+            if (j != k) {
+                k = j;
+                continue;
+            }
+            if (s[k] == '(') {
+                depth++;
+            } else if (s[k] == ')' && --depth == 0) {
+                return k + 1;
+            }
+            k++;
+        }
+        return n;
+    }
+    return i;
+}
+
+
+std::string compact_java(std::string_view text, const CompactOptions &opt)
+{
+    const char *s = text.data();
+    const size_t n = text.size();
+
+    // Pass 1: drop comments and annotations. Multi-line literals (text
+    // blocks) are recorded so pass 2 leaves their lines alone.
+    std::string code;
+    code.reserve(n);
+    std::vector<std::pair<size_t, size_t>> verbatim;
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        if (c == '/' || c == '"' || c == '\'') {
+            size_t j = java_skip_noncode(s, n, i);
+            if (j != i) {
+                if (c == '/' && opt.strip_comments) {
+                    bool block = s[i + 1] == '*';
+                    if (block && !code.empty() && !is_blank(code.back()) && code.back() != '\n' &&
+                        j < n && !is_blank(s[j]) && s[j] != '\n') {
+                        code += ' ';   // a/**/b must not become ab
+                    }
+                } else {
+                    if (c != '/' && std::memchr(s + i, '\n', j - i)) {
+                        verbatim.emplace_back(code.size(), code.size() + (j - i));
+                    }
+                    code.append(s + i, j - i);
+                }
+                i = j;
+                continue;
+            }
+        }
+        if (c == '@' && opt.strip_annotations &&
+            (i == 0 || !is_ident_char(static_cast<unsigned char>(s[i - 1])))) {
+            size_t j = skip_annotation(s, n, i);
+            if (j != i) {
+                while (j < n && is_blank(s[j])) {
+                    j++;
+                }
+                i = j;
+                continue;
+            }
+        }
+        code += c;
+        i++;
+    }
+
+    auto in_verbatim = [&](size_t pos) {
+        for (const auto &r : verbatim) {
+            if (pos > r.first && pos < r.second) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    struct Line
+    {
+        size_t start;
+        size_t body;      // first non-blank byte
+        size_t end;       // '\n' or code.size()
+        size_t width;     // indent columns, tabs count 4
+        bool verbatim;    // starts inside a text block
+    };
+    std::vector<Line> lines;
+    size_t min_width = SIZE_MAX;
+    for (size_t a = 0; a < code.size();) {
+        const void *nl = std::memchr(code.data() + a, '\n', code.size() - a);
+        size_t e = nl ? static_cast<size_t>(static_cast<const char *>(nl) - code.data()) : code.size();
+        Line ln{a, a, e, 0, in_verbatim(a)};
+        while (ln.body < e && is_blank(code[ln.body])) {
+            ln.width += code[ln.body] == '\t' ? 4 : 1;
+            ln.body++;
+        }
+        if (ln.verbatim || ln.body < e) {
+            lines.push_back(ln);
+            if (!ln.verbatim && ln.width < min_width) {
+                min_width = ln.width;
+            }
+        }
+        a = e + 1;
+    }
+
+    size_t unit = 0;
+    for (const Line &ln : lines) {
+        size_t d = ln.verbatim ? 0 : ln.width - min_width;
+        if (d > 0 && (unit == 0 || d < unit)) {
+            unit = d;
+        }
+    }
+
+    // Pass 2: one line per non-blank line, re-indented and trimmed.
+    std::string out;
+    out.reserve(code.size());
+    for (const Line &ln : lines) {
+        if (!out.empty()) {
+            out += '\n';
+        }
+        size_t e = ln.end;
+        if (!in_verbatim(e)) {
+            while (e > ln.body && is_blank(code[e - 1])) {
+                e--;
+            }
+        }
+        if (ln.verbatim) {
+            out.append(code, ln.start, e - ln.start);
+            continue;
+        }
+        if (opt.collapse_indent) {
+            out.append(unit ? (ln.width - min_width + unit / 2) / unit : 0, ' ');
+            out.append(code, ln.body, e - ln.body);
+        } else {
+            out.append(code, ln.start, e - ln.start);
+        }
+    }
+    return out;
+}
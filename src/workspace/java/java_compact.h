@@ -0,0 +1,20 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+
+struct CompactOptions
+{
+    bool strip_comments = true;
+    bool collapse_indent = true;     // dedent, then one space per indent level
+    bool strip_annotations = false;
+};
+
+
+// Shrinks a Java snippet for a prompt: drops comments, blank lines and
+// trailing whitespace, collapses indentation and, on request, removes
+// annotations. String and char literals and text blocks are left exactly as
+// they are; comment and literal boundaries come from java_skip_noncode.
+std::string compact_java(std::string_view src, const CompactOptions &opt);
@@ -0,0 +1,94 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tree_sitter/api.h>
+
+extern "C"
+{
+// from external/tree-sitter-java/src/parser.c
+const TSLanguage *tree_sitter_java(void);
+}
+
+
+// Bits over grammar symbols, so hot loops can test a node with one lookup.
+enum JavaKind : uint8_t
+{
+    JK_CALLABLE   = 1u << 0,   // method_declaration, constructor_declaration
+    JK_TYPE_DECL  = 1u << 1,   // class/interface/enum/record declaration
+    JK_INVOCATION = 1u << 2,   // method_invocation
+
+    JK_PREFERRED  = JK_CALLABLE | JK_TYPE_DECL
+};
+
+
+// Symbol and field ids of tree-sitter-java, resolved once per process.
+// Compare ts_node_symbol() against these instead of strcmp on ts_node_type().
+struct JavaGrammar
+{
+    const TSLanguage *lang = nullptr;
+
+    TSSymbol method_declaration = 0;
+    TSSymbol constructor_declaration = 0;
+    TSSymbol class_declaration = 0;
+    TSSymbol interface_declaration = 0;
+    TSSymbol enum_declaration = 0;
+    TSSymbol record_declaration = 0;
+    TSSymbol method_invocation = 0;
+    TSSymbol identifier = 0;
+    TSSymbol type_identifier = 0;
+    TSSymbol block = 0;
+
+    // type hierarchy
+    TSSymbol superclass = 0;
+    TSSymbol super_interfaces = 0;
+    TSSymbol extends_interfaces = 0;
+    TSSymbol type_list = 0;
+    TSSymbol generic_type = 0;
+    TSSymbol scoped_type_identifier = 0;
+    TSSymbol package_declaration = 0;
+
+    // receiver typing
+    TSSymbol import_declaration = 0;
+    TSSymbol asterisk = 0;
+    TSSymbol field_declaration = 0;
+    TSSymbol local_variable_declaration = 0;
+    TSSymbol formal_parameter = 0;
+    TSSymbol enhanced_for_statement = 0;
+    TSSymbol spread_parameter = 0;
+    TSSymbol variable_declarator = 0;
+    TSSymbol field_access = 0;
+    TSSymbol this_ = 0;
+
+    TSFieldId field_name = 0;
+    TSFieldId field_body = 0;
+    TSFieldId field_member = 0;   // 0 if the grammar has no such field
+    TSFieldId field_object = 0;
+    TSFieldId field_field = 0;
+    TSFieldId field_type = 0;
+    TSFieldId field_declarator = 0;
+    TSFieldId field_parameters = 0;
+
+    // JavaKind bits indexed by symbol
+    std::vector<uint8_t> kinds;
+
+    uint8_t kind_of(TSSymbol s) const
+    {
+        return s < kinds.size() ? kinds[s] : 0;
+    }
+
+    bool is(TSNode n, uint8_t bits) const
+    {
+        return (kind_of(ts_node_symbol(n)) & bits) != 0;
+    }
+};
+
+
+const JavaGrammar &java_grammar();
+
+// Foo, a.b.Foo, Foo<Bar> -> "Foo"; empty for anything else (arrays, primitives).
+std::string_view java_type_simple_name(const JavaGrammar &g, const std::string &src, TSNode type);
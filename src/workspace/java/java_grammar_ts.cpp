@@ -0,0 +1,121 @@
+
+#include "workspace/java/java_grammar.h"
+
+#include <cstdint>
+#include <cstring>
+
+
+static TSSymbol symbol_for(const TSLanguage *lang, const char *name)
+{
+    return ts_language_symbol_for_name(lang, name, static_cast<uint32_t>(std::strlen(name)), true);
+}
+
+
+static TSFieldId field_for(const TSLanguage *lang, const char *name)
+{
+    return ts_language_field_id_for_name(lang, name, static_cast<uint32_t>(std::strlen(name)));
+}
+
+
+static void mark(JavaGrammar &g, TSSymbol s, uint8_t bits)
+{
+    // symbol 0 is "end"; ts_language_symbol_for_name returns it for unknown names
+    if (s == 0 || s >= g.kinds.size()) {
+        return;
+    }
+    g.kinds[s] |= bits;
+}
+
+
+static JavaGrammar resolve_java_grammar()
+{
+    JavaGrammar g;
+    g.lang = tree_sitter_java();
+
+    g.method_declaration      = symbol_for(g.lang, "method_declaration");
+    g.constructor_declaration = symbol_for(g.lang, "constructor_declaration");
+    g.class_declaration       = symbol_for(g.lang, "class_declaration");
+    g.interface_declaration   = symbol_for(g.lang, "interface_declaration");
+    g.enum_declaration        = symbol_for(g.lang, "enum_declaration");
+    g.record_declaration      = symbol_for(g.lang, "record_declaration");
+    g.method_invocation       = symbol_for(g.lang, "method_invocation");
+    g.identifier              = symbol_for(g.lang, "identifier");
+    g.type_identifier         = symbol_for(g.lang, "type_identifier");
+    g.block                   = symbol_for(g.lang, "block");
+
+    g.superclass              = symbol_for(g.lang, "superclass");
+    g.super_interfaces        = symbol_for(g.lang, "super_interfaces");
+    g.extends_interfaces      = symbol_for(g.lang, "extends_interfaces");
+    g.type_list               = symbol_for(g.lang, "type_list");
+    g.generic_type            = symbol_for(g.lang, "generic_type");
+    g.scoped_type_identifier  = symbol_for(g.lang, "scoped_type_identifier");
+    g.package_declaration     = symbol_for(g.lang, "package_declaration");
+
+    g.import_declaration         = symbol_for(g.lang, "import_declaration");
+    g.asterisk                   = symbol_for(g.lang, "asterisk");
+    g.field_declaration          = symbol_for(g.lang, "field_declaration");
+    g.local_variable_declaration = symbol_for(g.lang, "local_variable_declaration");
+    g.formal_parameter           = symbol_for(g.lang, "formal_parameter");
+    g.enhanced_for_statement     = symbol_for(g.lang, "enhanced_for_statement");
+    g.spread_parameter           = symbol_for(g.lang, "spread_parameter");
+    g.variable_declarator        = symbol_for(g.lang, "variable_declarator");
+    g.field_access               = symbol_for(g.lang, "field_access");
+    g.this_                      = symbol_for(g.lang, "this");
+
+    g.field_name   = field_for(g.lang, "name");
+    g.field_body   = field_for(g.lang, "body");
+    g.field_member = field_for(g.lang, "member");
+    g.field_object = field_for(g.lang, "object");
+    g.field_field  = field_for(g.lang, "field");
+    g.field_type   = field_for(g.lang, "type");
+    g.field_declarator = field_for(g.lang, "declarator");
+    g.field_parameters = field_for(g.lang, "parameters");
+
+    g.kinds.assign(ts_language_symbol_count(g.lang), 0);
+
+    mark(g, g.method_declaration, JK_CALLABLE);
+    mark(g, g.constructor_declaration, JK_CALLABLE);
+    mark(g, g.class_declaration, JK_TYPE_DECL);
+    mark(g, g.interface_declaration, JK_TYPE_DECL);
+    mark(g, g.enum_declaration, JK_TYPE_DECL);
+    mark(g, g.record_declaration, JK_TYPE_DECL);
+    mark(g, g.method_invocation, JK_INVOCATION);
+
+    return g;
+}
+
+
+const JavaGrammar &java_grammar()
+{
+    // thread-safe one-time init (C++11 magic statics)
+    static const JavaGrammar g = resolve_java_grammar();
+    return g;
+}
+
+
+std::string_view java_type_simple_name(const JavaGrammar &g, const std::string &src, TSNode t)
+{
+    for (int guard = 0; guard < 16 && !ts_node_is_null(t); guard++) {
+        TSSymbol s = ts_node_symbol(t);
+        if (s == g.type_identifier) {
+            uint32_t a = ts_node_start_byte(t);
+            uint32_t b = ts_node_end_byte(t);
+            if (a >= b || b > src.size()) {
+                break;
+            }
+            return std::string_view(src.data() + a, b - a);
+        }
+        uint32_t n = ts_node_named_child_count(t);
+        if (n == 0) {
+            break;
+        }
+        if (s == g.generic_type) {
+            t = ts_node_named_child(t, 0);
+        } else if (s == g.scoped_type_identifier) {
+            t = ts_node_named_child(t, n - 1);
+        } else {
+            break;
+        }
+    }
+    return {};
+}
@@ -0,0 +1,374 @@
+
+#include "workspace/java/java_lexer.h"
+
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+static bool is_ident_char(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '$' || c >= 0x80;
+}
+
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+
+static bool is_special(char c)
+{
+    switch (c) {
+    case '"': case '\'': case '/': case '{': case '}': case '(': case ')': case ';':
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+// Next byte the scanner has to look at. Everything else (identifiers,
+// operators, whitespace) is skipped 16 bytes at a time where SSE2 exists.
+static size_t next_special(const char *s, size_t n, size_t i)
+{
+#if defined(__SSE2__)
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i sq = _mm_set1_epi8('\'');
+    const __m128i sl = _mm_set1_epi8('/');
+    const __m128i lb = _mm_set1_epi8('{');
+    const __m128i rb = _mm_set1_epi8('}');
+    const __m128i lp = _mm_set1_epi8('(');
+    const __m128i rp = _mm_set1_epi8(')');
+    const __m128i sc = _mm_set1_epi8(';');
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dq), _mm_cmpeq_epi8(v, sq)),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v, sl), _mm_cmpeq_epi8(v, lb))),
+                                 _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, rb), _mm_cmpeq_epi8(v, lp)),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v, rp), _mm_cmpeq_epi8(v, sc))));
+        int mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+        i += 16;
+    }
+#endif
+    for (; i < n; i++) {
+        if (is_special(s[i])) {
+            return i;
+        }
+    }
+    return n;
+}
+
+
+// Body of a string or char literal opened at i; an unescaped newline ends it
+// too, so a stray quote can't swallow the rest of the file.
+static size_t skip_quoted(const char *s, size_t n, size_t i, char q)
+{
+    for (i++; i < n; i++) {
+        if (s[i] == '\\') {
+            i++;
+        } else if (s[i] == q) {
+            return i + 1;
+        } else if (s[i] == '\n') {
+            return i;
+        }
+    }
+    return n;
+}
+
+
+size_t java_skip_noncode(const char *src, size_t n, size_t i)
+{
+    if (i >= n) {
+        return i;
+    }
+    char c = src[i];
+    if (c == '/' && i + 1 < n) {
+        if (src[i + 1] == '/') {
+            const void *nl = std::memchr(src + i + 2, '\n', n - i - 2);
+            return nl ? static_cast<size_t>(static_cast<const char *>(nl) - src) : n;
+        }
+        if (src[i + 1] == '*') {
+            for (size_t j = i + 2; j + 1 < n; j++) {
+                const void *star = std::memchr(src + j, '*', n - j - 1);
+                if (!star) {
+                    break;
+                }
+                j = static_cast<size_t>(static_cast<const char *>(star) - src);
+                if (src[j + 1] == '/') {
+                    return j + 2;
+                }
+            }
+            return n;
+        }
+        return i;
+    }
+    if (c == '"') {
+        if (i + 2 < n && src[i + 1] == '"' && src[i + 2] == '"') {
+            // text block
+            for (size_t j = i + 3; j < n; j++) {
+                if (src[j] == '\\') {
+                    j++;
+                } else if (src[j] == '"' && j + 2 < n && src[j + 1] == '"' && src[j + 2] == '"') {
+                    return j + 3;
+                }
+            }
+            return n;
+        }
+        return skip_quoted(src, n, i, '"');
+    }
+    if (c == '\'') {
+        return skip_quoted(src, n, i, '\'');
+    }
+    return i;
+}
+
+
+// Whitespace and comments, not literals.
+static size_t skip_trivia(const char *s, size_t n, size_t i)
+{
+    for (;;) {
+        while (i < n && is_space(s[i])) {
+            i++;
+        }
+        if (i < n && s[i] == '/') {
+            size_t j = java_skip_noncode(s, n, i);
+            if (j != i) {
+                i = j;
+                continue;
+            }
+        }
+        return i;
+    }
+}
+
+
+// Identifier ending right before end (after trailing whitespace); empty if none.
+static std::string_view word_before(const char *s, size_t lo, size_t end)
+{
+    size_t e = end;
+    while (e > lo && is_space(s[e - 1])) {
+        e--;
+    }
+    size_t b = e;
+    while (b > lo && is_ident_char(static_cast<unsigned char>(s[b - 1]))) {
+        b--;
+    }
+    return std::string_view(s + b, e - b);
+}
+
+
+// Between a parameter list's ')' and the '{' only "throws A, B" may appear.
+static bool is_header_tail(const char *s, size_t from, size_t brace)
+{
+    size_t i = skip_trivia(s, brace, from);
+    if (i == brace) {
+        return true;
+    }
+    if (brace - i < 7 || std::memcmp(s + i, "throws", 6) != 0 || is_ident_char(static_cast<unsigned char>(s[i + 6]))) {
+        return false;
+    }
+    for (i += 6; i < brace; i++) {
+        char c = s[i];
+        if (!is_ident_char(static_cast<unsigned char>(c)) && !is_space(c) &&
+            c != '.' && c != ',' && c != '<' && c != '>' && c != '@') {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool is_control_word(std::string_view w)
+{
+    static const char *const kWords[] = {
+        "if", "for", "while", "switch", "catch", "synchronized", "try", "else", "do", "return", "throw"
+    };
+    for (const char *k : kWords) {
+        if (w == k) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Whether [seg, brace) reads like a type header: class/interface/enum, or
+// record followed by a name. *is_enum tells which.
+static bool is_type_header(const char *s, size_t seg, size_t brace, bool *is_enum)
+{
+    size_t i = seg;
+    while (i < brace) {
+        size_t j = java_skip_noncode(s, brace, i);
+        if (j != i) {
+            i = j;
+            continue;
+        }
+        if (!is_ident_char(static_cast<unsigned char>(s[i]))) {
+            i++;
+            continue;
+        }
+        size_t b = i;
+        while (i < brace && is_ident_char(static_cast<unsigned char>(s[i]))) {
+            i++;
+        }
+        if (b > seg && s[b - 1] == '.') {
+            continue;   // Foo.class
+        }
+        std::string_view w(s + b, i - b);
+        if (w == "class" || w == "interface" || w == "enum") {
+            *is_enum = w == "enum";
+            return true;
+        }
+        if (w == "record") {
+            size_t k = skip_trivia(s, brace, i);
+            if (k < brace && is_ident_char(static_cast<unsigned char>(s[k]))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+namespace {
+
+enum BraceKind { BK_OTHER, BK_TYPE, BK_CALLABLE };
+
+struct Frame
+{
+    BraceKind kind;
+    size_t paren_base;   // paren stack depth when the brace opened
+    int decl;            // index into out for BK_CALLABLE
+    bool enum_consts;    // enum body before its first ';': a '{' here is a constant's class body
+};
+
+} // namespace
+
+
+std::vector<LexedCallable> java_lex_callables(const char *src, size_t n, bool *balanced)
+{
+    std::vector<LexedCallable> out;
+    std::vector<Frame> frames;
+    std::vector<size_t> parens;
+    frames.push_back(Frame{BK_OTHER, 0, -1, false});   // compilation unit
+
+    size_t seg = skip_trivia(src, n, 0);   // first token of the current member/statement
+    size_t last_open = 0;
+    size_t last_close = SIZE_MAX;
+    bool ok = true;
+
+    size_t i = next_special(src, n, 0);
+    while (i < n) {
+        char c = src[i];
+        if (c == '"' || c == '\'' || c == '/') {
+            size_t j = java_skip_noncode(src, n, i);
+            i = next_special(src, n, j == i ? i + 1 : j);
+            continue;
+        }
+
+        if (c == '(') {
+            parens.push_back(i);
+        } else if (c == ')') {
+            if (parens.size() > frames.back().paren_base) {
+                last_open = parens.back();
+                last_close = i;
+                parens.pop_back();
+            }
+        } else if (c == ';') {
+            if (parens.size() == frames.back().paren_base) {
+                frames.back().enum_consts = false;
+                seg = skip_trivia(src, n, i + 1);
+            }
+        } else if (c == '{') {
+            BraceKind kind = BK_OTHER;
+            int decl = -1;
+            bool is_enum = false;
+            bool header = last_close != SIZE_MAX && last_close >= seg && last_close < i &&
+                          is_header_tail(src, last_close + 1, i);
+            if (frames.back().enum_consts && parens.size() == frames.back().paren_base) {
+                kind = BK_TYPE;   // A(1) { ... } or A { ... }
+            } else if (header) {
+                std::string_view name = word_before(src, seg, last_open);
+                size_t name_at = name.empty() ? last_open : static_cast<size_t>(name.data() - src);
+                std::string_view before = word_before(src, seg, name_at);
+                if (last_open > seg && src[last_open - 1] == '>') {
+                    before = std::string_view();   // new Foo<Bar>() {
+                    int depth = 0;
+                    for (size_t k = last_open; k > seg; k--) {
+                        if (src[k - 1] == '>') {
+                            depth++;
+                        } else if (src[k - 1] == '<' && --depth == 0) {
+                            std::string_view t = word_before(src, seg, k - 1);
+                            size_t ta = static_cast<size_t>(t.data() - src);
+                            before = word_before(src, seg, ta);
+                            break;
+                        }
+                    }
+                    kind = before == "new" ? BK_TYPE : BK_OTHER;
+                } else if (before == "new" || before == "record") {
+                    kind = BK_TYPE;
+                } else if (name_at > seg && src[name_at - 1] == '.') {
+                    // new a.b.Foo() {
+                    size_t k = name_at - 1;
+                    while (k > seg && (is_ident_char(static_cast<unsigned char>(src[k - 1])) || src[k - 1] == '.')) {
+                        k--;
+                    }
+                    kind = word_before(src, seg, k) == "new" ? BK_TYPE : BK_OTHER;
+                } else if (frames.back().kind == BK_TYPE && !name.empty() && !is_control_word(name)) {
+                    kind = BK_CALLABLE;
+                    LexedCallable d;
+                    d.start = static_cast<uint32_t>(seg);
+                    d.name = static_cast<uint32_t>(name_at);
+                    d.name_end = static_cast<uint32_t>(name_at + name.size());
+                    d.params = static_cast<uint32_t>(last_open);
+                    d.params_end = static_cast<uint32_t>(last_close + 1);
+                    decl = static_cast<int>(out.size());
+                    out.push_back(d);
+                }
+            } else if (is_type_header(src, seg, i, &is_enum)) {
+                kind = BK_TYPE;
+            }
+            frames.push_back(Frame{kind, parens.size(), decl, is_enum});
+            last_close = SIZE_MAX;
+            seg = skip_trivia(src, n, i + 1);
+        } else if (c == '}') {
+            if (frames.size() > 1) {
+                const Frame &f = frames.back();
+                if (f.decl >= 0) {
+                    out[static_cast<size_t>(f.decl)].end = static_cast<uint32_t>(i + 1);
+                }
+                parens.resize(f.paren_base);
+                frames.pop_back();
+            } else {
+                ok = false;
+            }
+            last_close = SIZE_MAX;
+            seg = skip_trivia(src, n, i + 1);
+        }
+        i = next_special(src, n, i + 1);
+    }
+
+    if (frames.size() != 1) {
+        ok = false;
+        size_t w = 0;
+        for (size_t k = 0; k < out.size(); k++) {
+            if (out[k].end != 0) {
+                out[w++] = out[k];
+            }
+        }
+        out.resize(w);
+    }
+    if (balanced) {
+        *balanced = ok;
+    }
+    return out;
+}
@@ -0,0 +1,31 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Method or constructor with a body, found from the shape of its header and
+// matched braces. Offsets into the scanned buffer.
+struct LexedCallable
+{
+    uint32_t start = 0;        // first modifier/annotation/type token, like the tree-sitter node
+    uint32_t end = 0;          // one past the closing brace
+    uint32_t name = 0;
+    uint32_t name_end = 0;
+    uint32_t params = 0;       // '('
+    uint32_t params_end = 0;   // one past ')'
+};
+
+
+// Structural scan of Java source without a parse. Comments, string and char
+// literals and text blocks are skipped, so braces and parens inside them
+// don't count. Declarations are only recognised directly inside a type body
+// (class, interface, enum, record or anonymous class), which keeps if/for/
+// while blocks out. *balanced is false if braces didn't match up, in which
+// case unterminated declarations are dropped.
+std::vector<LexedCallable> java_lex_callables(const char *src, size_t n, bool *balanced = nullptr);
+
+// Offset just past the comment or literal starting at i, or i if none starts there.
+size_t java_skip_noncode(const char *src, size_t n, size_t i);
@@ -2,15 +2,18 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include "workspace/bloom_index.h"
 #include "workspace/scanner.h"
 
 
 struct ClassLocation
 {
     bool found = false;
+    FileId file_id = kNoFile;
     std::string abs_path;
     std::string rel_path;
     std::string reason;
+    int bloom_skipped = 0;   // candidate files never read because Bloom filters ruled out both checks
 };
 
 
@@ -22,9 +25,8 @@ public:
 };
 
 
-std::unique_ptr<JavaLocator> make_text_java_locator(const std::string &repo_root,
-                                                    const std::vector<FileEntry> &files);
-
-
-std::unique_ptr<JavaLocator> make_text_java_locator(const std::vector<FileEntry> &files);
+// blooms, when bound to files, lets the locator skip reading candidates
+// whose filters prove the package or type name absent.
+std::unique_ptr<JavaLocator> make_text_java_locator(const FileTable &files,
+                                                    const FileBlooms *blooms = nullptr);
 
@@ -5,10 +5,11 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
-static bool ends_with(const std::string &s, const std::string &suffix)
+static bool ends_with(std::string_view s, const std::string &suffix)
 {
     return s.size() >= suffix.size() &&
            std::equal(suffix.rbegin(), suffix.rend(), s.rbegin());
@@ -112,21 +113,38 @@ static bool file_contains_type_decl(const std::string &abs_path, const std::stri
 }
 
 
-static int score_path(const std::string &rel_path)
+// "package a.b.c;" can only be there if every token of it is
+static bool blooms_allow_package(const FileBlooms &blooms, FileId id, const std::string &pkg)
+{
+    if (!blooms.may_contain(id, "package")) {
+        return false;
+    }
+    size_t i = 0;
+    while (i <= pkg.size()) {
+        size_t dot = pkg.find('.', i);
+        if (dot == std::string::npos) {
+            dot = pkg.size();
+        }
+        if (dot > i && !blooms.may_contain(id, std::string_view(pkg).substr(i, dot - i))) {
+            return false;
+        }
+        i = dot + 1;
+    }
+    return true;
+}
+
+
+static int score_path(uint32_t flags)
 {
     int score = 0;
 
-    if (rel_path.find("/src/main/java/") != std::string::npos) {
+    if (flags & FF_MAIN_SRC) {
         score += 50;
     }
-    if (rel_path.find("/src/test/java/") != std::string::npos) {
+    if (flags & FF_TEST_SRC) {
         score += 20;
     }
-
-    if (rel_path.find("/target/") != std::string::npos) {
-        score -= 80;
-    }
-    if (rel_path.find("/build/") != std::string::npos) {
+    if (flags & FF_BUILD_OUTPUT) {
         score -= 80;
     }
 
@@ -138,8 +156,8 @@ class TextJavaLocator final : public JavaLocator
 {
 
 public:
-    TextJavaLocator(const std::vector<FileEntry> &files)
-        : files_(files) {}
+    TextJavaLocator(const FileTable &files, const FileBlooms *blooms)
+        : files_(files), blooms_(blooms && blooms->bound() ? blooms : nullptr) {}
 
     ClassLocation locate_class(const std::string &fqcn) override
     {
@@ -148,20 +166,21 @@ public:
         const std::string simple = class_simple_name(fqcn);
         const std::string pkg = class_package_name(fqcn);
 
-        std::vector<const FileEntry *> candidates;
+        std::vector<FileId> candidates;
         candidates.reserve(8);
 
-        for (const FileEntry &fe : files_) {
-            if (ends_with(fe.rel_path, suffix)) {
-                candidates.push_back(&fe);
+        const FileId n = static_cast<FileId>(files_.size());
+        for (FileId id = 0; id < n; id++) {
+            if (files_.alive(id) && ends_with(files_.rel_path(id), suffix)) {
+                candidates.push_back(id);
             }
         }
 
         if (candidates.empty()) {
             const std::string file_name = simple + ".java";
-            for (const FileEntry &fe : files_) {
-                if (ends_with(fe.rel_path, file_name)) {
-                    candidates.push_back(&fe);
+            for (FileId id = 0; id < n; id++) {
+                if (files_.alive(id) && ends_with(files_.rel_path(id), file_name)) {
+                    candidates.push_back(id);
                 }
             }
         }
@@ -174,7 +193,7 @@ public:
 
         struct Scored
         {
-            const FileEntry *fe = nullptr;
+            FileId id = kNoFile;
             int score = 0;
             bool pkg_ok = false;
             bool decl_ok = false;
@@ -183,13 +202,21 @@ public:
         std::vector<Scored> scored;
         scored.reserve(candidates.size());
 
-        for (const FileEntry *fe : candidates) {
+        for (FileId id : candidates) {
+            const std::string abs = files_.abs_path(id);
             Scored s;
-            s.fe = fe;
-            s.pkg_ok = file_contains_package_line(fe->abs_path, pkg);
-            s.decl_ok = file_contains_type_decl(fe->abs_path, simple);
+            s.id = id;
 
-            s.score = score_path(fe->rel_path);
+            bool may_pkg = !pkg.empty() && (!blooms_ || blooms_allow_package(*blooms_, id, pkg));
+            bool may_decl = !blooms_ || blooms_->may_contain(id, simple);
+            if (!may_pkg && !may_decl) {
+                // neither check below opens the file
+                out.bloom_skipped += 1;
+            }
+            s.pkg_ok = may_pkg && file_contains_package_line(abs, pkg);
+            s.decl_ok = may_decl && file_contains_type_decl(abs, simple);
+
+            s.score = score_path(files_.flags(id));
             if (s.pkg_ok) {
                 s.score += 30;
             }
@@ -209,8 +236,9 @@ public:
         const Scored &best = scored.front();
 
         out.found = true;
-        out.abs_path = best.fe->abs_path;
-        out.rel_path = best.fe->rel_path;
+        out.file_id = best.id;
+        out.abs_path = files_.abs_path(best.id);
+        out.rel_path = std::string(files_.rel_path(best.id));
         out.reason = "best score=" + std::to_string(best.score) +
                      " pkg_ok=" + (best.pkg_ok ? "1" : "0") +
                      " decl_ok=" + (best.decl_ok ? "1" : "0");
@@ -219,14 +247,12 @@ public:
     }
 
 private:
-    // const std::string &repo_root_;
-    const std::vector<FileEntry> &files_;
+    const FileTable &files_;
+    const FileBlooms *blooms_;
 };
 
 
-std::unique_ptr<JavaLocator> make_text_java_locator(const std::vector<FileEntry> &files)
+std::unique_ptr<JavaLocator> make_text_java_locator(const FileTable &files, const FileBlooms *blooms)
 {
-    return std::make_unique<TextJavaLocator>(files);
+    return std::make_unique<TextJavaLocator>(files, blooms);
 }
-
-
@@ -0,0 +1,151 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <tree_sitter/api.h>
+
+
+// Callable declaration derived from a parse; kept up to date across incremental reparses.
+struct JavaDecl
+{
+    std::string name;
+    TSSymbol symbol = 0;   // method_declaration or constructor_declaration
+    uint32_t start = 0;
+    uint32_t end = 0;
+    bool has_body = false;
+};
+
+
+struct ParsedFile
+{
+    bool ok = false;
+    std::string error;
+
+    std::string abs_path;
+    std::string src;
+    TSTree *tree = nullptr;
+
+    // stat() identity of src
+    uint64_t size_bytes = 0;
+    int64_t mtime_ns = 0;
+
+    // refused or timed out by the installed ParseBudget; a cheaper path may still work
+    bool over_budget = false;
+
+    // true if this tree was produced by reparsing the previous one
+    bool incremental = false;
+    // byte ranges (in src) that differ from the previous parse; empty for a fresh parse
+    std::vector<TSRange> changed;
+
+    // callable declarations in source order; only filled by JavaParseCache
+    bool has_decls = false;
+    std::vector<JavaDecl> decls;
+
+    ParsedFile() = default;
+    ParsedFile(const ParsedFile &) = delete;
+    ParsedFile &operator=(const ParsedFile &) = delete;
+    ~ParsedFile();
+};
+
+using ParsedFilePtr = std::shared_ptr<const ParsedFile>;
+
+
+struct ParseCacheStats
+{
+    int hits = 0;
+    int full_parses = 0;
+    int incremental_parses = 0;
+    int unchanged_reloads = 0;   // mtime moved but bytes identical
+    int decls_reused = 0;
+    int decls_rebuilt = 0;
+};
+
+
+// Keeps the last tree per file. When a file changes on disk, the old tree is
+// edited with the changed byte range and handed to the parser, so only the
+// edited region is reparsed and only the decls touching it are re-derived.
+class JavaParseCache
+{
+public:
+    explicit JavaParseCache(size_t max_files = 512);
+    ~JavaParseCache();
+
+    JavaParseCache(const JavaParseCache &) = delete;
+    JavaParseCache &operator=(const JavaParseCache &) = delete;
+
+    // Cached parse if the file is unchanged on disk, otherwise reparse.
+    ParsedFilePtr get(const std::string &abs_path);
+
+    // Re-read and reparse regardless of stat() (e.g. watcher told us so).
+    ParsedFilePtr refresh(const std::string &abs_path);
+
+    void evict(const std::string &abs_path);
+
+    size_t size() const { return files_.size(); }
+    const ParseCacheStats &stats() const { return stats_; }
+
+private:
+    struct Entry
+    {
+        ParsedFilePtr file;
+        uint64_t last_use = 0;
+    };
+
+    ParsedFilePtr load(const std::string &abs_path, Entry *prev);
+    void evict_lru();
+
+    size_t max_files_;
+    uint64_t tick_ = 0;
+    std::unordered_map<std::string, Entry> files_;
+    ParseCacheStats stats_;
+};
+
+
+// Parse a Java file, going through the installed cache if there is one.
+// Never returns null; check ->ok.
+ParsedFilePtr parse_java_file(const std::string &abs_path);
+
+struct ParserPoolStats
+{
+    uint64_t created = 0;   // one per thread that parsed anything
+    uint64_t reused = 0;    // parses that didn't need ts_parser_new
+};
+
+// Parsers are kept per thread and shared by every parse on it, cached or not.
+ParserPoolStats parser_pool_stats();
+
+// One-off parse of an in-memory buffer, bypassing the cache; caller owns the tree.
+TSTree *parse_java_buffer(const char *src, size_t n, std::string *error);
+
+// Limits on tree-sitter work for one run, installed process-wide like the
+// cache. Each parse gets at most per_parse_us (and never more than what is
+// left of total_us); files over max_file_bytes, a stand-in for tree memory,
+// aren't parsed at all. Files refused or timed out once are not retried.
+struct ParseBudget
+{
+    uint64_t per_parse_us = 0;     // 0: no limit
+    uint64_t total_us = 0;         // 0: no limit
+    uint64_t max_file_bytes = 0;   // 0: no limit
+
+    uint64_t spent_us = 0;
+    size_t parses = 0;
+    size_t timed_out = 0;
+    size_t skipped_size = 0;
+    size_t skipped_exhausted = 0;
+    size_t lexer_fallbacks = 0;    // callers that used java_lexer.h instead
+    std::unordered_set<std::string> refused;
+};
+
+void set_parse_budget(ParseBudget *budget);
+ParseBudget *parse_budget();
+
+// Install (or clear with nullptr) the process-wide cache used by parse_java_file.
+void set_java_parse_cache(JavaParseCache *cache);
+JavaParseCache *java_parse_cache();
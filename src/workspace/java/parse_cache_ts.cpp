@@ -0,0 +1,542 @@
+
+#include "workspace/java/parse_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "workspace/java/java_grammar.h"
+#include "workspace/java/ts_alloc.h"
+
+
+static JavaParseCache *g_cache = nullptr;
+
+
+ParsedFile::~ParsedFile()
+{
+    if (tree) {
+        ts_tree_delete(tree);
+    }
+}
+
+
+static bool read_entire_file(const std::string &path, std::string &out)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    in.seekg(0, std::ios::end);
+    std::streamoff n = in.tellg();
+    if (n < 0) {
+        return false;
+    }
+    in.seekg(0, std::ios::beg);
+
+    out.assign(static_cast<size_t>(n), '\0');
+    if (n == 0) {
+        return true;
+    }
+
+    in.read(out.data(), n);
+    return in.good() || in.eof();
+}
+
+
+static bool stat_identity(const std::string &path, uint64_t *size, int64_t *mtime_ns)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    *size = static_cast<uint64_t>(st.st_size);
+    *mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+
+static TSPoint point_at(const std::string &src, size_t off)
+{
+    TSPoint pt{0, 0};
+    const char *p = src.data();
+    const char *e = src.data() + off;
+    while (p < e) {
+        const void *nl = std::memchr(p, '\n', static_cast<size_t>(e - p));
+        if (!nl) {
+            break;
+        }
+        pt.row++;
+        p = static_cast<const char *>(nl) + 1;
+    }
+    pt.column = static_cast<uint32_t>(e - p);
+    return pt;
+}
+
+
+// Single edit covering everything between the common prefix and common suffix.
+static TSInputEdit diff_edit(const std::string &old_src, const std::string &new_src)
+{
+    size_t n = std::min(old_src.size(), new_src.size());
+
+    size_t pre = 0;
+    while (pre < n && old_src[pre] == new_src[pre]) {
+        pre++;
+    }
+
+    size_t suf = 0;
+    while (suf < n - pre &&
+           old_src[old_src.size() - 1 - suf] == new_src[new_src.size() - 1 - suf]) {
+        suf++;
+    }
+
+    TSInputEdit e;
+    e.start_byte = static_cast<uint32_t>(pre);
+    e.old_end_byte = static_cast<uint32_t>(old_src.size() - suf);
+    e.new_end_byte = static_cast<uint32_t>(new_src.size() - suf);
+    e.start_point = point_at(old_src, pre);
+    e.old_end_point = point_at(old_src, e.old_end_byte);
+    e.new_end_point = point_at(new_src, e.new_end_byte);
+    return e;
+}
+
+
+static bool touches(uint32_t a, uint32_t b, const std::vector<TSRange> &ranges)
+{
+    // inclusive so zero-width edits (pure deletions) still hit their enclosing decl
+    for (const TSRange &r : ranges) {
+        if (a <= r.end_byte && r.start_byte <= b) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Collect callable decls; with `only` set, subtrees outside those ranges are skipped.
+static void collect_decls(const JavaGrammar &g,
+                          TSNode root,
+                          const std::string &src,
+                          const std::vector<TSRange> *only,
+                          std::vector<JavaDecl> *out)
+{
+    TSTreeCursor cur = ts_tree_cursor_new(root);
+    for (;;) {
+        TSNode n = ts_tree_cursor_current_node(&cur);
+        uint32_t a = ts_node_start_byte(n);
+        uint32_t b = ts_node_end_byte(n);
+
+        bool descend = !only || touches(a, b, *only);
+        if (descend && g.is(n, JK_CALLABLE)) {
+            JavaDecl d;
+            d.symbol = ts_node_symbol(n);
+            d.start = a;
+            d.end = b;
+            d.has_body = !ts_node_is_null(ts_node_child_by_field_id(n, g.field_body));
+            TSNode name = ts_node_child_by_field_id(n, g.field_name);
+            if (!ts_node_is_null(name)) {
+                uint32_t na = ts_node_start_byte(name);
+                uint32_t nb = ts_node_end_byte(name);
+                if (na <= nb && nb <= src.size()) {
+                    d.name.assign(src.data() + na, nb - na);
+                }
+            }
+            out->push_back(std::move(d));
+        }
+
+        if (descend && ts_tree_cursor_goto_first_child(&cur)) continue;
+        if (ts_tree_cursor_goto_next_sibling(&cur)) continue;
+        bool climbed = false;
+        while (ts_tree_cursor_goto_parent(&cur)) {
+            if (ts_tree_cursor_goto_next_sibling(&cur)) {
+                climbed = true;
+                break;
+            }
+        }
+        if (!climbed) {
+            break;
+        }
+    }
+    ts_tree_cursor_delete(&cur);
+}
+
+
+static void sort_decls(std::vector<JavaDecl> &decls)
+{
+    // source order, enclosing decl before nested ones
+    std::sort(decls.begin(), decls.end(),
+              [](const JavaDecl &a, const JavaDecl &b)
+              {
+                  if (a.start != b.start) return a.start < b.start;
+                  return a.end > b.end;
+              });
+    decls.erase(std::unique(decls.begin(), decls.end(),
+                            [](const JavaDecl &a, const JavaDecl &b)
+                            {
+                                return a.start == b.start && a.end == b.end && a.symbol == b.symbol;
+                            }),
+                decls.end());
+}
+
+
+static TSParser *new_java_parser(std::string *error)
+{
+    TSParser *parser = ts_parser_new();
+    if (!parser) {
+        *error = "ts_parser_new failed";
+        return nullptr;
+    }
+    if (!ts_parser_set_language(parser, java_grammar().lang)) {
+        ts_parser_delete(parser);
+        *error = "ts_parser_set_language(java) failed";
+        return nullptr;
+    }
+    return parser;
+}
+
+
+namespace {
+
+struct PooledParser
+{
+    TSParser *parser = nullptr;
+    ~PooledParser()
+    {
+        if (parser) {
+            ts_parser_delete(parser);
+        }
+    }
+};
+
+thread_local PooledParser t_parser;
+
+std::atomic<uint64_t> g_parsers_created{0};
+std::atomic<uint64_t> g_parser_reuses{0};
+
+} // namespace
+
+
+// The calling thread's parser; every parse on the thread shares it.
+static TSParser *pooled_java_parser(std::string *error)
+{
+    if (t_parser.parser) {
+        g_parser_reuses.fetch_add(1, std::memory_order_relaxed);
+        return t_parser.parser;
+    }
+    t_parser.parser = new_java_parser(error);
+    if (t_parser.parser) {
+        g_parsers_created.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t_parser.parser;
+}
+
+
+ParserPoolStats parser_pool_stats()
+{
+    ParserPoolStats s;
+    s.created = g_parsers_created.load(std::memory_order_relaxed);
+    s.reused = g_parser_reuses.load(std::memory_order_relaxed);
+    return s;
+}
+
+
+static ParseBudget *g_budget = nullptr;
+
+
+// Parse pf->src under the installed budget. Null with pf->error set on
+// failure; pf->over_budget tells a refusal or timeout from a parser error.
+static TSTree *budgeted_parse(TSParser *parser, TSTree *old_tree, ParsedFile *pf)
+{
+    ParseBudget *b = g_budget;
+    uint64_t timeout_us = 0;
+    if (b) {
+        if (b->refused.count(pf->abs_path) != 0) {
+            pf->over_budget = true;
+            pf->error = "over parse budget (earlier in this run)";
+            return nullptr;
+        }
+        if (b->max_file_bytes != 0 && pf->src.size() > b->max_file_bytes) {
+            b->skipped_size += 1;
+            b->refused.insert(pf->abs_path);
+            pf->over_budget = true;
+            pf->error = "file too large for parse budget";
+            return nullptr;
+        }
+        if (b->total_us != 0 && b->spent_us >= b->total_us) {
+            b->skipped_exhausted += 1;
+            pf->over_budget = true;
+            pf->error = "parse budget exhausted";
+            return nullptr;
+        }
+        timeout_us = b->per_parse_us;
+        if (b->total_us != 0) {
+            uint64_t left = b->total_us - b->spent_us;
+            if (timeout_us == 0 || left < timeout_us) {
+                timeout_us = left;
+            }
+        }
+    }
+    // pooled parser: always re-arm, a previous run may have left a limit
+    ts_parser_set_timeout_micros(parser, timeout_us);
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point t0 = clock::now();
+    TSTree *tree = ts_parser_parse_string(parser, old_tree, pf->src.data(),
+                                          static_cast<uint32_t>(pf->src.size()));
+    if (b) {
+        b->parses += 1;
+        b->spent_us += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - t0).count());
+    }
+    if (!tree) {
+        ts_parser_reset(parser);
+        if (timeout_us != 0) {
+            b->timed_out += 1;
+            b->refused.insert(pf->abs_path);
+            pf->over_budget = true;
+            pf->error = "parse timed out";
+        } else {
+            pf->error = "ts_parser_parse_string failed";
+        }
+    }
+    return tree;
+}
+
+
+JavaParseCache::JavaParseCache(size_t max_files)
+    : max_files_(max_files < 1 ? 1 : max_files)
+{
+}
+
+
+JavaParseCache::~JavaParseCache()
+{
+    files_.clear();
+    if (g_cache == this) {
+        g_cache = nullptr;
+    }
+}
+
+
+ParsedFilePtr JavaParseCache::get(const std::string &abs_path)
+{
+    auto it = files_.find(abs_path);
+    if (it != files_.end()) {
+        const ParsedFile &pf = *it->second.file;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (pf.ok && stat_identity(abs_path, &size, &mtime) &&
+            size == pf.size_bytes && mtime == pf.mtime_ns) {
+            stats_.hits += 1;
+            it->second.last_use = ++tick_;
+            return it->second.file;
+        }
+        return load(abs_path, &it->second);
+    }
+    return load(abs_path, nullptr);
+}
+
+
+ParsedFilePtr JavaParseCache::refresh(const std::string &abs_path)
+{
+    auto it = files_.find(abs_path);
+    return load(abs_path, it == files_.end() ? nullptr : &it->second);
+}
+
+
+void JavaParseCache::evict(const std::string &abs_path)
+{
+    files_.erase(abs_path);
+}
+
+
+void JavaParseCache::evict_lru()
+{
+    auto victim = files_.end();
+    for (auto it = files_.begin(); it != files_.end(); ++it) {
+        if (victim == files_.end() || it->second.last_use < victim->second.last_use) {
+            victim = it;
+        }
+    }
+    if (victim != files_.end()) {
+        files_.erase(victim);
+    }
+}
+
+
+ParsedFilePtr JavaParseCache::load(const std::string &abs_path, Entry *prev)
+{
+    auto pf = std::make_shared<ParsedFile>();
+    pf->abs_path = abs_path;
+
+    const ParsedFile *old = (prev && prev->file->ok) ? prev->file.get() : nullptr;
+
+    if (!stat_identity(abs_path, &pf->size_bytes, &pf->mtime_ns) ||
+        !read_entire_file(abs_path, pf->src)) {
+        // gone or unreadable: drop the stale entry too
+        files_.erase(abs_path);
+        pf->error = "failed to read file";
+        return pf;
+    }
+
+    if (old && old->src == pf->src) {
+        // touched but not modified
+        pf->tree = ts_tree_copy(old->tree);
+        pf->has_decls = old->has_decls;
+        pf->decls = old->decls;
+        pf->ok = true;
+        stats_.unchanged_reloads += 1;
+    } else {
+        TSParser *parser = pooled_java_parser(&pf->error);
+        if (!parser) {
+            return pf;
+        }
+
+        TSTree *old_tree = nullptr;
+        TSInputEdit edit{};
+        if (old) {
+            // edit a copy; readers may still hold the previous ParsedFile
+            old_tree = ts_tree_copy(old->tree);
+            edit = diff_edit(old->src, pf->src);
+            ts_tree_edit(old_tree, &edit);
+        }
+
+        pf->tree = budgeted_parse(parser, old_tree, pf.get());
+        if (!pf->tree) {
+            if (old_tree) {
+                ts_tree_delete(old_tree);
+            }
+            return pf;
+        }
+
+        const JavaGrammar &g = java_grammar();
+        if (old_tree) {
+            uint32_t n = 0;
+            TSRange *ranges = ts_tree_get_changed_ranges(old_tree, pf->tree, &n);
+            pf->changed.assign(ranges, ranges + n);
+            ts_alloc_free(ranges);
+            ts_tree_delete(old_tree);
+
+            // token-only edits can leave the tree shape (and so changed ranges) alone
+            TSRange er;
+            er.start_byte = edit.start_byte;
+            er.end_byte = edit.new_end_byte;
+            er.start_point = edit.start_point;
+            er.end_point = edit.new_end_point;
+            pf->changed.push_back(er);
+
+            pf->incremental = true;
+            stats_.incremental_parses += 1;
+
+            // shift decls outside the edit, re-derive the ones it touched
+            int64_t delta = static_cast<int64_t>(edit.new_end_byte) - static_cast<int64_t>(edit.old_end_byte);
+            for (const JavaDecl &d : old->decls) {
+                if (d.end < edit.start_byte) {
+                    pf->decls.push_back(d);
+                } else if (d.start > edit.old_end_byte) {
+                    JavaDecl s = d;
+                    s.start = static_cast<uint32_t>(s.start + delta);
+                    s.end = static_cast<uint32_t>(s.end + delta);
+                    pf->decls.push_back(std::move(s));
+                }
+            }
+            size_t reused = pf->decls.size();
+            collect_decls(g, ts_tree_root_node(pf->tree), pf->src, &pf->changed, &pf->decls);
+            stats_.decls_reused += static_cast<int>(reused);
+            stats_.decls_rebuilt += static_cast<int>(pf->decls.size() - reused);
+            sort_decls(pf->decls);
+        } else {
+            stats_.full_parses += 1;
+            collect_decls(g, ts_tree_root_node(pf->tree), pf->src, nullptr, &pf->decls);
+            stats_.decls_rebuilt += static_cast<int>(pf->decls.size());
+        }
+        pf->has_decls = true;
+        pf->ok = true;
+    }
+
+    if (!prev && files_.size() >= max_files_) {
+        evict_lru();
+    }
+    Entry &e = files_[abs_path];
+    e.file = pf;
+    e.last_use = ++tick_;
+    return pf;
+}
+
+
+ParsedFilePtr parse_java_file(const std::string &abs_path)
+{
+    if (g_cache) {
+        return g_cache->get(abs_path);
+    }
+
+    auto pf = std::make_shared<ParsedFile>();
+    pf->abs_path = abs_path;
+
+    if (!read_entire_file(abs_path, pf->src)) {
+        pf->error = "failed to read file";
+        return pf;
+    }
+
+    TSParser *parser = pooled_java_parser(&pf->error);
+    if (!parser) {
+        return pf;
+    }
+
+    pf->tree = budgeted_parse(parser, nullptr, pf.get());
+    if (!pf->tree) {
+        return pf;
+    }
+
+    pf->size_bytes = pf->src.size();
+    pf->ok = true;
+    return pf;
+}
+
+
+TSTree *parse_java_buffer(const char *src, size_t n, std::string *error)
+{
+    TSParser *parser = pooled_java_parser(error);
+    if (!parser) {
+        return nullptr;
+    }
+    ts_parser_set_timeout_micros(parser, 0);
+    TSTree *tree = ts_parser_parse_string(parser, nullptr, src, static_cast<uint32_t>(n));
+    if (!tree) {
+        ts_parser_reset(parser);
+        *error = "ts_parser_parse_string failed";
+    }
+    return tree;
+}
+
+
+void set_java_parse_cache(JavaParseCache *cache)
+{
+    g_cache = cache;
+}
+
+
+void set_parse_budget(ParseBudget *budget)
+{
+    g_budget = budget;
+}
+
+
+ParseBudget *parse_budget()
+{
+    return g_budget;
+}
+
+
+JavaParseCache *java_parse_cache()
+{
+    return g_cache;
+}
@@ -19,11 +19,18 @@ struct HitSnippet
 
     std::string reason;
     std::string text;
+
+    // text is a class skeleton: start..end is the whole type declaration but
+    // member bodies not containing the hit read "{ ... }"
+    bool skeleton = false;
 };
 
 // given a file and a byte offset (from rg), return the enclosing snippet.
 // Prefers method/constructor nodes; falls back to class, interface, etc.
+// With class_skeleton that fallback keeps the header, fields and member
+// signatures but elides the bodies that don't contain the hit.
 HitSnippet snippet_from_hit(const std::string &abs_path,
                             const std::string &rel_path,
-                            uint64_t hit_byte_offset);
+                            uint64_t hit_byte_offset,
+                            bool class_skeleton = false);
 
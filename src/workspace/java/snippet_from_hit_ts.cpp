@@ -2,109 +2,111 @@
 #include "workspace/java/snippet_from_hit.h"
 
 #include <cstdint>
-#include <cstring>
-#include <fstream>
 #include <string>
 
 #include <tree_sitter/api.h>
 
-extern "C"
+#include "workspace/java/java_grammar.h"
+#include "workspace/java/parse_cache.h"
+
+
+// method/constructor first, else the enclosing class, interface, enum or record
+static bool is_preferred_type(const JavaGrammar &g, TSNode n)
 {
-const TSLanguage *tree_sitter_java(void);
+    return g.is(n, JK_PREFERRED);
 }
 
 
-static bool read_entire_file(const std::string &path, std::string &out)
+static TSNode climb_to_preferred(TSNode n)
 {
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        return false;
-    }
-
-    in.seekg(0, std::ios::end);
-    std::streamoff n = in.tellg();
-    if (n < 0) {
-        return false;
+    const JavaGrammar &g = java_grammar();
+    TSNode cur = n;
+    while (!ts_node_is_null(cur)) {
+        if (is_preferred_type(g, cur)) {
+            return cur;
+        }
+        TSNode parent = ts_node_parent(cur);
+        if (ts_node_is_null(parent)) {
+            break;
+        }
+        cur = parent;
     }
-    in.seekg(0, std::ios::beg);
+    return TSNode{};
+}
 
-    // zero init
-    out.assign(static_cast<size_t>(n), '\0');
-    if (n == 0) {
-        return true;
-    }
 
-    in.read(out.data(), n);
-    return in.good() || in.eof();
-}
+struct Skeleton
+{
+    const JavaGrammar &g;
+    const std::string &src;
+    uint32_t hit;
+    uint32_t pos;       // src copied up to here
+    std::string out;
+};
 
 
-static bool node_type_is(TSNode n, const char *type)
+static bool spans(TSNode n, uint32_t b)
 {
-    const char *t = ts_node_type(n);
-    return t && std::strcmp(t, type) == 0;
+    return ts_node_start_byte(n) <= b && b < ts_node_end_byte(n);
 }
 
 
-static const char *preferred_types[] =
+static void elide(Skeleton *sk, TSNode body)
 {
-    "method_declaration",
-    "constructor_declaration",
-    "class_declaration",
-    "interface_declaration",
-    "enum_declaration",
-    "record_declaration"
-};
+    uint32_t a = ts_node_start_byte(body);
+    sk->out.append(sk->src, sk->pos, a - sk->pos);
+    sk->out += "{ ... }";
+    sk->pos = ts_node_end_byte(body);
+}
 
 
-static bool is_preferred_type(TSNode n)
+// Method and constructor bodies, initializer blocks and lambda bodies are
+// elided unless they hold the hit; nested types are walked the same way.
+static void skeleton_walk(Skeleton *sk, TSNode n)
 {
-    const char *t = ts_node_type(n);
-    if (!t) {
-        return false;
-    }
-
-    for (const char *want : preferred_types) {
-        if (std::strcmp(t, want) == 0) {
-            return true;
+    const JavaGrammar &g = sk->g;
+    if (g.is(n, JK_CALLABLE)) {
+        TSNode body = ts_node_child_by_field_id(n, g.field_body);
+        if (!ts_node_is_null(body) && !spans(body, sk->hit)) {
+            elide(sk, body);
+            return;
         }
+    } else if (ts_node_symbol(n) == g.block && !spans(n, sk->hit)) {
+        elide(sk, n);
+        return;
+    }
+    uint32_t count = ts_node_child_count(n);
+    for (uint32_t i = 0; i < count; i++) {
+        skeleton_walk(sk, ts_node_child(n, i));
     }
-
-    return false;
 }
 
 
-static TSNode climb_to_preferred(TSNode n)
+static std::string skeleton_text(const std::string &src, TSNode decl, uint32_t hit)
 {
-    TSNode cur = n;
-    while (!ts_node_is_null(cur)) {
-        if (is_preferred_type(cur)) {
-            return cur;
-        }
-        TSNode parent = ts_node_parent(cur);
-        if (ts_node_is_null(parent)) {
-            break;
-        }
-        cur = parent;
-    }
-    return TSNode{};
+    Skeleton sk{java_grammar(), src, hit, ts_node_start_byte(decl), std::string()};
+    skeleton_walk(&sk, decl);
+    sk.out.append(src, sk.pos, ts_node_end_byte(decl) - sk.pos);
+    return std::move(sk.out);
 }
 
 
 HitSnippet snippet_from_hit(const std::string &abs_path,
                             const std::string &rel_path,
-                            uint64_t hit_byte_offset)
+                            uint64_t hit_byte_offset,
+                            bool class_skeleton)
 {
     HitSnippet out;
     out.abs_path = abs_path;
     out.rel_path = rel_path;
 
-    std::string src;
-    if (!read_entire_file(abs_path, src)) {
+    ParsedFilePtr pf = parse_java_file(abs_path);
+    if (!pf->ok) {
         out.found = false;
-        out.reason = "failed to read file";
+        out.reason = pf->error;
         return out;
     }
+    const std::string &src = pf->src;
 
     if (hit_byte_offset >= src.size()) {
         out.found = false;
@@ -112,37 +114,13 @@ HitSnippet snippet_from_hit(const std::string &abs_path,
         return out;
     }
 
-    TSParser *parser = ts_parser_new();
-    if (!parser) {
-        out.found = false;
-        out.reason = "ts_parser_new failed";
-        return out;
-    }
-
-    if (!ts_parser_set_language(parser, tree_sitter_java())) {
-        ts_parser_delete(parser);
-        out.found = false;
-        out.reason = "ts_parser_set_language(java) failed";
-        return out;
-    }
-
-    TSTree *tree = ts_parser_parse_string(parser, nullptr, src.data(), static_cast<uint32_t>(src.size()));
-    if (!tree) {
-        ts_parser_delete(parser);
-        out.found = false;
-        out.reason = "ts_parser_parse_string failed";
-        return out;
-    }
-
-    TSNode root = ts_tree_root_node(tree);
+    TSNode root = ts_tree_root_node(pf->tree);
 
     // find the smallest node that spans the byte offset.
     uint32_t b = static_cast<uint32_t>(hit_byte_offset);
     TSNode leaf = ts_node_descendant_for_byte_range(root, b, b);
 
     if (ts_node_is_null(leaf)) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
         out.found = false;
         out.reason = "descendant_for_byte_range returned null";
         return out;
@@ -159,8 +137,6 @@ HitSnippet snippet_from_hit(const std::string &abs_path,
     uint32_t e = ts_node_end_byte(best);
 
     if (a > e || e > src.size()) {
-        ts_tree_delete(tree);
-        ts_parser_delete(parser);
         out.found = false;
         out.reason = "invalid node byte range";
         return out;
@@ -170,11 +146,14 @@ HitSnippet snippet_from_hit(const std::string &abs_path,
     out.kind = ts_node_type(best);
     out.start = static_cast<size_t>(a);
     out.end = static_cast<size_t>(e);
-    out.text = src.substr(out.start, out.end - out.start);
     out.reason = "tree-sitter enclosing node";
+    if (class_skeleton && java_grammar().is(best, JK_TYPE_DECL)) {
+        out.text = skeleton_text(src, best, b);
+        out.skeleton = true;
+    } else {
+        out.text = src.substr(out.start, out.end - out.start);
+    }
 
-    ts_tree_delete(tree);
-    ts_parser_delete(parser);
     return out;
 }
 
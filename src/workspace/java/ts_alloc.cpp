@@ -0,0 +1,213 @@
+
+#include "workspace/java/ts_alloc.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <tree_sitter/api.h>
+
+
+namespace {
+
+constexpr size_t kHeader = alignof(std::max_align_t) < 16 ? 16 : alignof(std::max_align_t);
+constexpr size_t kMinShift = 4;    // 16 bytes
+constexpr size_t kClasses = 9;     // 16 .. 4096
+constexpr size_t kLarge = kClasses;
+constexpr uint32_t kMaxListed = 4096;   // blocks kept per class per thread
+
+// Stored in front of every block.
+struct BlockHeader
+{
+    size_t cls;    // size class, or kLarge
+    size_t cap;    // usable bytes
+};
+static_assert(sizeof(BlockHeader) <= kHeader, "header must fit the alignment gap");
+
+struct FreeNode
+{
+    FreeNode *next;
+};
+
+// Plain data so it stays usable while the thread's destructors run.
+struct FreeLists
+{
+    FreeNode *head[kClasses];
+    uint32_t count[kClasses];
+    bool drained;
+};
+
+thread_local FreeLists t_lists;
+
+struct Drain
+{
+    ~Drain()
+    {
+        for (size_t c = 0; c < kClasses; c++) {
+            while (t_lists.head[c]) {
+                FreeNode *n = t_lists.head[c];
+                t_lists.head[c] = n->next;
+                std::free(n);
+            }
+            t_lists.count[c] = 0;
+        }
+        t_lists.drained = true;
+    }
+};
+
+thread_local Drain t_drain;
+
+std::atomic<uint64_t> g_allocs{0};
+std::atomic<uint64_t> g_pool_hits{0};
+std::atomic<uint64_t> g_frees{0};
+std::atomic<uint64_t> g_pooled_frees{0};
+std::atomic<uint64_t> g_realloc_in_place{0};
+std::atomic<bool> g_installed{false};
+
+} // namespace
+
+
+static size_t size_class(size_t n)
+{
+    size_t cls = 0;
+    size_t cap = size_t(1) << kMinShift;
+    while (cap < n && cls < kClasses) {
+        cap <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+
+static void *user_ptr(void *block)
+{
+    return static_cast<unsigned char *>(block) + kHeader;
+}
+
+
+static BlockHeader *header_of(void *p)
+{
+    return reinterpret_cast<BlockHeader *>(static_cast<unsigned char *>(p) - kHeader);
+}
+
+
+static void *pool_malloc(size_t n)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    size_t cls = size_class(n);
+    if (cls < kClasses && !t_lists.drained) {
+        FreeNode *node = t_lists.head[cls];
+        if (node) {
+            t_lists.head[cls] = node->next;
+            t_lists.count[cls]--;
+            g_pool_hits.fetch_add(1, std::memory_order_relaxed);
+            BlockHeader *h = reinterpret_cast<BlockHeader *>(node);
+            h->cls = cls;
+            h->cap = size_t(1) << (kMinShift + cls);
+            return user_ptr(node);
+        }
+    }
+    size_t cap = cls < kClasses ? size_t(1) << (kMinShift + cls) : n;
+    void *block = std::malloc(kHeader + cap);
+    if (!block) {
+        return nullptr;
+    }
+    BlockHeader *h = static_cast<BlockHeader *>(block);
+    h->cls = cls < kClasses ? cls : kLarge;
+    h->cap = cap;
+    return user_ptr(block);
+}
+
+
+static void pool_free(void *p)
+{
+    if (!p) {
+        return;
+    }
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    BlockHeader *h = header_of(p);
+    size_t cls = h->cls;
+    if (cls < kClasses && !t_lists.drained && t_lists.count[cls] < kMaxListed) {
+        (void)&t_drain;   // registers the thread-exit drain
+        FreeNode *node = reinterpret_cast<FreeNode *>(h);
+        node->next = t_lists.head[cls];
+        t_lists.head[cls] = node;
+        t_lists.count[cls]++;
+        g_pooled_frees.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::free(h);
+}
+
+
+static void *pool_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void *p = pool_malloc(count * size);
+    if (p) {
+        std::memset(p, 0, count * size);
+    }
+    return p;
+}
+
+
+static void *pool_realloc(void *p, size_t n)
+{
+    if (!p) {
+        return pool_malloc(n);
+    }
+    BlockHeader *h = header_of(p);
+    if (n <= h->cap) {
+        g_realloc_in_place.fetch_add(1, std::memory_order_relaxed);
+        return p;
+    }
+    if (h->cls == kLarge) {
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        void *block = std::realloc(h, kHeader + n);
+        if (!block) {
+            return nullptr;
+        }
+        h = static_cast<BlockHeader *>(block);
+        h->cap = n;
+        return user_ptr(block);
+    }
+    void *q = pool_malloc(n);
+    if (!q) {
+        return nullptr;
+    }
+    std::memcpy(q, p, h->cap);
+    pool_free(p);
+    return q;
+}
+
+
+void install_ts_allocator()
+{
+    ts_set_allocator(pool_malloc, pool_calloc, pool_realloc, pool_free);
+    g_installed.store(true, std::memory_order_release);
+}
+
+
+void ts_alloc_free(void *p)
+{
+    if (g_installed.load(std::memory_order_acquire)) {
+        pool_free(p);
+    } else {
+        std::free(p);
+    }
+}
+
+
+TsAllocStats ts_alloc_stats()
+{
+    TsAllocStats s;
+    s.allocs = g_allocs.load(std::memory_order_relaxed);
+    s.pool_hits = g_pool_hits.load(std::memory_order_relaxed);
+    s.frees = g_frees.load(std::memory_order_relaxed);
+    s.pooled_frees = g_pooled_frees.load(std::memory_order_relaxed);
+    s.realloc_in_place = g_realloc_in_place.load(std::memory_order_relaxed);
+    return s;
+}
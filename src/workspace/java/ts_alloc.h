@@ -0,0 +1,28 @@
+
+#pragma once
+
+#include <cstdint>
+
+
+struct TsAllocStats
+{
+    uint64_t allocs = 0;         // malloc/calloc/realloc calls that needed a new block
+    uint64_t pool_hits = 0;      // of those, served from a free list (no malloc)
+    uint64_t frees = 0;
+    uint64_t pooled_frees = 0;   // of those, kept on a free list (no free)
+    uint64_t realloc_in_place = 0;
+};
+
+
+// Routes tree-sitter's allocations through per-thread free lists, one per
+// power-of-two size class up to 4 KiB; bigger blocks go straight to malloc.
+// Trees outlive the parse that built them (the parse cache keeps them), so
+// blocks are recycled rather than reset in bulk. Must run before the first
+// parser or tree is created; main does it.
+void install_ts_allocator();
+
+// Frees memory tree-sitter handed to the caller (ts_tree_get_changed_ranges,
+// ts_node_string, ...) through whichever allocator is installed.
+void ts_alloc_free(void *p);
+
+TsAllocStats ts_alloc_stats();
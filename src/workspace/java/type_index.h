@@ -0,0 +1,152 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "sys/mmap_file.h"
+#include "workspace/file_table.h"
+#include "workspace/index_io.h"
+#include "workspace/java/parse_cache.h"
+
+
+enum TypeKind : uint8_t
+{
+    TK_CLASS     = 0,
+    TK_INTERFACE = 1,
+    TK_ENUM      = 2,
+    TK_RECORD    = 3
+};
+
+const char *type_kind_name(TypeKind k);
+
+
+struct TypeDecl
+{
+    uint32_t id = 0;        // index-local, see TypeIndex::type_at
+    uint32_t file = 0;      // index-local file id, see IndexFileList
+    uint32_t start = 0;
+    uint32_t end = 0;
+    TypeKind kind = TK_CLASS;
+    std::string_view simple;   // views point into the mapped index
+    std::string_view fqcn;     // package + enclosing types + simple, dot separated
+};
+
+
+struct MethodDecl
+{
+    uint32_t file = 0;
+    uint32_t start = 0;
+    uint32_t end = 0;
+    uint32_t type = 0;      // declaring type id
+    std::string_view name;
+    bool has_body = false;
+    bool ctor = false;
+};
+
+
+struct TypeBuildStats
+{
+    size_t files = 0;
+    size_t parse_failed = 0;
+    size_t types = 0;
+    size_t methods = 0;
+    size_t supertypes = 0;   // extends/implements edges
+    uint64_t index_bytes = 0;
+};
+
+
+std::string type_index_path(const std::string &index_dir);
+
+
+// Collects type declarations, their extends/implements lists and the
+// methods each declares. Fed one parsed file at a time by the identifier
+// index build, so the tree-sitter pass is shared.
+class TypeIndexBuilder
+{
+public:
+    // Every live file in table order; pf null (or !ok) when it couldn't be parsed.
+    void add_file(const FileTable &files, FileId id, const ParsedFile *pf);
+
+    bool write(const std::string &out_path, TypeBuildStats *stats, std::string *error);
+
+private:
+    struct Type
+    {
+        uint32_t file, start, end;
+        uint32_t simple, fqcn;   // string ids
+        TypeKind kind;
+    };
+    struct Method
+    {
+        uint32_t file, start, end;
+        uint32_t name;
+        uint32_t type;
+        uint32_t flags;
+    };
+    struct Super
+    {
+        uint32_t name;
+        uint32_t type;
+    };
+
+    uint32_t intern(std::string_view s);
+    void collect(const ParsedFile &pf, uint32_t file);
+    void collect_supers(const std::string &src, TSNode decl, uint32_t type);
+
+    std::string records_;
+    std::string paths_;
+    uint32_t nfiles_ = 0;
+    size_t parse_failed_ = 0;
+
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, uint32_t> string_ids_;
+    std::vector<Type> types_;
+    std::vector<Method> methods_;
+    std::vector<Super> supers_;
+};
+
+
+// Read side, mmap'd. Types, methods and supertype edges are each sorted by
+// name, so every lookup is a binary search plus a contiguous run.
+class TypeIndex
+{
+public:
+    bool open(const std::string &path, std::string *error);
+
+    const IndexFileList &files() const { return files_; }
+    uint32_t type_count() const { return ntypes_; }
+
+    bool type_at(uint32_t id, TypeDecl *out) const;
+    void types_named(std::string_view simple, std::vector<TypeDecl> *out) const;
+
+    // Types that name simple in their extends/implements list.
+    void direct_subtypes(std::string_view simple, std::vector<uint32_t> *out) const;
+
+    void methods_named(std::string_view name, std::vector<MethodDecl> *out) const;
+
+    // Methods named name with a body, declared in types below type (not
+    // type itself), breadth first; stops after visiting max_types types.
+    void implementations(uint32_t type, std::string_view name,
+                         std::vector<MethodDecl> *out, size_t max_types = 256) const;
+
+private:
+    std::string_view str(const unsigned char *rec) const;
+    void name_run(const unsigned char *base, uint32_t count, size_t rec_size, size_t name_at,
+                  std::string_view key, uint32_t *first, uint32_t *last) const;
+
+    MappedFile map_;
+    IndexFileList files_;
+    uint32_t ntypes_ = 0;
+    uint32_t nmethods_ = 0;
+    uint32_t nsupers_ = 0;
+    const unsigned char *strings_ = nullptr;
+    uint64_t strings_size_ = 0;
+    const unsigned char *types_ = nullptr;
+    const unsigned char *methods_ = nullptr;
+    const unsigned char *supers_ = nullptr;
+};
@@ -0,0 +1,539 @@
+
+#include "workspace/java/type_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <tree_sitter/api.h>
+
+#include "workspace/java/java_grammar.h"
+
+
+// On-disk layout:
+//   header   80 bytes
+//   files    IndexFileList records + rel paths
+//   strings  names back to back
+//   types    ntypes x { u32 file, u32 start, u32 end, u32 simple_off, u32 simple_len,
+//                       u32 fqcn_off, u32 fqcn_len, u32 kind }, by simple name
+//   methods  nmethods x { u32 name_off, u32 name_len, u32 file, u32 start, u32 end,
+//                         u32 type, u32 flags }, by name
+//   supers   nsupers x { u32 name_off, u32 name_len, u32 type }, by supertype simple name
+static const char kMagic[8] = {'C', 'G', 'T', 'Y', 'P', '0', '0', '1'};
+
+static constexpr size_t kHeaderSize = 80;
+static constexpr size_t kTypeSize = 32;
+static constexpr size_t kMethodSize = 28;
+static constexpr size_t kSuperSize = 12;
+
+static constexpr uint32_t kMethodHasBody = 1u << 0;
+static constexpr uint32_t kMethodCtor = 1u << 1;
+static constexpr uint32_t kNoType = 0xffffffffu;
+
+
+const char *type_kind_name(TypeKind k)
+{
+    switch (k) {
+    case TK_CLASS: return "class";
+    case TK_INTERFACE: return "interface";
+    case TK_ENUM: return "enum";
+    case TK_RECORD: return "record";
+    }
+    return "class";
+}
+
+
+std::string type_index_path(const std::string &index_dir)
+{
+    return index_dir + "/types.idx";
+}
+
+
+static std::string_view node_text(const std::string &src, TSNode n)
+{
+    uint32_t a = ts_node_start_byte(n);
+    uint32_t b = ts_node_end_byte(n);
+    if (a >= b || b > src.size()) {
+        return {};
+    }
+    return std::string_view(src.data() + a, b - a);
+}
+
+
+static TypeKind type_kind_of(const JavaGrammar &g, TSSymbol s)
+{
+    if (s == g.interface_declaration) return TK_INTERFACE;
+    if (s == g.enum_declaration) return TK_ENUM;
+    if (s == g.record_declaration) return TK_RECORD;
+    return TK_CLASS;
+}
+
+
+uint32_t TypeIndexBuilder::intern(std::string_view s)
+{
+    std::string key(s);
+    auto it = string_ids_.find(key);
+    if (it != string_ids_.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(strings_.size());
+    strings_.push_back(key);
+    string_ids_.emplace(std::move(key), id);
+    return id;
+}
+
+
+void TypeIndexBuilder::collect_supers(const std::string &src, TSNode decl, uint32_t type)
+{
+    const JavaGrammar &g = java_grammar();
+    uint32_t n = ts_node_named_child_count(decl);
+    for (uint32_t i = 0; i < n; i++) {
+        TSNode c = ts_node_named_child(decl, i);
+        TSSymbol s = ts_node_symbol(c);
+        if (s != g.superclass && s != g.super_interfaces && s != g.extends_interfaces) {
+            continue;
+        }
+        uint32_t m = ts_node_named_child_count(c);
+        for (uint32_t j = 0; j < m; j++) {
+            TSNode t = ts_node_named_child(c, j);
+            if (ts_node_symbol(t) == g.type_list) {
+                uint32_t k = ts_node_named_child_count(t);
+                for (uint32_t x = 0; x < k; x++) {
+                    std::string_view name = java_type_simple_name(g, src, ts_node_named_child(t, x));
+                    if (!name.empty()) {
+                        supers_.push_back(Super{intern(name), type});
+                    }
+                }
+            } else {
+                std::string_view name = java_type_simple_name(g, src, t);
+                if (!name.empty()) {
+                    supers_.push_back(Super{intern(name), type});
+                }
+            }
+        }
+    }
+}
+
+
+void TypeIndexBuilder::collect(const ParsedFile &pf, uint32_t file)
+{
+    const JavaGrammar &g = java_grammar();
+    const std::string &src = pf.src;
+    TSNode root = ts_tree_root_node(pf.tree);
+
+    std::string pkg;
+    uint32_t nroot = ts_node_named_child_count(root);
+    for (uint32_t i = 0; i < nroot; i++) {
+        TSNode c = ts_node_named_child(root, i);
+        if (ts_node_symbol(c) == g.package_declaration && ts_node_named_child_count(c) > 0) {
+            // skip leading annotations
+            TSNode name = ts_node_named_child(c, ts_node_named_child_count(c) - 1);
+            pkg = std::string(node_text(src, name));
+            break;
+        }
+    }
+
+    // innermost enclosing type or callable; methods count only directly inside a type,
+    // so anonymous classes in method bodies don't leak theirs onto the outer type
+    struct Scope
+    {
+        size_t depth;
+        uint32_t type;   // kNoType for a callable
+        std::string fqcn;
+    };
+    std::vector<Scope> scopes;
+    size_t depth = 0;
+
+    TSTreeCursor c = ts_tree_cursor_new(root);
+    for (;;) {
+        TSNode n = ts_tree_cursor_current_node(&c);
+        uint8_t kind = g.kind_of(ts_node_symbol(n));
+        bool opens = false;
+        Scope scope{0, kNoType, std::string()};
+
+        if (kind & JK_TYPE_DECL) {
+            TSNode name = ts_node_child_by_field_id(n, g.field_name);
+            std::string_view simple = ts_node_is_null(name) ? std::string_view() : node_text(src, name);
+            if (!simple.empty()) {
+                std::string outer = scopes.empty() ? pkg : scopes.back().fqcn;
+                std::string fqcn = outer.empty() ? std::string(simple) : outer + "." + std::string(simple);
+                uint32_t id = static_cast<uint32_t>(types_.size());
+                types_.push_back(Type{file, ts_node_start_byte(n), ts_node_end_byte(n),
+                                      intern(simple), intern(fqcn), type_kind_of(g, ts_node_symbol(n))});
+                collect_supers(src, n, id);
+                opens = true;
+                scope = Scope{0, id, std::move(fqcn)};
+            }
+        } else if (kind & JK_CALLABLE) {
+            if (!scopes.empty() && scopes.back().type != kNoType) {
+                TSNode name = ts_node_child_by_field_id(n, g.field_name);
+                std::string_view mname = ts_node_is_null(name) ? std::string_view() : node_text(src, name);
+                if (!mname.empty()) {
+                    uint32_t flags = 0;
+                    if (!ts_node_is_null(ts_node_child_by_field_id(n, g.field_body))) {
+                        flags |= kMethodHasBody;
+                    }
+                    if (ts_node_symbol(n) == g.constructor_declaration) {
+                        flags |= kMethodCtor;
+                    }
+                    methods_.push_back(Method{file, ts_node_start_byte(n), ts_node_end_byte(n),
+                                              intern(mname), scopes.back().type, flags});
+                }
+            }
+            opens = true;
+            scope = Scope{0, kNoType, scopes.empty() ? pkg : scopes.back().fqcn};
+        }
+
+        if (ts_tree_cursor_goto_first_child(&c)) {
+            depth++;
+            if (opens) {
+                scope.depth = depth;
+                scopes.push_back(std::move(scope));
+            }
+            continue;
+        }
+
+        bool done = false;
+        while (!ts_tree_cursor_goto_next_sibling(&c)) {
+            if (!ts_tree_cursor_goto_parent(&c)) {
+                done = true;
+                break;
+            }
+            if (!scopes.empty() && scopes.back().depth == depth) {
+                scopes.pop_back();
+            }
+            depth--;
+        }
+        if (done) {
+            break;
+        }
+    }
+    ts_tree_cursor_delete(&c);
+}
+
+
+void TypeIndexBuilder::add_file(const FileTable &files, FileId id, const ParsedFile *pf)
+{
+    bool usable = pf && pf->ok && pf->src.size() <= 0xffffffffu;
+    IndexFileList::append(files, id, usable, &records_, &paths_);
+    uint32_t file = nfiles_++;
+    if (!usable) {
+        parse_failed_ += 1;
+        return;
+    }
+    collect(*pf, file);
+}
+
+
+bool TypeIndexBuilder::write(const std::string &out_path, TypeBuildStats *stats, std::string *error)
+{
+    TypeBuildStats st;
+    st.files = nfiles_;
+    st.parse_failed = parse_failed_;
+    st.types = types_.size();
+    st.methods = methods_.size();
+    st.supertypes = supers_.size();
+
+    std::string out;
+    out.resize(kHeaderSize, '\0');
+    size_t files_off = out.size();
+    out += records_;
+    size_t paths_off = out.size();
+    out += paths_;
+
+    size_t strings_off = out.size();
+    std::vector<uint32_t> str_off(strings_.size());
+    for (size_t i = 0; i < strings_.size(); i++) {
+        str_off[i] = static_cast<uint32_t>(out.size() - strings_off);
+        out += strings_[i];
+    }
+    size_t strings_size = out.size() - strings_off;
+    index_pad8(&out);
+
+    auto by_name = [this](uint32_t a, uint32_t b)
+    {
+        return strings_[a] < strings_[b];
+    };
+
+    // types sorted by simple name; remap ids for methods and supers
+    std::vector<uint32_t> order(types_.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return by_name(types_[a].simple, types_[b].simple); });
+    std::vector<uint32_t> new_id(types_.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        new_id[order[i]] = i;
+    }
+
+    size_t types_off = out.size();
+    for (uint32_t i : order) {
+        const Type &t = types_[i];
+        index_store<uint32_t>(&out, t.file);
+        index_store<uint32_t>(&out, t.start);
+        index_store<uint32_t>(&out, t.end);
+        index_store<uint32_t>(&out, str_off[t.simple]);
+        index_store<uint32_t>(&out, static_cast<uint32_t>(strings_[t.simple].size()));
+        index_store<uint32_t>(&out, str_off[t.fqcn]);
+        index_store<uint32_t>(&out, static_cast<uint32_t>(strings_[t.fqcn].size()));
+        index_store<uint32_t>(&out, t.kind);
+    }
+
+    std::stable_sort(methods_.begin(), methods_.end(),
+                     [&](const Method &a, const Method &b) { return by_name(a.name, b.name); });
+    size_t methods_off = out.size();
+    for (const Method &m : methods_) {
+        index_store<uint32_t>(&out, str_off[m.name]);
+        index_store<uint32_t>(&out, static_cast<uint32_t>(strings_[m.name].size()));
+        index_store<uint32_t>(&out, m.file);
+        index_store<uint32_t>(&out, m.start);
+        index_store<uint32_t>(&out, m.end);
+        index_store<uint32_t>(&out, new_id[m.type]);
+        index_store<uint32_t>(&out, m.flags);
+    }
+
+    std::stable_sort(supers_.begin(), supers_.end(),
+                     [&](const Super &a, const Super &b) { return by_name(a.name, b.name); });
+    size_t supers_off = out.size();
+    for (const Super &s : supers_) {
+        index_store<uint32_t>(&out, str_off[s.name]);
+        index_store<uint32_t>(&out, static_cast<uint32_t>(strings_[s.name].size()));
+        index_store<uint32_t>(&out, new_id[s.type]);
+    }
+
+    std::memcpy(&out[0], kMagic, sizeof(kMagic));
+    index_store_at<uint32_t>(&out, 8, nfiles_);
+    index_store_at<uint32_t>(&out, 12, static_cast<uint32_t>(types_.size()));
+    index_store_at<uint32_t>(&out, 16, static_cast<uint32_t>(methods_.size()));
+    index_store_at<uint32_t>(&out, 20, static_cast<uint32_t>(supers_.size()));
+    index_store_at<uint64_t>(&out, 24, files_off);
+    index_store_at<uint64_t>(&out, 32, paths_off);
+    index_store_at<uint64_t>(&out, 40, strings_off);
+    index_store_at<uint64_t>(&out, 48, strings_size);
+    index_store_at<uint64_t>(&out, 56, types_off);
+    index_store_at<uint64_t>(&out, 64, methods_off);
+    index_store_at<uint64_t>(&out, 72, supers_off);
+    st.index_bytes = out.size();
+
+    if (!write_file_atomic(out_path, out, error)) {
+        return false;
+    }
+    if (stats) {
+        *stats = st;
+    }
+    return true;
+}
+
+
+bool TypeIndex::open(const std::string &path, std::string *error)
+{
+    if (!map_.open(path)) {
+        *error = "open(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+    const unsigned char *base = map_.data();
+    size_t size = map_.size();
+
+    if (size < kHeaderSize || std::memcmp(base, kMagic, sizeof(kMagic)) != 0) {
+        *error = "not a type index: " + path;
+        map_.close();
+        return false;
+    }
+
+    uint32_t nfiles = index_load<uint32_t>(base + 8);
+    ntypes_ = index_load<uint32_t>(base + 12);
+    nmethods_ = index_load<uint32_t>(base + 16);
+    nsupers_ = index_load<uint32_t>(base + 20);
+    uint64_t files_off = index_load<uint64_t>(base + 24);
+    uint64_t paths_off = index_load<uint64_t>(base + 32);
+    uint64_t strings_off = index_load<uint64_t>(base + 40);
+    strings_size_ = index_load<uint64_t>(base + 48);
+    uint64_t types_off = index_load<uint64_t>(base + 56);
+    uint64_t methods_off = index_load<uint64_t>(base + 64);
+    uint64_t supers_off = index_load<uint64_t>(base + 72);
+
+    bool ok = files_off == kHeaderSize &&
+              paths_off == files_off + static_cast<uint64_t>(nfiles) * IndexFileList::kRecordSize &&
+              paths_off <= strings_off && strings_off + strings_size_ <= types_off &&
+              methods_off == types_off + static_cast<uint64_t>(ntypes_) * kTypeSize &&
+              supers_off == methods_off + static_cast<uint64_t>(nmethods_) * kMethodSize &&
+              supers_off + static_cast<uint64_t>(nsupers_) * kSuperSize == size;
+    if (!ok) {
+        *error = "corrupt type index: " + path;
+        map_.close();
+        return false;
+    }
+
+    files_.init(base + files_off, base + paths_off, nfiles);
+    strings_ = base + strings_off;
+    types_ = base + types_off;
+    methods_ = base + methods_off;
+    supers_ = base + supers_off;
+    return true;
+}
+
+
+// rec points at a (u32 off, u32 len) pair
+std::string_view TypeIndex::str(const unsigned char *rec) const
+{
+    uint32_t off = index_load<uint32_t>(rec);
+    uint32_t len = index_load<uint32_t>(rec + 4);
+    if (static_cast<uint64_t>(off) + len > strings_size_) {
+        return {};
+    }
+    return std::string_view(reinterpret_cast<const char *>(strings_) + off, len);
+}
+
+
+// [first, last) of the count records at base whose name pair (name_at
+// bytes into each) equals key
+void TypeIndex::name_run(const unsigned char *base, uint32_t count, size_t rec_size, size_t name_at,
+                         std::string_view key, uint32_t *first, uint32_t *last) const
+{
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (str(base + static_cast<size_t>(mid) * rec_size + name_at) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *first = lo;
+    hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (str(base + static_cast<size_t>(mid) * rec_size + name_at) <= key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *last = lo;
+}
+
+
+bool TypeIndex::type_at(uint32_t id, TypeDecl *out) const
+{
+    if (!map_ || id >= ntypes_) {
+        return false;
+    }
+    const unsigned char *p = types_ + static_cast<size_t>(id) * kTypeSize;
+    out->id = id;
+    out->file = index_load<uint32_t>(p);
+    out->start = index_load<uint32_t>(p + 4);
+    out->end = index_load<uint32_t>(p + 8);
+    out->simple = str(p + 12);
+    out->fqcn = str(p + 20);
+    out->kind = static_cast<TypeKind>(index_load<uint32_t>(p + 28));
+    return true;
+}
+
+
+void TypeIndex::types_named(std::string_view simple, std::vector<TypeDecl> *out) const
+{
+    out->clear();
+    if (!map_) {
+        return;
+    }
+    uint32_t first = 0;
+    uint32_t last = 0;
+    name_run(types_, ntypes_, kTypeSize, 12, simple, &first, &last);
+    for (uint32_t i = first; i < last; i++) {
+        TypeDecl t;
+        type_at(i, &t);
+        out->push_back(t);
+    }
+}
+
+
+void TypeIndex::direct_subtypes(std::string_view simple, std::vector<uint32_t> *out) const
+{
+    out->clear();
+    if (!map_) {
+        return;
+    }
+    uint32_t first = 0;
+    uint32_t last = 0;
+    name_run(supers_, nsupers_, kSuperSize, 0, simple, &first, &last);
+    for (uint32_t i = first; i < last; i++) {
+        out->push_back(index_load<uint32_t>(supers_ + static_cast<size_t>(i) * kSuperSize + 8));
+    }
+}
+
+
+void TypeIndex::methods_named(std::string_view name, std::vector<MethodDecl> *out) const
+{
+    out->clear();
+    if (!map_) {
+        return;
+    }
+    uint32_t first = 0;
+    uint32_t last = 0;
+    name_run(methods_, nmethods_, kMethodSize, 0, name, &first, &last);
+    for (uint32_t i = first; i < last; i++) {
+        const unsigned char *p = methods_ + static_cast<size_t>(i) * kMethodSize;
+        MethodDecl m;
+        m.name = str(p);
+        m.file = index_load<uint32_t>(p + 8);
+        m.start = index_load<uint32_t>(p + 12);
+        m.end = index_load<uint32_t>(p + 16);
+        m.type = index_load<uint32_t>(p + 20);
+        uint32_t flags = index_load<uint32_t>(p + 24);
+        m.has_body = (flags & kMethodHasBody) != 0;
+        m.ctor = (flags & kMethodCtor) != 0;
+        out->push_back(m);
+    }
+}
+
+
+void TypeIndex::implementations(uint32_t type, std::string_view name,
+                                std::vector<MethodDecl> *out, size_t max_types) const
+{
+    out->clear();
+    TypeDecl root;
+    if (!type_at(type, &root)) {
+        return;
+    }
+
+    // subtypes are known by simple name only, so same-named types in other
+    // packages are followed too; callers rank, they don't trust this blindly
+    std::unordered_set<uint32_t> below;
+    std::deque<std::string_view> queue;
+    std::unordered_set<std::string_view> queued;
+    queue.push_back(root.simple);
+    queued.insert(root.simple);
+    std::vector<uint32_t> subs;
+    while (!queue.empty() && below.size() < max_types) {
+        std::string_view s = queue.front();
+        queue.pop_front();
+        direct_subtypes(s, &subs);
+        for (uint32_t t : subs) {
+            if (t == type || !below.insert(t).second) {
+                continue;
+            }
+            TypeDecl td;
+            if (type_at(t, &td) && queued.insert(td.simple).second) {
+                queue.push_back(td.simple);
+            }
+        }
+    }
+    if (below.empty()) {
+        return;
+    }
+
+    std::vector<MethodDecl> all;
+    methods_named(name, &all);
+    for (const MethodDecl &m : all) {
+        if (m.has_body && below.count(m.type)) {
+            out->push_back(m);
+        }
+    }
+}
+
@@ -0,0 +1,290 @@
+
+#include "workspace/pack_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "workspace/index_io.h"
+
+
+// On-disk layout (host byte order, see index_io.h):
+//   magic     8 bytes
+//   files     u32 count, then { u64 size, i64 mtime, u64 hash, str rel }
+//   pack      u32 anchor file (index into files, or ~0), u32 hops_used, str token_counter
+//   snippets  u32 count, then { u32 file, u64 start, u64 end, i32 score, i32 hop,
+//                               i32 tokens, u8 skeleton, str kind, str symbol, str text }
+// where str is u32 length + bytes.
+static const char kMagic[8] = {'C', 'G', 'P', 'A', 'C', 'K', '0', '1'};
+
+static constexpr uint32_t kNoIndex = 0xffffffffu;
+
+
+static uint64_t hash_bytes(std::string_view s, uint64_t h = 1469598103934665603ull)
+{
+    // FNV-1a
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+static void store_str(std::string *out, std::string_view s)
+{
+    index_store<uint32_t>(out, static_cast<uint32_t>(s.size()));
+    out->append(s.data(), s.size());
+}
+
+
+// "size:mtime" of path, or "-" when it can't be stat'ed.
+static std::string file_stamp(const std::string &path)
+{
+    struct stat st;
+    if (path.empty() || ::stat(path.c_str(), &st) != 0) {
+        return "-";
+    }
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return std::to_string(static_cast<uint64_t>(st.st_size)) + ':' + std::to_string(mtime_ns);
+}
+
+
+namespace {
+
+// Bounds-checked cursor over a cache file; ok goes false on truncation.
+struct Reader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    bool ok = true;
+
+    template <typename T>
+    T get()
+    {
+        if (!ok || static_cast<size_t>(end - p) < sizeof(T)) {
+            ok = false;
+            return T();
+        }
+        T v = index_load<T>(p);
+        p += sizeof(T);
+        return v;
+    }
+
+    std::string str()
+    {
+        uint32_t n = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - p) < n) {
+            ok = false;
+            return std::string();
+        }
+        std::string s(reinterpret_cast<const char *>(p), n);
+        p += n;
+        return s;
+    }
+};
+
+} // namespace
+
+
+std::string pack_cache_path(const std::string &dir,
+                            const ContextRequest &req,
+                            const ContextOptions &opt,
+                            const WorkspaceIndex *index)
+{
+    // every field that changes what build_context_pack returns, except deadline_ms
+    // (packs cut short by it are not stored)
+    std::string k;
+    k += std::string(kMagic, sizeof(kMagic)) + '\n';
+    k += req.repo_root + '\n' + req.anchor_class_fqcn + '\n' + req.anchor_method + '\n';
+    for (const std::string &g : req.globs) {
+        k += "g:" + g + '\n';
+    }
+    for (const std::string &x : req.excludes) {
+        k += "x:" + x + '\n';
+    }
+    const int nums[] = {
+        opt.max_hops, opt.max_snippets, opt.max_bytes, opt.max_tokens,
+        opt.max_symbols_per_method, opt.max_rg_hits_per_symbol, opt.max_snippets_per_symbol,
+        opt.max_callers, opt.include_anchor_in_snippets, opt.compact_snippets, opt.strip_annotations,
+        opt.class_skeletons, opt.parse_timeout_ms, opt.parse_budget_ms, opt.max_parse_bytes,
+        index && index->has_trigrams, index && index->has_idents,
+        index && index->has_blooms, index && index->has_types,
+    };
+    for (int v : nums) {
+        k += std::to_string(v) + ',';
+    }
+    k += '\n' + opt.token_vocab + ' ' + file_stamp(opt.token_vocab) + '\n';
+    if (index) {
+        // a rebuilt index can find different snippets for unchanged files
+        const std::pair<bool, std::string> parts[] = {
+            {index->has_trigrams, trigram_index_path(index->dir)},
+            {index->has_idents, ident_index_path(index->dir)},
+            {index->has_blooms, bloom_index_path(index->dir)},
+            {index->has_types, type_index_path(index->dir)},
+        };
+        for (const auto &p : parts) {
+            k += (p.first ? file_stamp(p.second) : std::string("-")) + ',';
+        }
+        k += '\n';
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash_bytes(k)));
+    return dir + "/packs/" + hex + ".pack";
+}
+
+
+bool load_cached_pack(const std::string &path,
+                      const FileTable &files,
+                      ContextPack *pack,
+                      std::string *why)
+{
+    std::string bytes;
+    if (!read_file_bytes(path, &bytes)) {
+        *why = "miss";
+        return false;
+    }
+    Reader r{reinterpret_cast<const unsigned char *>(bytes.data()),
+             reinterpret_cast<const unsigned char *>(bytes.data()) + bytes.size()};
+    if (bytes.size() < sizeof(kMagic) || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0) {
+        *why = "corrupt";
+        return false;
+    }
+    r.p += sizeof(kMagic);
+
+    // Validate every involved file before decoding the snippets.
+    uint32_t nfiles = r.get<uint32_t>();
+    std::vector<FileId> ids;
+    std::string content;
+    int rehashed = 0;
+    for (uint32_t i = 0; i < nfiles && r.ok; i++) {
+        uint64_t size = r.get<uint64_t>();
+        int64_t mtime = r.get<int64_t>();
+        uint64_t hash = r.get<uint64_t>();
+        std::string rel = r.str();
+        if (!r.ok) {
+            break;
+        }
+        FileId id = files.find_rel(rel);
+        if (id == kNoFile || files.size_bytes(id) != size) {
+            *why = "stale";
+            return false;
+        }
+        if (files.mtime(id) != mtime) {
+            // touched, maybe not edited
+            if (!read_file_bytes(files.abs_path(id), &content) || hash_bytes(content) != hash) {
+                *why = "stale";
+                return false;
+            }
+            rehashed += 1;
+        }
+        ids.push_back(id);
+    }
+
+    ContextPack out;
+    uint32_t anchor = r.get<uint32_t>();
+    out.anchor_file = anchor < ids.size() ? ids[anchor] : kNoFile;
+    out.stats.hops_used = static_cast<int>(r.get<uint32_t>());
+    out.stats.token_counter = r.str();
+    uint32_t nsnips = r.get<uint32_t>();
+    for (uint32_t i = 0; i < nsnips && r.ok; i++) {
+        ContextSnippet s;
+        uint32_t f = r.get<uint32_t>();
+        s.start = static_cast<size_t>(r.get<uint64_t>());
+        s.end = static_cast<size_t>(r.get<uint64_t>());
+        s.score = r.get<int32_t>();
+        s.hop = r.get<int32_t>();
+        s.tokens = r.get<int32_t>();
+        s.skeleton = r.get<uint8_t>() != 0;
+        s.kind = r.str();
+        s.symbol = r.str();
+        s.text = r.str();
+        if (f >= ids.size()) {
+            r.ok = false;
+            break;
+        }
+        s.file_id = ids[f];
+        s.rel_path = std::string(files.rel_path(s.file_id));
+        s.abs_path = files.abs_path(s.file_id);
+
+        out.stats.snippets_written += 1;
+        out.stats.bytes_written += static_cast<int>(s.text.size());
+        out.stats.tokens_written += s.tokens;
+        out.stats.skeletons += s.skeleton ? 1 : 0;
+        out.snippets.push_back(std::move(s));
+    }
+    if (!r.ok) {
+        *why = "corrupt";
+        return false;
+    }
+
+    out.stats.pack_cache = "hit";
+    out.stats.pack_cache_files = static_cast<int>(nfiles);
+    out.stats.pack_cache_rehashed = rehashed;
+    *pack = std::move(out);
+    return true;
+}
+
+
+bool store_cached_pack(const std::string &path,
+                       const FileTable &files,
+                       const ContextPack &pack,
+                       std::string *error)
+{
+    std::vector<FileId> involved;
+    std::unordered_map<FileId, uint32_t> slot;
+    auto involve = [&](FileId id) {
+        auto ins = slot.emplace(id, static_cast<uint32_t>(involved.size()));
+        if (ins.second) {
+            involved.push_back(id);
+        }
+        return ins.first->second;
+    };
+    uint32_t anchor = pack.anchor_file == kNoFile ? kNoIndex : involve(pack.anchor_file);
+    std::vector<uint32_t> snip_slots;
+    for (const ContextSnippet &s : pack.snippets) {
+        snip_slots.push_back(involve(s.file_id));
+    }
+
+    std::string out;
+    out.append(kMagic, sizeof(kMagic));
+    index_store<uint32_t>(&out, static_cast<uint32_t>(involved.size()));
+    std::string content;
+    for (FileId id : involved) {
+        if (!read_file_bytes(files.abs_path(id), &content)) {
+            *error = "read " + files.abs_path(id);
+            return false;
+        }
+        index_store<uint64_t>(&out, files.size_bytes(id));
+        index_store<int64_t>(&out, files.mtime(id));
+        index_store<uint64_t>(&out, hash_bytes(content));
+        store_str(&out, files.rel_path(id));
+    }
+
+    index_store<uint32_t>(&out, anchor);
+    index_store<uint32_t>(&out, static_cast<uint32_t>(pack.stats.hops_used));
+    store_str(&out, pack.stats.token_counter);
+    index_store<uint32_t>(&out, static_cast<uint32_t>(pack.snippets.size()));
+    for (size_t i = 0; i < pack.snippets.size(); i++) {
+        const ContextSnippet &s = pack.snippets[i];
+        index_store<uint32_t>(&out, snip_slots[i]);
+        index_store<uint64_t>(&out, s.start);
+        index_store<uint64_t>(&out, s.end);
+        index_store<int32_t>(&out, s.score);
+        index_store<int32_t>(&out, s.hop);
+        index_store<int32_t>(&out, s.tokens);
+        index_store<uint8_t>(&out, s.skeleton ? 1 : 0);
+        store_str(&out, s.kind);
+        store_str(&out, s.symbol);
+        store_str(&out, s.text);
+    }
+
+    return write_file_atomic(path, out, error);
+}
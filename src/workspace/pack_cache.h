@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include <string>
+
+#include "workspace/context_builder.h"
+
+
+// Context packs saved on disk, one file per request and option set, with the
+// size, mtime and content hash of every file they were built from (the
+// anchor's and each snippet's). A saved pack is reused while those files are
+// unchanged; files whose mtime moved but whose bytes hash the same still
+// count as unchanged. Files that were not involved are not checked, so a new
+// caller or callee elsewhere is only picked up once an involved file changes
+// or the cache is bypassed.
+
+// Cache file name for req/opt under dir. The size and mtime of each open
+// index part and of the token vocab are part of the key, since rebuilding
+// either changes which snippets are found or how they are counted.
+std::string pack_cache_path(const std::string &dir,
+                            const ContextRequest &req,
+                            const ContextOptions &opt,
+                            const WorkspaceIndex *index);
+
+// False if there is no usable pack at path; *why says "miss", "stale" or
+// "corrupt". On success *pack holds the saved snippets and stats.
+bool load_cached_pack(const std::string &path,
+                      const FileTable &files,
+                      ContextPack *pack,
+                      std::string *why);
+
+bool store_cached_pack(const std::string &path,
+                       const FileTable &files,
+                       const ContextPack &pack,
+                       std::string *error);
@@ -0,0 +1,353 @@
+
+#include "workspace/regex_literals.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Index just past the ']' closing a class that starts at s[i] == '['.
+static size_t skip_class(const std::string &s, size_t i)
+{
+    size_t j = i + 1;
+    if (j < s.size() && s[j] == '^') j++;
+    if (j < s.size() && s[j] == ']') j++;   // leading ']' is literal
+    int depth = 1;
+    while (j < s.size()) {
+        char c = s[j];
+        if (c == '\\') {
+            j += 2;
+            continue;
+        }
+        if (c == '[') {
+            depth++;   // nested class or [:alpha:]
+        } else if (c == ']') {
+            if (--depth == 0) {
+                return j + 1;
+            }
+        }
+        j++;
+    }
+    return std::string::npos;
+}
+
+
+// Index just past the ')' closing a group that starts at s[i] == '('.
+static size_t skip_group(const std::string &s, size_t i)
+{
+    size_t j = i + 1;
+    int depth = 1;
+    while (j < s.size()) {
+        char c = s[j];
+        if (c == '\\') {
+            j += 2;
+            continue;
+        }
+        if (c == '[') {
+            j = skip_class(s, j);
+            if (j == std::string::npos) {
+                return j;
+            }
+            continue;
+        }
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            if (--depth == 0) {
+                return j + 1;
+            }
+        }
+        j++;
+    }
+    return std::string::npos;
+}
+
+
+// Bytes of escapes like \pL, \p{Greek}, \x41, \x{263a}, \u{...} after the letter.
+static size_t skip_escape_arg(const std::string &s, size_t j, char letter)
+{
+    bool takes_arg = letter == 'p' || letter == 'P' || letter == 'x' || letter == 'u' || letter == 'U';
+    if (!takes_arg) {
+        return j;   // a '{' after \s or \b is a repetition, not an argument
+    }
+    if (j < s.size() && s[j] == '{') {
+        size_t close = s.find('}', j);
+        return close == std::string::npos ? s.size() : close + 1;
+    }
+    if (letter == 'p' || letter == 'P') return std::min(s.size(), j + 1);
+    if (letter == 'x') return std::min(s.size(), j + 2);
+    if (letter == 'u') return std::min(s.size(), j + 4);
+    return std::min(s.size(), j + 8);
+}
+
+
+bool regex_required_literals(const std::string &pattern,
+                             bool fixed_string,
+                             std::vector<RegexLiteral> *out)
+{
+    out->clear();
+
+    if (fixed_string) {
+        if (!pattern.empty()) {
+            out->push_back(RegexLiteral{pattern, false, false});
+        }
+        return true;
+    }
+
+    std::string cur;
+    bool cur_start = false;
+    // the next literal byte follows a word boundary
+    bool pending_start = false;
+
+    auto flush = [&](bool end_boundary) {
+        if (!cur.empty()) {
+            out->push_back(RegexLiteral{cur, cur_start, end_boundary});
+        }
+        cur.clear();
+    };
+    auto push = [&](char c) {
+        if (cur.empty()) {
+            cur_start = pending_start;
+        }
+        cur.push_back(c);
+        pending_start = false;
+    };
+    // the previous atom may match zero times: it is not part of any required
+    // run; for a multibyte character that is all of its bytes
+    auto drop_last = [&](bool last_was_literal) {
+        if (last_was_literal) {
+            while (!cur.empty() && (static_cast<unsigned char>(cur.back()) & 0xc0) == 0x80) {
+                cur.pop_back();
+            }
+            if (!cur.empty()) {
+                cur.pop_back();
+            }
+        }
+        flush(false);
+        pending_start = false;
+    };
+
+    // A \b, \s or \W just seen. It bounds the runs around it only if the
+    // next token doesn't make it optional, so that is decided one step late.
+    bool boundary_pending = false;
+    size_t boundary_lit = 0;   // out index of the run before it, or npos
+    auto settle_boundary = [&](bool holds) {
+        if (holds && boundary_lit != std::string::npos) {
+            (*out)[boundary_lit].word_end = true;
+        }
+        pending_start = holds;
+        boundary_pending = false;
+    };
+
+    bool last_literal = false;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+
+        if (boundary_pending) {
+            if (c == '*' || c == '?') {
+                settle_boundary(false);
+                i++;
+                continue;
+            }
+            size_t close = c == '{' ? pattern.find('}', i) : std::string::npos;
+            if (c == '+' || close != std::string::npos) {
+                // {0}, {0,n} and {,n} allow zero repetitions
+                bool zero = c == '{' && (pattern[i + 1] == '0' || pattern[i + 1] == ',');
+                settle_boundary(!zero);
+                i = c == '+' ? i + 1 : close + 1;
+                if (i < pattern.size() && pattern[i] == '?') {
+                    i++;   // lazy form
+                }
+                continue;
+            }
+            settle_boundary(true);
+        }
+
+        if (c == '|') {
+            // top-level alternation: no literal is required on every branch
+            return false;
+        }
+        if (c == '*' || c == '?') {
+            drop_last(last_literal);
+            last_literal = false;
+            i++;
+            continue;
+        }
+        if (c == '{') {
+            size_t close = pattern.find('}', i);
+            if (close == std::string::npos) {
+                // rg treats an unterminated brace as a literal
+                push(c);
+                last_literal = true;
+                i++;
+                continue;
+            }
+            drop_last(last_literal);
+            last_literal = false;
+            i = close + 1;
+            continue;
+        }
+        if (c == '+') {
+            flush(false);
+            pending_start = false;
+            last_literal = false;
+            i++;
+            continue;
+        }
+        if (c == '(') {
+            if (pattern.compare(i, 2, "(?") == 0) {
+                size_t k = i + 2;
+                while (k < pattern.size() && pattern[k] != ')' && pattern[k] != ':') {
+                    if (pattern[k] == 'i' || pattern[k] == 'x') {
+                        // case folding / verbose mode change what the literals mean
+                        return false;
+                    }
+                    k++;
+                }
+            }
+            size_t j = skip_group(pattern, i);
+            if (j == std::string::npos) {
+                return false;
+            }
+            flush(false);
+            pending_start = false;
+            last_literal = false;
+            i = j;
+            continue;
+        }
+        if (c == ')') {
+            return false;
+        }
+        if (c == '[') {
+            size_t j = skip_class(pattern, i);
+            if (j == std::string::npos) {
+                return false;
+            }
+            flush(false);
+            pending_start = false;
+            last_literal = false;
+            i = j;
+            continue;
+        }
+        if (c == '.') {
+            flush(false);
+            pending_start = false;
+            last_literal = false;
+            i++;
+            continue;
+        }
+        if (c == '^' || c == '$') {
+            // line edges are word boundaries for our purposes
+            flush(c == '$');
+            pending_start = (c == '^');
+            last_literal = false;
+            i++;
+            continue;
+        }
+        if (c == '\\') {
+            if (i + 1 >= pattern.size()) {
+                return false;
+            }
+            char e = pattern[i + 1];
+            bool alnum = (e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || (e >= '0' && e <= '9');
+            if (!alnum) {
+                // escaped metacharacter: a literal byte
+                push(e);
+                last_literal = true;
+                i += 2;
+                continue;
+            }
+            // \b, \s and \W put a non-word position next to the run unless a
+            // quantifier makes them optional; other classes, assertions and
+            // escapes we don't decode just end it
+            bool boundary = (e == 'b' || e == 's' || e == 'W');
+            boundary_lit = cur.empty() ? std::string::npos : out->size();
+            flush(false);
+            pending_start = false;
+            boundary_pending = boundary;
+            last_literal = false;
+            i = skip_escape_arg(pattern, i + 2, e);
+            continue;
+        }
+
+        push(c);
+        last_literal = true;
+        i++;
+    }
+    if (boundary_pending) {
+        settle_boundary(true);
+    }
+    flush(false);
+    return true;
+}
+
+
+std::string regex_token(std::string_view name)
+{
+    std::string p;
+    if (!name.empty() && is_word_byte(static_cast<unsigned char>(name.front()))) {
+        p += "\\b";
+    }
+    for (char c : name) {
+        // the set the regex crate's escape() covers
+        if (c != '\0' && std::strchr("\\.+*?()|[]{}^$#&-~", c)) {
+            p += '\\';
+        }
+        p += c;
+    }
+    if (!name.empty() && is_word_byte(static_cast<unsigned char>(name.back()))) {
+        p += "\\b";
+    }
+    return p;
+}
+
+
+static inline uint32_t trigram_at(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+}
+
+
+void literal_trigrams(const std::vector<RegexLiteral> &lits, std::vector<uint32_t> *out)
+{
+    out->clear();
+    for (const RegexLiteral &l : lits) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(l.text.data());
+        for (size_t i = 0; i + 3 <= l.text.size(); i++) {
+            out->push_back(trigram_at(p + i));
+        }
+    }
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
+
+
+void literal_words(const std::vector<RegexLiteral> &lits, std::vector<std::string> *out)
+{
+    out->clear();
+    for (const RegexLiteral &l : lits) {
+        const std::string &t = l.text;
+        size_t i = 0;
+        while (i < t.size()) {
+            if (!is_word_byte(static_cast<unsigned char>(t[i]))) {
+                i++;
+                continue;
+            }
+            size_t j = i;
+            while (j < t.size() && is_word_byte(static_cast<unsigned char>(t[j]))) {
+                j++;
+            }
+            bool whole_start = (i > 0) || l.word_start;
+            bool whole_end = (j < t.size()) || l.word_end;
+            if (whole_start && whole_end) {
+                out->push_back(t.substr(i, j - i));
+            }
+            i = j;
+        }
+    }
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
@@ -0,0 +1,51 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// A run of bytes every match of a pattern must contain.
+struct RegexLiteral
+{
+    std::string text;
+    // preceded / followed by a word boundary: ^ or $, or \b, \s, \W that
+    // no quantifier makes optional
+    bool word_start = false;
+    bool word_end = false;
+};
+
+
+// Literal runs required on every path through pattern. False when nothing
+// can be said (top-level alternation, (?i) / (?x) flags, unbalanced groups);
+// an empty list with true means the pattern has no required literal bytes.
+bool regex_required_literals(const std::string &pattern,
+                             bool fixed_string,
+                             std::vector<RegexLiteral> *out);
+
+// name as a pattern matching it as a whole token: metacharacters escaped,
+// and \b on each side whose edge byte is a word byte ('$' can't take one).
+std::string regex_token(std::string_view name);
+
+// Distinct byte trigrams of the literals, sorted.
+void literal_trigrams(const std::vector<RegexLiteral> &lits, std::vector<uint32_t> *out);
+
+// Word tokens (is_word_byte runs) that must appear whole in a match, i.e.
+// bounded on both sides inside a literal or by a word boundary around it.
+void literal_words(const std::vector<RegexLiteral> &lits, std::vector<std::string> *out);
+
+inline bool is_ident_byte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '$' || c >= 0x80;
+}
+
+// ASCII \w. Unlike is_ident_byte, '$' and non-ASCII bytes split tokens:
+// rg's \b, \s and \W can sit next to '$', '€' or a no-break space, so only
+// this narrower split lets a boundary in the pattern vouch for a token end.
+inline bool is_word_byte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
@@ -2,9 +2,9 @@
 #include "workspace/scanner.h"
 
 #include <algorithm>
-// #include <chrono>
 #include <filesystem>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
@@ -19,16 +19,6 @@ static bool ends_with(const std::string &s, const std::string &suffix)
 }
 
 
-// static int64_t file_time_to_epoch_seconds(const fs::file_time_type &ft) 
-// {
-//     using namespace std::chrono;
-//     auto now_ft = fs::file_time_type::clock::now();
-//     auto now_sys = system_clock::now();
-//     auto sys_tp = time_point_cast<system_clock::duration>(ft - now_ft + now_sys);
-//     return duration_cast<seconds>(sys_tp.time_since_epoch()).count();
-// }
-//
-
 static bool has_included_ext(const std::vector<std::string> &exts,
                              const fs::path &p) 
 {
@@ -40,18 +30,44 @@ static bool has_included_ext(const std::vector<std::string> &exts,
 }
 
 
-std::vector<FileEntry> scan_workspace(const std::string &root_dir,
-                                      const ScanOptions &opt)
+bool has_included_ext(const ScanOptions &opt, const std::string &path)
 {
-    std::error_code ec;
+    for (const std::string &e : opt.include_exts) {
+        if (ends_with(path, e)) return true;
+    }
+    return false;
+}
+
+
+bool is_excluded_dir_name(const ScanOptions &opt, const std::string &name)
+{
+    for (const std::string &s : opt.exclude_dir_names) {
+        if (s == name) return true;
+    }
+    return false;
+}
+
 
-    // root
+std::string workspace_root(const std::string &root_dir)
+{
+    std::error_code ec;
     fs::path root = fs::absolute(fs::path(root_dir), ec);
     if (ec) {
         root = fs::path(root_dir);
-        ec.clear();
     }
-    root = root.lexically_normal();
+    std::string s = root.lexically_normal().string();
+    while (s.size() > 1 && s.back() == '/') {
+        s.pop_back();
+    }
+    return s;
+}
+
+
+static void scan_into(const fs::path &start,
+                      const ScanOptions &opt,
+                      FileTable &out)
+{
+    std::error_code ec;
 
     // exclude
     std::unordered_set<std::string> skip;
@@ -60,15 +76,12 @@ std::vector<FileEntry> scan_workspace(const std::string &root_dir,
 
     fs::directory_options dopts = fs::directory_options::skip_permission_denied;
 
-    std::vector<FileEntry> out;
-    out.reserve(4096);
-
-    fs::recursive_directory_iterator it(root, dopts, ec);
+    fs::recursive_directory_iterator it(start, dopts, ec);
     fs::recursive_directory_iterator end;
 
     while (!ec && it != end) {
         const fs::directory_entry &ent = *it;
-        const fs::path p = ent.path();
+        const fs::path &p = ent.path();
 
         if (ent.is_directory(ec)) {
             ec.clear();
@@ -105,39 +118,76 @@ std::vector<FileEntry> scan_workspace(const std::string &root_dir,
             continue;
         }
 
-        FileEntry fe;
-        // abs path
-        fs::path abs = fs::absolute(p, ec);
+        // start is absolute and normalized, so entries are too: rel is a plain suffix
+        std::string_view rel;
+        const std::string &abs = p.native();
+        if (!out.rel_of(abs, &rel)) {
+            ++it;
+            continue;
+        }
+
+        // last modified
+        int64_t mtime = 0;
+        auto ft = ent.last_write_time(ec);
         if (ec) {
             ec.clear();
-            abs = p;
+        } else {
+            mtime = static_cast<int64_t>(ft.time_since_epoch().count());
         }
-        abs = abs.lexically_normal();
-        fe.abs_path = abs.string();
-        // rel path
-        fs::path rel = abs.lexically_relative(root);
-        fe.rel_path = rel.empty() ? fe.abs_path : rel.string();
-        // size
-        fe.size_bytes = static_cast<uint64_t>(sz);
-        // // last modified
-        // auto ft = ent.last_write_time(ec);
-        // if (ec) {
-        //     ec.clear();
-        //     fe.mdftime_sec = 0;
-        // } else {
-        //     fe.mdftime_sec = file_time_to_epoch_seconds(ft);
-        // }
-
-        out.push_back(std::move(fe));
+
+        out.add(rel, static_cast<uint64_t>(sz), mtime);
         ++it;
     }
+}
 
-    std::sort(out.begin(), 
-              out.end(),
-              [](const FileEntry &a, const FileEntry &b) {
-                return a.rel_path < b.rel_path;
-              });
 
+FileTable scan_workspace(const std::string &root_dir,
+                         const ScanOptions &opt)
+{
+    FileTable out(workspace_root(root_dir));
+    scan_into(fs::path(out.root()), opt, out);
+    out.sort_by_path();
+    return out;
+}
+
+
+FileTable scan_subtree(const std::string &root_dir,
+                       const std::string &sub_dir,
+                       const ScanOptions &opt)
+{
+    FileTable out(workspace_root(root_dir));
+    fs::path sub = fs::path(sub_dir);
+    if (sub.is_relative()) {
+        sub = fs::path(out.root()) / sub;
+    }
+    scan_into(sub.lexically_normal(), opt, out);
+    out.sort_by_path();
     return out;
 }
 
+
+bool scan_file(const std::string &abs_path,
+               const ScanOptions &opt,
+               uint64_t *size_bytes,
+               int64_t *mtime)
+{
+    std::error_code ec;
+    fs::path p = fs::path(abs_path);
+
+    if (!has_included_ext(opt.include_exts, p)) {
+        return false;
+    }
+    if (!fs::is_regular_file(p, ec) || ec) {
+        return false;
+    }
+
+    uintmax_t sz = fs::file_size(p, ec);
+    if (ec || sz > opt.max_file_size_bytes) {
+        return false;
+    }
+
+    auto ft = fs::last_write_time(p, ec);
+    *mtime = ec ? 0 : static_cast<int64_t>(ft.time_since_epoch().count());
+    *size_bytes = static_cast<uint64_t>(sz);
+    return true;
+}
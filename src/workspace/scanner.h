@@ -5,13 +5,7 @@
 #include <string>
 #include <vector>
 
-
-struct FileEntry 
-{
-    std::string rel_path;   // relative to scan root
-    std::string abs_path;   
-    uint64_t    size_bytes;
-};
+#include "workspace/file_table.h"
 
 
 struct ScanOptions 
@@ -26,6 +20,23 @@ struct ScanOptions
 };
 
 
-std::vector<FileEntry> scan_workspace(const std::string &root_dir,
-                                      const ScanOptions &opt);
+// Absolute, normalized, no trailing '/'; the root every FileTable is built against.
+std::string workspace_root(const std::string &root_dir);
+
+// Ids come out in rel path order.
+FileTable scan_workspace(const std::string &root_dir,
+                         const ScanOptions &opt);
+
+// Scan only sub_dir (absolute, or relative to root_dir); rel paths stay relative to root_dir.
+FileTable scan_subtree(const std::string &root_dir,
+                       const std::string &sub_dir,
+                       const ScanOptions &opt);
+
+// Stat a single file the way scan_workspace would; false if it would not be listed.
+bool scan_file(const std::string &abs_path,
+               const ScanOptions &opt,
+               uint64_t *size_bytes,
+               int64_t *mtime);
 
+bool is_excluded_dir_name(const ScanOptions &opt, const std::string &name);
+bool has_included_ext(const ScanOptions &opt, const std::string &path);
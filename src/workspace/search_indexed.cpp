@@ -0,0 +1,214 @@
+
+#include "workspace/search_indexed.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fnmatch.h>
+
+#include "workspace/index_io.h"
+#include "workspace/regex_literals.h"
+
+
+// rg glob semantics, near enough: a glob with a '/' matches the rel path,
+// one without matches the file name anywhere.
+static bool glob_matches(std::string_view rel, const std::string &glob)
+{
+    std::string path;
+    if (glob.find('/') != std::string::npos) {
+        path.assign(rel.data(), rel.size());
+    } else {
+        size_t slash = rel.rfind('/');
+        std::string_view name = (slash == std::string_view::npos) ? rel : rel.substr(slash + 1);
+        path.assign(name.data(), name.size());
+    }
+    return fnmatch(glob.c_str(), path.c_str(), 0) == 0;
+}
+
+
+bool rg_query_accepts(const RgQuery &q, std::string_view rel)
+{
+    for (const std::string &x : q.excludes) {
+        if (glob_matches(rel, x)) {
+            return false;
+        }
+    }
+    if (q.globs.empty()) {
+        return true;
+    }
+    for (const std::string &g : q.globs) {
+        if (glob_matches(rel, g)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void restrict_to_scan(const ScanOptions &opt, RgQuery *q)
+{
+    for (const std::string &d : opt.exclude_dir_names) {
+        // trailing '/': a directory of that name at any depth
+        q->excludes.push_back(d + "/");
+    }
+    q->max_filesize = opt.max_file_size_bytes;
+    // the scan doesn't read .gitignore or skip dot files, and rg applies
+    // neither to the explicit paths the indexed search passes
+    q->no_ignore = true;
+}
+
+
+static RgResult full_scan(const std::string &repo_root,
+                          const RgQuery &q,
+                          const FileTable &files,
+                          const ScanOptions &opt,
+                          const char *why,
+                          IndexedSearchStats *st)
+{
+    st->used_index = false;
+    st->fallback = why;
+    RgQuery scoped = q;
+    restrict_to_scan(opt, &scoped);
+    return rg_search_json(repo_root, scoped, &files);
+}
+
+
+IndexedSearcher::IndexedSearcher(const WorkspaceIndex &index,
+                                 const FileTable &files,
+                                 const ScanOptions &opt,
+                                 size_t max_candidates)
+    : files_(files), opt_(opt), max_candidates_(max_candidates)
+{
+    if (index.has_trigrams) {
+        tri_ = &index.trigrams;
+        std::vector<FileId> stale;
+        tri_->files().resolve(files, &tri_to_table_, &stale);
+        tri_covered_.assign(files.size(), false);
+        for (FileId id : tri_to_table_) {
+            if (id != kNoFile) {
+                tri_covered_[id] = true;
+            }
+        }
+    }
+    if (index.has_blooms) {
+        blooms_.bind(&index.blooms, files);
+    }
+}
+
+
+RgResult IndexedSearcher::search(const std::string &repo_root,
+                                 const RgQuery &q,
+                                 IndexedSearchStats *stats) const
+{
+    IndexedSearchStats local;
+    IndexedSearchStats *st = stats ? stats : &local;
+    *st = IndexedSearchStats{};
+    st->files_total = files_.live_count();
+
+    if (!usable()) {
+        return full_scan(repo_root, q, files_, opt_, "no index", st);
+    }
+
+    // only scanned files are indexed; anything else needs rg's own walk
+    if (q.globs.empty()) {
+        return full_scan(repo_root, q, files_, opt_, "no --glob limits the search to indexed files", st);
+    }
+    for (const std::string &g : q.globs) {
+        if (!has_included_ext(opt_, g)) {
+            return full_scan(repo_root, q, files_, opt_, "glob outside the indexed extensions", st);
+        }
+    }
+
+    std::vector<RegexLiteral> lits;
+    if (!regex_required_literals(q.pattern, q.fixed_string, &lits)) {
+        return full_scan(repo_root, q, files_, opt_, "pattern has alternation or flags the index can't follow", st);
+    }
+    std::vector<uint32_t> tris;
+    std::vector<std::string> words;
+    if (tri_) {
+        literal_trigrams(lits, &tris);
+    }
+    if (blooms_.bound()) {
+        literal_words(lits, &words);
+    }
+    if (tris.empty() && words.empty()) {
+        return full_scan(repo_root, q, files_, opt_, "no required literal the index can use", st);
+    }
+    st->trigrams = tris.size();
+    st->words = words.size();
+
+    std::vector<bool> tri_hit;
+    if (!tris.empty()) {
+        std::vector<uint32_t> matched = tri_->query(tris);
+        st->index_matches = matched.size();
+        tri_hit.assign(files_.size(), false);
+        for (uint32_t i : matched) {
+            if (i < tri_to_table_.size() && tri_to_table_[i] != kNoFile) {
+                tri_hit[tri_to_table_[i]] = true;
+            }
+        }
+    }
+
+    RgQuery vq = q;
+    for (FileId id = 0; id < static_cast<FileId>(files_.size()); id++) {
+        if (!files_.alive(id)) {
+            continue;
+        }
+        // files the trigram index can't vouch for always pass it
+        if (!tris.empty() && tri_covered_[id] && !tri_hit[id]) {
+            continue;
+        }
+        if (!tris.empty() && !tri_covered_[id]) {
+            st->stale_files += 1;
+        }
+        if (!words.empty() && !blooms_.may_contain_all(id, words)) {
+            st->bloom_skipped += 1;
+            continue;
+        }
+        if (!rg_query_accepts(q, files_.rel_path(id))) {
+            continue;
+        }
+        if (vq.paths.size() >= max_candidates_) {
+            return full_scan(repo_root, q, files_, opt_, "too many candidate files", st);
+        }
+        vq.paths.push_back(files_.abs_path(id));
+    }
+
+    st->used_index = true;
+    st->candidates = vq.paths.size();
+
+    if (vq.paths.empty()) {
+        RgResult res;
+        res.exit_code = 1;   // rg's "no match"
+        return res;
+    }
+    return rg_search_json(repo_root, vq, &files_);
+}
+
+
+RgResult rg_search_with_index_dir(const std::string &repo_root,
+                                  const RgQuery &q,
+                                  const std::string &index_dir,
+                                  IndexedSearchStats *stats)
+{
+    ScanOptions opt;
+    FileTable files = scan_workspace(repo_root, opt);
+
+    std::string dir = index_dir.empty() ? default_index_dir(files.root()) : index_dir;
+    WorkspaceIndex index;
+    open_workspace_index(files.root(), dir, &index);
+
+    IndexedSearcher searcher(index, files, opt);
+    if (!searcher.usable()) {
+        IndexedSearchStats local;
+        IndexedSearchStats *st = stats ? stats : &local;
+        *st = IndexedSearchStats{};
+        st->files_total = files.live_count();
+        st->fallback = "no trigram or bloom index in " + dir;
+        RgQuery scoped = q;
+        restrict_to_scan(opt, &scoped);
+        return rg_search_json(repo_root, scoped, &files);
+    }
+    return searcher.search(repo_root, q, stats);
+}
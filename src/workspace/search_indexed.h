@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "workspace/bloom_index.h"
+#include "workspace/file_table.h"
+#include "workspace/scanner.h"
+#include "workspace/search_rg.h"
+#include "workspace/workspace_index.h"
+
+
+struct IndexedSearchStats
+{
+    bool used_index = false;
+    std::string fallback;         // why rg searched the whole tree; empty when the index was used
+    size_t trigrams = 0;          // required trigrams taken from the pattern
+    size_t words = 0;             // required whole tokens checked against Bloom filters
+    size_t index_matches = 0;     // indexed files holding all trigrams
+    size_t bloom_skipped = 0;     // files the trigrams allowed but a Bloom filter ruled out
+    size_t stale_files = 0;       // new or changed since the index was built; always searched
+    size_t candidates = 0;        // files handed to rg
+    size_t files_total = 0;
+};
+
+
+// Whether rg would search rel under q's --glob/--exclude. rg skips these
+// checks for explicit paths, so callers passing RgQuery::paths filter first.
+bool rg_query_accepts(const RgQuery &q, std::string_view rel);
+
+
+// Limit q to what scan_workspace lists: no directory named in
+// exclude_dir_names, nothing over max_file_size_bytes, but ignored and
+// hidden files included. With it rg's own walk covers the same files as an
+// index built from a scan.
+void restrict_to_scan(const ScanOptions &opt, RgQuery *q);
+
+
+// Prefilters files through the trigram index and per-file Bloom filters,
+// then lets rg verify only the candidates. Binding to the file table happens
+// once in the constructor, so one searcher serves many queries.
+// Falls back to rg over the scanned part of the repo (see restrict_to_scan)
+// when the pattern has no required literals, the globs reach beyond the
+// scanned extensions, or more than max_candidates files survive the
+// prefilter.
+class IndexedSearcher
+{
+public:
+    IndexedSearcher(const WorkspaceIndex &index,
+                    const FileTable &files,
+                    const ScanOptions &opt,
+                    size_t max_candidates = 2000);
+
+    // true if any part of the index can prefilter
+    bool usable() const { return tri_ != nullptr || blooms_.bound(); }
+
+    RgResult search(const std::string &repo_root, const RgQuery &q, IndexedSearchStats *stats) const;
+
+private:
+    const FileTable &files_;
+    const ScanOptions &opt_;
+    size_t max_candidates_;
+
+    const TrigramIndex *tri_ = nullptr;
+    std::vector<FileId> tri_to_table_;
+    std::vector<bool> tri_covered_;   // by table id
+    FileBlooms blooms_;
+};
+
+
+// Scan the workspace, open the index under index_dir (default_index_dir when
+// empty) and run one IndexedSearcher query; without an index this is
+// rg_search_json, restricted the same way, with the reason in stats->fallback.
+RgResult rg_search_with_index_dir(const std::string &repo_root,
+                                  const RgQuery &q,
+                                  const std::string &index_dir,
+                                  IndexedSearchStats *stats);
@@ -1,6 +1,7 @@
 
 #include "workspace/search_rg.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
 #include <cstdio>
@@ -8,8 +9,10 @@
 #include <filesystem>
 #include <poll.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <signal.h>
 #include <unistd.h>
 
 #include "sys/error.h"
@@ -82,7 +85,43 @@ static bool extract_json_string_after(const std::string &line, const char *prefi
 }
 
 
-static bool parse_match_line(const std::string &line, const std::string &repo_abs, RgHit *out)
+// rg prints paths as <repo_root arg>/<rel>; peel that off and probe the table.
+static FileId lookup_hit_path(const FileTable &files,
+                              const std::string &repo_arg,
+                              const std::string &path_text)
+{
+    std::string_view p(path_text);
+    if (!p.empty() && p[0] == '/') {
+        return files.find_abs(p);
+    }
+    std::string_view arg(repo_arg);
+    while (arg.size() > 1 && arg.back() == '/') {
+        arg.remove_suffix(1);
+    }
+    if (arg == ".") {
+        arg = {};
+    }
+    if (!arg.empty()) {
+        if (p.compare(0, arg.size(), arg) != 0 || p.size() <= arg.size() || p[arg.size()] != '/') {
+            return kNoFile;
+        }
+        p.remove_prefix(arg.size());
+    }
+    while (!p.empty() && p[0] == '/') {
+        p.remove_prefix(1);
+    }
+    while (p.size() > 2 && p[0] == '.' && p[1] == '/') {
+        p.remove_prefix(2);
+    }
+    return files.find_rel(p);
+}
+
+
+static bool parse_match_line(const std::string &line,
+                             const std::string &repo_abs,
+                             const std::string &repo_arg,
+                             const FileTable *files,
+                             RgHit *out)
 {
 
     // {"type":"match",...}
@@ -129,6 +168,20 @@ static bool parse_match_line(const std::string &line, const std::string &repo_ab
         return false;
     }
 
+    out->line_number = line_number;
+    out->match_byte_offset = abs_off + sub_start;
+    out->match_len = static_cast<uint32_t>(sub_end - sub_start);
+
+    if (files) {
+        FileId id = lookup_hit_path(*files, repo_arg, path_text);
+        if (id != kNoFile) {
+            out->file_id = id;
+            out->abs_path = files->abs_path(id);
+            out->rel_path = std::string(files->rel_path(id));
+            return true;
+        }
+    }
+
     //  Normalize relative to repo_abs.
     fs::path p = fs::path(path_text);
     fs::path abs_path;
@@ -146,14 +199,13 @@ static bool parse_match_line(const std::string &line, const std::string &repo_ab
 
     out->abs_path = abs_path.string();
     out->rel_path = rel;
-    out->line_number = line_number;
-    out->match_byte_offset = abs_off + sub_start;
-    out->match_len = static_cast<uint32_t>(sub_end - sub_start);
     return true;
 }
 
 
-RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
+RgResult rg_search_json(const std::string &repo_root,
+                        const RgQuery &q,
+                        const FileTable *files)
 {
     RgResult res;
 
@@ -179,6 +231,16 @@ RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
         spec.argv.push_back("-F");
     }
 
+    if (q.max_filesize > 0) {
+        spec.argv.push_back("--max-filesize");
+        spec.argv.push_back(std::to_string(q.max_filesize));
+    }
+
+    if (q.no_ignore) {
+        spec.argv.push_back("--no-ignore");
+        spec.argv.push_back("--hidden");
+    }
+
     for (const std::string &g : q.globs) {
         spec.argv.push_back("-g");
         spec.argv.push_back(g);
@@ -191,7 +253,14 @@ RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
     }
 
     spec.argv.push_back(q.pattern);
-    spec.argv.push_back(repo_root);
+    if (q.paths.empty()) {
+        spec.argv.push_back(repo_root);
+    } else {
+        spec.argv.push_back("--");
+        for (const std::string &p : q.paths) {
+            spec.argv.push_back(p);
+        }
+    }
 
     ChildProcess cp = spawn(spec);
     // not needed
@@ -215,13 +284,28 @@ RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
         fds[0].events = out_open ? POLLIN : 0;
         fds[1].events = err_open ? POLLIN : 0;
 
-        int rc = poll(fds, 2, -1);
+        int timeout_ms = -1;
+        if (q.deadline != std::chrono::steady_clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                q.deadline - std::chrono::steady_clock::now()).count();
+            timeout_ms = left > 0 ? static_cast<int>(std::min<long long>(left, 60000)) : 0;
+        }
+
+        int rc = poll(fds, 2, timeout_ms);
         if (rc < 0) {
             if (errno == EINTR) {
                 continue;
             }
             die("poll");
         }
+        // checked on every pass: a busy rg keeps poll returning > 0
+        if (std::chrono::steady_clock::now() >= q.deadline) {
+            kill(cp.pid, SIGKILL);
+            cp.stdout_r.close();
+            cp.stderr_r.close();
+            res.killed_at_deadline = true;
+            break;
+        }
 
         if (out_open && (fds[0].revents & (POLLIN | POLLHUP))) {
             ssize_t r = read(cp.stdout_r.get(), buf, sizeof(buf));
@@ -247,7 +331,7 @@ RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
                     line_buf.erase(0, nl + 1);
 
                     RgHit hit;
-                    if (parse_match_line(line, repo_abs, &hit)) {
+                    if (parse_match_line(line, repo_abs, repo_root, files, &hit)) {
                         res.hits.push_back(std::move(hit));
                     }
                 }
@@ -274,6 +358,10 @@ RgResult rg_search_json(const std::string &repo_root, const RgQuery &q)
 
     ExitStatus es = wait_child(cp.pid);
     res.exit_code = es.as_shell_code();
+    if (res.killed_at_deadline) {
+        res.error = "rg killed at deadline";
+        return res;
+    }
 
     // ripgrep conventions: exit code 0 = match found, 1 = no match, 2 = error.
     if (res.exit_code == 2) {
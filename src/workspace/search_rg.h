@@ -1,13 +1,17 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
 
+#include "workspace/file_table.h"
+
 
 struct RgHit
 {
+    FileId file_id = kNoFile;   // set when a FileTable was given and knows the path
     std::string abs_path;
     std::string rel_path;
 
@@ -25,6 +29,18 @@ struct RgQuery
     std::vector<std::string> excludes;  
 
     bool fixed_string = false; // -F 
+
+    // rg --max-filesize when nonzero
+    uint64_t max_filesize = 0;
+
+    // rg --no-ignore --hidden: skip no file for .gitignore rules or a leading dot
+    bool no_ignore = false;
+
+    // explicit files to search instead of repo_root (rg ignores globs for these)
+    std::vector<std::string> paths;
+
+    // rg is killed if still running then; hits read so far are kept
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
 };
 
 struct RgResult
@@ -32,9 +48,13 @@ struct RgResult
     int exit_code = -1;                 
     std::string error;                   
     std::vector<RgHit> hits;
+    bool killed_at_deadline = false;
 };
 
 // run rg --json and parses "match" events.
 // repo_root can be relative or absolute.
-RgResult rg_search_json(const std::string &repo_root, const RgQuery &q);
+// With files, hit paths are resolved by table lookup instead of path normalization.
+RgResult rg_search_json(const std::string &repo_root,
+                        const RgQuery &q,
+                        const FileTable *files = nullptr);
 
@@ -0,0 +1,261 @@
+
+#include "workspace/token_count.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+
+
+static bool is_letter(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80;
+}
+
+
+static bool is_digit(unsigned char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+static bool is_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+
+static bool is_newline(unsigned char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+
+static int base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+
+static bool base64_decode(std::string_view in, std::string *out)
+{
+    out->clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : in) {
+        if (c == '=') {
+            break;
+        }
+        int v = base64_value(c);
+        if (v < 0) {
+            return false;
+        }
+        acc = (acc << 6) | static_cast<uint32_t>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return !out->empty();
+}
+
+
+bool TokenCounter::load_vocab(const std::string &path, std::string *error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        *error = "cannot open " + path;
+        return false;
+    }
+
+    std::vector<std::pair<size_t, size_t>> spans;   // into arena_
+    std::vector<uint32_t> ranks;
+    std::string line;
+    std::string tok;
+    uint32_t lineno = 0;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        uint32_t rank = lineno++;
+        tok = line;
+        size_t sp = line.rfind(' ');
+        if (sp != std::string::npos && sp > 0 && sp + 1 < line.size()) {
+            char *end = nullptr;
+            unsigned long r = std::strtoul(line.c_str() + sp + 1, &end, 10);
+            if (*end == '\0' && base64_decode(std::string_view(line).substr(0, sp), &tok)) {
+                rank = static_cast<uint32_t>(r);
+            } else {
+                tok = line;
+            }
+        }
+        if (tok.empty()) {
+            continue;
+        }
+        spans.emplace_back(arena_.size(), tok.size());
+        ranks.push_back(rank);
+        arena_ += tok;
+    }
+
+    ranks_.clear();
+    ranks_.reserve(spans.size());
+    for (size_t i = 0; i < spans.size(); i++) {
+        ranks_.emplace(std::string_view(arena_.data() + spans[i].first, spans[i].second), ranks[i]);
+    }
+    memo_.clear();
+    if (ranks_.empty()) {
+        *error = "no tokens in " + path;
+        return false;
+    }
+    return true;
+}
+
+
+// Merge the adjacent pair with the lowest rank until none is in the
+// vocabulary; bytes the vocabulary lacks count one each.
+size_t TokenCounter::bpe(std::string_view piece) const
+{
+    if (ranks_.count(piece) != 0) {
+        return 1;
+    }
+    std::vector<size_t> starts(piece.size());
+    for (size_t i = 0; i < piece.size(); i++) {
+        starts[i] = i;
+    }
+    for (;;) {
+        uint32_t best = UINT32_MAX;
+        size_t at = 0;
+        for (size_t i = 0; i + 1 < starts.size(); i++) {
+            size_t end = i + 2 < starts.size() ? starts[i + 2] : piece.size();
+            auto it = ranks_.find(piece.substr(starts[i], end - starts[i]));
+            if (it != ranks_.end() && it->second < best) {
+                best = it->second;
+                at = i;
+            }
+        }
+        if (best == UINT32_MAX) {
+            break;
+        }
+        starts.erase(starts.begin() + static_cast<std::ptrdiff_t>(at) + 1);
+    }
+    return starts.size();
+}
+
+
+// No vocabulary: camelCase/snake_case parts of up to 7 letters are one token
+// each (longer ones one per 6), punctuation pairs up, whitespace runs are one.
+static size_t heuristic_piece(std::string_view p)
+{
+    size_t i = 0;
+    if (!p.empty() && !is_letter(static_cast<unsigned char>(p[0])) && p.size() > 1 &&
+        is_letter(static_cast<unsigned char>(p[1]))) {
+        i = 1;   // leading space or punctuation rides along with the word
+    }
+    unsigned char c0 = static_cast<unsigned char>(p[i]);
+    if (is_letter(c0)) {
+        size_t tokens = 0;
+        size_t part = 0;
+        for (size_t k = i; k <= p.size(); k++) {
+            bool boundary = k == p.size() || p[k] == '_' ||
+                            (k > i && p[k] >= 'A' && p[k] <= 'Z' && p[k - 1] >= 'a' && p[k - 1] <= 'z');
+            if (boundary && part > 0) {
+                tokens += part <= 7 ? 1 : (part + 5) / 6;
+                part = 0;
+            }
+            if (k < p.size() && p[k] != '_') {
+                part++;   // '_' itself usually merges with a neighbour
+            }
+        }
+        return tokens > 0 ? tokens : 1;
+    }
+    if (is_digit(c0) || is_space(c0)) {
+        return 1;
+    }
+    return (p.size() + 1) / 2;
+}
+
+
+size_t TokenCounter::count_piece(std::string_view piece)
+{
+    if (piece.size() > 64) {
+        // long runs (base64 blobs, ascii art) don't merge much; skip the memo
+        size_t n = 0;
+        for (size_t i = 0; i < piece.size(); i += 64) {
+            std::string_view chunk = piece.substr(i, 64);
+            n += has_vocab() ? bpe(chunk) : heuristic_piece(chunk);
+        }
+        return n;
+    }
+    auto it = memo_.find(std::string(piece));
+    if (it != memo_.end()) {
+        return it->second;
+    }
+    size_t n = has_vocab() ? bpe(piece) : heuristic_piece(piece);
+    if (memo_.size() >= (1u << 16)) {
+        memo_.clear();
+    }
+    memo_.emplace(std::string(piece), static_cast<uint32_t>(n));
+    return n;
+}
+
+
+size_t TokenCounter::count(std::string_view s)
+{
+    size_t total = 0;
+    size_t i = 0;
+    const size_t n = s.size();
+    auto at = [&](size_t k) { return static_cast<unsigned char>(s[k]); };
+
+    while (i < n) {
+        size_t j = i;
+        unsigned char c = at(i);
+        if (is_letter(c) ||
+            (!is_digit(c) && !is_newline(c) && i + 1 < n && is_letter(at(i + 1)))) {
+            // [^\r\n\w]?\w+
+            j = i + 1;
+            while (j < n && is_letter(at(j))) {
+                j++;
+            }
+        } else if (is_digit(c)) {
+            while (j < n && j - i < 3 && is_digit(at(j))) {
+                j++;
+            }
+        } else if (!is_space(c) || (c == ' ' && i + 1 < n && !is_space(at(i + 1)) && !is_digit(at(i + 1)))) {
+            // " ?[^\s\w]+[\r\n]*"
+            j = c == ' ' ? i + 1 : i;
+            while (j < n && !is_space(at(j)) && !is_letter(at(j)) && !is_digit(at(j))) {
+                j++;
+            }
+            while (j < n && is_newline(at(j))) {
+                j++;
+            }
+        } else {
+            size_t e = i;
+            size_t last_nl = SIZE_MAX;
+            while (e < n && is_space(at(e))) {
+                if (is_newline(at(e))) {
+                    last_nl = e;
+                }
+                e++;
+            }
+            if (last_nl != SIZE_MAX) {
+                j = last_nl + 1;          // \s*[\r\n]+
+            } else if (e < n && e - i > 1) {
+                j = e - 1;                // leave one space for the next word
+            } else {
+                j = e;
+            }
+        }
+        if (j <= i) {
+            j = i + 1;
+        }
+        total += count_piece(s.substr(i, j - i));
+        i = j;
+    }
+    return total;
+}
@@ -0,0 +1,36 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Estimates how many model tokens a piece of text costs. Text is first split
+// the way GPT-style tokenizers pre-tokenize (words with their leading space
+// or punctuation, digit groups of up to three, punctuation runs, whitespace).
+// With a vocabulary each piece is then BPE-merged by rank, otherwise a
+// heuristic tuned for Java identifiers and punctuation is used.
+class TokenCounter
+{
+public:
+    // One token per line. "<base64> <rank>" lines (tiktoken files) are
+    // decoded; any other line is taken literally, ranked by line number.
+    bool load_vocab(const std::string &path, std::string *error);
+
+    bool has_vocab() const { return !ranks_.empty(); }
+    const char *method() const { return has_vocab() ? "bpe" : "heuristic"; }
+
+    size_t count(std::string_view text);
+
+private:
+    size_t count_piece(std::string_view piece);
+    size_t bpe(std::string_view piece) const;
+
+    std::string arena_;   // vocabulary bytes, ranks_ keys point here
+    std::unordered_map<std::string_view, uint32_t> ranks_;
+    std::unordered_map<std::string, uint32_t> memo_;   // piece -> tokens
+};
@@ -0,0 +1,271 @@
+
+#include "workspace/trigram_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "workspace/index_io.h"
+
+
+// On-disk layout:
+//   header   64 bytes
+//   files    IndexFileList records + rel paths
+//   table    ntrigrams x { u32 trigram, u32 count, u64 postings_off }, sorted by trigram
+//   postings per trigram: ascending file ids as varint deltas (first delta from 0)
+static const char kMagic[8] = {'C', 'G', 'T', 'R', 'I', '0', '0', '1'};
+
+static constexpr size_t kHeaderSize = 64;
+static constexpr size_t kFileRecSize = IndexFileList::kRecordSize;
+static constexpr size_t kTriRecSize = 16;
+
+
+static inline uint32_t trigram_at(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+}
+
+
+std::string trigram_index_path(const std::string &index_dir)
+{
+    return index_dir + "/trigrams.idx";
+}
+
+
+namespace
+{
+
+struct Posting
+{
+    uint32_t last = 0;
+    uint32_t count = 0;
+    std::vector<uint8_t> bytes;
+};
+
+} // namespace
+
+
+bool build_trigram_index(const FileTable &files,
+                         const std::string &out_path,
+                         TrigramBuildStats *stats,
+                         std::string *error)
+{
+    TrigramBuildStats st;
+
+    std::unordered_map<uint32_t, Posting> lists;
+    std::string header_files;
+    std::string paths;
+
+    std::string src;
+    std::vector<uint32_t> tris;
+
+    uint32_t idx = 0;
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (!files.alive(id)) {
+            continue;
+        }
+        // unreadable files still get a record, so queries treat them as stale rather than absent
+        bool readable = read_file_bytes(files.abs_path(id), &src);
+        IndexFileList::append(files, id, readable, &header_files, &paths);
+        if (!readable) {
+            st.unreadable += 1;
+            idx++;
+            continue;
+        }
+        st.bytes_read += src.size();
+
+        tris.clear();
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(src.data());
+        for (size_t i = 0; i + 3 <= src.size(); i++) {
+            tris.push_back(trigram_at(p + i));
+        }
+        std::sort(tris.begin(), tris.end());
+        tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+
+        for (uint32_t t : tris) {
+            Posting &pl = lists[t];
+            put_varint(&pl.bytes, idx - pl.last);
+            pl.last = idx;
+            pl.count += 1;
+        }
+        st.postings += tris.size();
+        idx++;
+    }
+    st.files = idx;
+
+    std::vector<uint32_t> keys;
+    keys.reserve(lists.size());
+    for (const auto &kv : lists) {
+        keys.push_back(kv.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    st.trigrams = keys.size();
+
+    std::string out;
+    out.resize(kHeaderSize, '\0');
+    size_t files_off = out.size();
+    out += header_files;
+    size_t paths_off = out.size();
+    out += paths;
+    index_pad8(&out);
+    size_t table_off = out.size();
+
+    uint64_t post_pos = 0;
+    for (uint32_t t : keys) {
+        const Posting &pl = lists[t];
+        index_store<uint32_t>(&out, t);
+        index_store<uint32_t>(&out, pl.count);
+        index_store<uint64_t>(&out, post_pos);
+        post_pos += pl.bytes.size();
+    }
+    size_t post_off = out.size();
+    for (uint32_t t : keys) {
+        const Posting &pl = lists[t];
+        out.append(reinterpret_cast<const char *>(pl.bytes.data()), pl.bytes.size());
+    }
+    st.postings_bytes = post_pos;
+
+    std::memcpy(&out[0], kMagic, sizeof(kMagic));
+    index_store_at<uint32_t>(&out, 8, idx);
+    index_store_at<uint32_t>(&out, 12, static_cast<uint32_t>(keys.size()));
+    index_store_at<uint64_t>(&out, 16, files_off);
+    index_store_at<uint64_t>(&out, 24, paths_off);
+    index_store_at<uint64_t>(&out, 32, table_off);
+    index_store_at<uint64_t>(&out, 40, post_off);
+    index_store_at<uint64_t>(&out, 48, out.size());
+    st.index_bytes = out.size();
+
+    if (!write_file_atomic(out_path, out, error)) {
+        return false;
+    }
+
+    if (stats) {
+        *stats = st;
+    }
+    return true;
+}
+
+
+bool TrigramIndex::open(const std::string &path, std::string *error)
+{
+    if (!map_.open(path)) {
+        *error = "open(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+    const unsigned char *base = map_.data();
+    size_t size = map_.size();
+
+    if (size < kHeaderSize || std::memcmp(base, kMagic, sizeof(kMagic)) != 0) {
+        *error = "not a trigram index: " + path;
+        map_.close();
+        return false;
+    }
+
+    nfiles_ = index_load<uint32_t>(base + 8);
+    ntrigrams_ = index_load<uint32_t>(base + 12);
+    uint64_t files_off = index_load<uint64_t>(base + 16);
+    uint64_t paths_off = index_load<uint64_t>(base + 24);
+    uint64_t table_off = index_load<uint64_t>(base + 32);
+    uint64_t post_off = index_load<uint64_t>(base + 40);
+    uint64_t total = index_load<uint64_t>(base + 48);
+
+    bool ok = total == size &&
+              files_off == kHeaderSize &&
+              paths_off == files_off + static_cast<uint64_t>(nfiles_) * kFileRecSize &&
+              paths_off <= table_off &&
+              post_off == table_off + static_cast<uint64_t>(ntrigrams_) * kTriRecSize &&
+              post_off <= size;
+    if (!ok) {
+        *error = "corrupt trigram index: " + path;
+        map_.close();
+        return false;
+    }
+
+    files_.init(base + files_off, base + paths_off, nfiles_);
+    table_ = base + table_off;
+    post_ = base + post_off;
+    end_ = base + size;
+    return true;
+}
+
+
+bool TrigramIndex::postings(uint32_t trigram, uint32_t *count, const unsigned char **p) const
+{
+    size_t lo = 0;
+    size_t hi = ntrigrams_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t t = index_load<uint32_t>(table_ + mid * kTriRecSize);
+        if (t < trigram) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == ntrigrams_ || index_load<uint32_t>(table_ + lo * kTriRecSize) != trigram) {
+        return false;
+    }
+    const unsigned char *rec = table_ + lo * kTriRecSize;
+    *count = index_load<uint32_t>(rec + 4);
+    *p = post_ + index_load<uint64_t>(rec + 8);
+    return *p <= end_;
+}
+
+
+static void decode_list(const unsigned char *p, const unsigned char *end, uint32_t count,
+                        std::vector<uint32_t> *out)
+{
+    out->clear();
+    out->reserve(count);
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < count && p; i++) {
+        uint32_t d = 0;
+        p = get_varint(p, end, &d);
+        if (!p) break;
+        id += d;
+        out->push_back(id);
+    }
+}
+
+
+std::vector<uint32_t> TrigramIndex::query(const std::vector<uint32_t> &trigrams) const
+{
+    struct List
+    {
+        uint32_t count;
+        const unsigned char *p;
+    };
+    std::vector<List> lists;
+    lists.reserve(trigrams.size());
+    for (uint32_t t : trigrams) {
+        List l;
+        if (!postings(t, &l.count, &l.p)) {
+            // some required trigram occurs nowhere
+            return {};
+        }
+        lists.push_back(l);
+    }
+    if (lists.empty()) {
+        return {};
+    }
+
+    // shortest list first keeps every intersection step small
+    std::sort(lists.begin(), lists.end(), [](const List &a, const List &b) { return a.count < b.count; });
+
+    std::vector<uint32_t> acc;
+    decode_list(lists[0].p, end_, lists[0].count, &acc);
+
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> merged;
+    for (size_t i = 1; i < lists.size() && !acc.empty(); i++) {
+        decode_list(lists[i].p, end_, lists[i].count, &next);
+        merged.clear();
+        std::set_intersection(acc.begin(), acc.end(), next.begin(), next.end(), std::back_inserter(merged));
+        acc.swap(merged);
+    }
+    return acc;
+}
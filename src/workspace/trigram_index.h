@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sys/mmap_file.h"
+#include "workspace/file_table.h"
+#include "workspace/index_io.h"
+
+
+std::string trigram_index_path(const std::string &index_dir);
+
+
+struct TrigramBuildStats
+{
+    size_t files = 0;
+    size_t unreadable = 0;
+    uint64_t bytes_read = 0;
+    size_t trigrams = 0;        // distinct trigrams
+    size_t postings = 0;        // (trigram, file) pairs
+    uint64_t postings_bytes = 0;
+    uint64_t index_bytes = 0;
+};
+
+
+// Byte trigrams of every live file in the table, written to out_path as one
+// file: header, per-file records (rel path, size, mtime), a sorted trigram
+// table and delta+varint encoded posting lists. Written to a temp file and
+// renamed into place, so readers never see a partial index.
+bool build_trigram_index(const FileTable &files,
+                         const std::string &out_path,
+                         TrigramBuildStats *stats,
+                         std::string *error);
+
+
+// Read side; the file is mmap'd and nothing is decoded until a query.
+// Index-local file ids are 0..file_count() in the order they were indexed.
+class TrigramIndex
+{
+public:
+    bool open(const std::string &path, std::string *error);
+
+    uint32_t file_count() const { return nfiles_; }
+    uint32_t trigram_count() const { return ntrigrams_; }
+
+    const IndexFileList &files() const { return files_; }
+
+    // Sorted index-local ids of files containing every trigram; empty input
+    // means "no constraint" and is the caller's job to avoid.
+    std::vector<uint32_t> query(const std::vector<uint32_t> &trigrams) const;
+
+private:
+    bool postings(uint32_t trigram, uint32_t *count, const unsigned char **p) const;
+
+    MappedFile map_;
+    uint32_t nfiles_ = 0;
+    uint32_t ntrigrams_ = 0;
+    IndexFileList files_;
+    const unsigned char *table_ = nullptr;
+    const unsigned char *post_ = nullptr;
+    const unsigned char *end_ = nullptr;
+};
@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sys/fd.h"
+#include "workspace/scanner.h"
+
+
+// One debounced burst of filesystem activity, coalesced per path.
+struct WatchBatch
+{
+    std::vector<std::string> changed;       // abs paths of created/modified/moved-in files
+    std::vector<std::string> removed;       // abs paths of deleted/moved-out files
+    std::vector<std::string> rescan_dirs;   // new subtrees whose contents must be scanned
+    std::vector<std::string> removed_dirs;  // subtrees that disappeared
+    bool overflow = false;                  // kernel queue overflowed: rescan everything
+    int events = 0;
+};
+
+
+struct WatchStats
+{
+    int watched_dirs = 0;
+    int unwatched_dirs = 0;   // subtrees skipped because the watch limit was hit
+    int events = 0;
+    int batches = 0;
+};
+
+
+// Recursive inotify watcher over a workspace. Directories named in
+// ScanOptions::exclude_dir_names are never watched. When inotify runs out of
+// watch descriptors, the subtree is recorded in unwatched() so the caller can
+// fall back to periodic rescans of just those directories.
+class WorkspaceWatcher
+{
+public:
+    WorkspaceWatcher(const std::string &root_dir, const ScanOptions &opt);
+
+    bool start(std::string *error);
+
+    // Wait up to timeout_ms for activity, then keep draining until debounce_ms
+    // pass without events (bounded by max_batch_ms). False if nothing arrived.
+    bool wait_batch(int timeout_ms, int debounce_ms, int max_batch_ms, WatchBatch *out);
+
+    // Try to watch previously unwatched subtrees again; returns how many succeeded.
+    int retry_unwatched();
+
+    // After an overflow: watch directories created while events were lost and
+    // drop unwatched entries that no longer exist. Returns the new watches.
+    int rewatch();
+
+    const std::vector<std::string> &unwatched() const { return unwatched_; }
+    const std::string &root() const { return root_; }
+    WatchStats stats() const;
+
+private:
+    void add_tree(const std::string &dir, std::vector<std::string> *added);
+    int add_one(const std::string &dir);
+    void drain(WatchBatch *out);
+    void forget_tree(const std::string &dir);
+
+    std::string root_;
+    ScanOptions opt_;
+    Fd fd_;
+    std::unordered_map<int, std::string> wd_dirs_;
+    std::vector<std::string> unwatched_;
+
+    // coalesced state of the batch being collected; true = changed, false = removed
+    std::unordered_map<std::string, bool> pending_files_;
+    std::unordered_set<std::string> pending_new_dirs_;
+    std::unordered_set<std::string> pending_gone_dirs_;
+
+    int events_ = 0;
+    int batches_ = 0;
+};
@@ -0,0 +1,288 @@
+
+#include "workspace/watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+
+namespace fs = std::filesystem;
+
+
+static const uint32_t kWatchMask =
+    IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_ONLYDIR;
+
+
+static bool under(const std::string &path, const std::string &dir)
+{
+    return path.size() > dir.size() &&
+           path.compare(0, dir.size(), dir) == 0 &&
+           path[dir.size()] == '/';
+}
+
+
+WorkspaceWatcher::WorkspaceWatcher(const std::string &root_dir, const ScanOptions &opt)
+    : root_(workspace_root(root_dir)), opt_(opt)
+{
+}
+
+
+bool WorkspaceWatcher::start(std::string *error)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        *error = std::string("inotify_init1: ") + std::strerror(errno);
+        return false;
+    }
+    fd_.reset(fd);
+    add_tree(root_, nullptr);
+    return true;
+}
+
+
+int WorkspaceWatcher::add_one(const std::string &dir)
+{
+    int wd = inotify_add_watch(fd_.get(), dir.c_str(), kWatchMask);
+    if (wd < 0) {
+        return errno;
+    }
+    wd_dirs_[wd] = dir;
+    return 0;
+}
+
+
+void WorkspaceWatcher::add_tree(const std::string &dir, std::vector<std::string> *added)
+{
+    std::vector<std::string> stack;
+    stack.push_back(dir);
+
+    while (!stack.empty()) {
+        std::string cur = std::move(stack.back());
+        stack.pop_back();
+
+        int err = add_one(cur);
+        if (err == ENOSPC) {
+            // out of watch descriptors (fs.inotify.max_user_watches); poll this subtree instead
+            if (std::find(unwatched_.begin(), unwatched_.end(), cur) == unwatched_.end()) {
+                unwatched_.push_back(cur);
+            }
+            continue;
+        }
+        if (err != 0) {
+            // vanished or unreadable
+            continue;
+        }
+        if (added) {
+            added->push_back(cur);
+        }
+
+        std::error_code ec;
+        fs::directory_iterator it(cur, fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            if (!it->is_directory(ec) || it->is_symlink(ec)) {
+                ec.clear();
+                continue;
+            }
+            std::string name = it->path().filename().string();
+            if (is_excluded_dir_name(opt_, name)) {
+                continue;
+            }
+            stack.push_back(it->path().string());
+        }
+    }
+}
+
+
+void WorkspaceWatcher::forget_tree(const std::string &dir)
+{
+    for (const auto &kv : wd_dirs_) {
+        if (kv.second == dir || under(kv.second, dir)) {
+            // the kernel answers with IN_IGNORED, which erases the entry
+            inotify_rm_watch(fd_.get(), kv.first);
+        }
+    }
+    unwatched_.erase(std::remove_if(unwatched_.begin(), unwatched_.end(),
+                                    [&](const std::string &u) { return u == dir || under(u, dir); }),
+                     unwatched_.end());
+}
+
+
+void WorkspaceWatcher::drain(WatchBatch *out)
+{
+    alignas(struct inotify_event) char buf[64 * 1024];
+
+    for (;;) {
+        ssize_t n = read(fd_.get(), buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: queue drained
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            events_ += 1;
+            out->events += 1;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                out->overflow = true;
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                wd_dirs_.erase(ev->wd);
+                continue;
+            }
+
+            auto it = wd_dirs_.find(ev->wd);
+            if (it == wd_dirs_.end() || ev->len == 0) {
+                continue;
+            }
+
+            std::string name(ev->name);
+            std::string path = it->second + "/" + name;
+
+            if (ev->mask & IN_ISDIR) {
+                if (is_excluded_dir_name(opt_, name)) {
+                    continue;
+                }
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // files may land before the new watch exists, so rescan the subtree too
+                    add_tree(path, nullptr);
+                    pending_gone_dirs_.erase(path);
+                    pending_new_dirs_.insert(path);
+                } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    forget_tree(path);
+                    pending_new_dirs_.erase(path);
+                    pending_gone_dirs_.insert(path);
+                }
+                continue;
+            }
+
+            if (!has_included_ext(opt_, name)) {
+                continue;
+            }
+            if (ev->mask & (IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO)) {
+                pending_files_[path] = true;
+            } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                pending_files_[path] = false;
+            }
+        }
+    }
+}
+
+
+bool WorkspaceWatcher::wait_batch(int timeout_ms, int debounce_ms, int max_batch_ms, WatchBatch *out)
+{
+    using clock = std::chrono::steady_clock;
+
+    *out = WatchBatch{};
+
+    pollfd pfd;
+    pfd.fd = fd_.get();
+    pfd.events = POLLIN;
+
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc <= 0) {
+        return false;
+    }
+    drain(out);
+
+    // coalesce the burst (branch switch, build, formatter run)
+    clock::time_point deadline = clock::now() + std::chrono::milliseconds(max_batch_ms);
+    for (;;) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+        int wait_ms = static_cast<int>(std::min<long long>(debounce_ms, left));
+        if (wait_ms <= 0) {
+            break;
+        }
+        rc = poll(&pfd, 1, wait_ms);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        drain(out);
+    }
+
+    for (const auto &kv : pending_files_) {
+        if (kv.second) {
+            out->changed.push_back(kv.first);
+        } else {
+            out->removed.push_back(kv.first);
+        }
+    }
+    out->rescan_dirs.assign(pending_new_dirs_.begin(), pending_new_dirs_.end());
+    out->removed_dirs.assign(pending_gone_dirs_.begin(), pending_gone_dirs_.end());
+    pending_files_.clear();
+    pending_new_dirs_.clear();
+    pending_gone_dirs_.clear();
+
+    std::sort(out->changed.begin(), out->changed.end());
+    std::sort(out->removed.begin(), out->removed.end());
+    std::sort(out->rescan_dirs.begin(), out->rescan_dirs.end());
+    std::sort(out->removed_dirs.begin(), out->removed_dirs.end());
+
+    batches_ += 1;
+    return out->overflow || !out->changed.empty() || !out->removed.empty() ||
+           !out->rescan_dirs.empty() || !out->removed_dirs.empty();
+}
+
+
+int WorkspaceWatcher::retry_unwatched()
+{
+    std::vector<std::string> dirs;
+    dirs.swap(unwatched_);
+    for (const std::string &d : dirs) {
+        add_tree(d, nullptr);
+    }
+    int still = 0;
+    for (const std::string &d : unwatched_) {
+        if (std::find(dirs.begin(), dirs.end(), d) != dirs.end()) {
+            still++;
+        }
+    }
+    return static_cast<int>(dirs.size()) - still;
+}
+
+
+int WorkspaceWatcher::rewatch()
+{
+    unwatched_.erase(std::remove_if(unwatched_.begin(), unwatched_.end(),
+                                    [](const std::string &u) {
+                                        std::error_code ec;
+                                        return !fs::is_directory(u, ec);
+                                    }),
+                     unwatched_.end());
+    // watched directories get their existing descriptor back from the kernel
+    size_t before = wd_dirs_.size();
+    add_tree(root_, nullptr);
+    return static_cast<int>(wd_dirs_.size() - std::min(before, wd_dirs_.size()));
+}
+
+
+WatchStats WorkspaceWatcher::stats() const
+{
+    WatchStats s;
+    s.watched_dirs = static_cast<int>(wd_dirs_.size());
+    s.unwatched_dirs = static_cast<int>(unwatched_.size());
+    s.events = events_;
+    s.batches = batches_;
+    return s;
+}
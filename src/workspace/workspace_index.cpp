@@ -0,0 +1,94 @@
+
+#include "workspace/workspace_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "workspace/index_io.h"
+
+
+void open_workspace_index(const std::string &repo_root,
+                          const std::string &index_dir,
+                          WorkspaceIndex *wi)
+{
+    wi->dir = index_dir.empty() ? default_index_dir(repo_root) : index_dir;
+    std::string err;
+    wi->has_trigrams = wi->trigrams.open(trigram_index_path(wi->dir), &err);
+    wi->has_idents = wi->idents.open(ident_index_path(wi->dir), &err);
+    wi->has_blooms = wi->blooms.open(bloom_index_path(wi->dir), &err);
+    wi->has_types = wi->types.open(type_index_path(wi->dir), &err);
+}
+
+
+// Unlike resolve's stale list, a record that was unusable at index time
+// only counts once its file changes; rebuilding wouldn't make it usable.
+static size_t stale_against(const IndexFileList &list, const FileTable &files)
+{
+    std::vector<bool> seen(files.size(), false);
+    size_t n = 0;
+    for (uint32_t i = 0; i < list.count(); i++) {
+        FileId id = files.find_rel(list.rel_path(i));
+        if (id == kNoFile || !files.alive(id)) {
+            n++;   // gone
+            continue;
+        }
+        seen[id] = true;
+        bool same = list.mtime(i) == files.mtime(id) &&
+                    (!list.usable(i) || list.size_bytes(i) == files.size_bytes(id));
+        if (!same) {
+            n++;
+        }
+    }
+    for (FileId id = 0; id < static_cast<FileId>(files.size()); id++) {
+        if (files.alive(id) && !seen[id]) {
+            n++;   // new
+        }
+    }
+    return n;
+}
+
+
+size_t workspace_index_stale_files(const WorkspaceIndex &wi, const FileTable &files)
+{
+    size_t n = 0;
+    if (wi.has_trigrams) {
+        n = std::max(n, stale_against(wi.trigrams.files(), files));
+    }
+    if (wi.has_idents) {
+        n = std::max(n, stale_against(wi.idents.files(), files));
+    }
+    if (wi.has_blooms) {
+        n = std::max(n, stale_against(wi.blooms.files(), files));
+    }
+    if (wi.has_types) {
+        n = std::max(n, stale_against(wi.types.files(), files));
+    }
+    return n;
+}
+
+
+bool build_workspace_index(const FileTable &files,
+                           const std::string &dir,
+                           double bloom_fp,
+                           WorkspaceIndexBuildStats *stats,
+                           std::string *error)
+{
+    if (!build_trigram_index(files, trigram_index_path(dir), &stats->trigrams, error)) {
+        return false;
+    }
+
+    using clock = std::chrono::steady_clock;
+    TypeIndexBuilder types;
+    clock::time_point tp = clock::now();
+    if (!build_ident_index(files, ident_index_path(dir), &stats->idents, error, &types)) {
+        return false;
+    }
+    stats->parse_us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - tp).count();
+
+    if (!types.write(type_index_path(dir), &stats->types, error)) {
+        return false;
+    }
+    return build_bloom_index(files, bloom_fp, bloom_index_path(dir), &stats->blooms, error);
+}
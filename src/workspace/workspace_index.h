@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "workspace/bloom_index.h"
+#include "workspace/java/ident_index.h"
+#include "workspace/java/type_index.h"
+#include "workspace/trigram_index.h"
+
+
+// The optional on-disk indexes written by the index command. Parts that are
+// missing or unreadable stay off and callers fall back to rg.
+struct WorkspaceIndex
+{
+    TrigramIndex trigrams;
+    IdentIndex idents;
+    BloomIndex blooms;
+    TypeIndex types;
+    std::string dir;   // where the parts were opened from
+
+    bool has_trigrams = false;
+    bool has_idents = false;
+    bool has_blooms = false;
+    bool has_types = false;
+};
+
+
+// Beyond this many files changed since indexing, an rg over just those costs
+// as much as one over the tree, and naming them all may overflow argv.
+static constexpr size_t kMaxStaleForIndex = 2000;
+
+
+// index_dir empty means default_index_dir(repo_root).
+void open_workspace_index(const std::string &repo_root,
+                          const std::string &index_dir,
+                          WorkspaceIndex *wi);
+
+
+// Files changed since the on-disk indexes were built: new, modified or gone.
+// Files that failed to read or parse at index time count only if they
+// changed since. The index parts are written together, so the largest
+// count of any open part is returned.
+size_t workspace_index_stale_files(const WorkspaceIndex &wi, const FileTable &files);
+
+
+struct WorkspaceIndexBuildStats
+{
+    TrigramBuildStats trigrams;
+    IdentBuildStats idents;
+    TypeBuildStats types;
+    BloomBuildStats blooms;
+    long long parse_us = 0;   // ident pass, which parses every file
+};
+
+// Writes every index part under dir, as the index command does.
+bool build_workspace_index(const FileTable &files,
+                           const std::string &dir,
+                           double bloom_fp,
+                           WorkspaceIndexBuildStats *stats,
+                           std::string *error);